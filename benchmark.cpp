@@ -0,0 +1,117 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "benchmark.hpp"
+#include "loglevel.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <ctime>
+#include <thread>
+
+namespace benchmark
+{
+  namespace
+  {
+    constexpr uint64_t MAX_ITERATIONS{uint64_t{1} << 40U};
+  }
+
+  /// @class Runner
+  /// @name add
+  /// @brief Adds a benchmark
+  /// @param[in] name : unique name, by convention group/case
+  /// @param[in] function : performs the operations
+  /// @throws None
+  void Runner::add(std::string name, Function function)
+  {
+    benchmarks_.emplace_back(std::move(name), std::move(function));
+  }
+
+  /// @class Runner
+  /// @name measure
+  /// @brief Times one run
+  /// @throws None
+  std::chrono::nanoseconds Runner::measure(const Function &function, const uint64_t iterations)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    function(iterations);
+    return std::chrono::steady_clock::now() - start;
+  }
+
+  /// @class Runner
+  /// @name run
+  /// @brief Runs the benchmarks matching the filter. The first runs also warm caches and the branch predictor
+  /// @param[out] progress : one line per benchmark
+  /// @returns one result per benchmark run
+  /// @throws None
+  std::vector<Result> Runner::run(std::ostream &progress) const
+  {
+    std::vector<Result> results;
+    progress << fmt::format("{:<40} {:>12} {:>12} {:>12} {:>12}\n", "benchmark", "iterations", "min ns/op", "median ns/op", "max ns/op");
+    for (const auto& [name, function] : benchmarks_)
+    {
+      if (name.find(filter_) == std::string::npos)
+        continue;
+
+      uint64_t iterations{1};
+      while (iterations < MAX_ITERATIONS)
+      {
+        const std::chrono::nanoseconds elapsed = measure(function, iterations);
+        if (elapsed >= min_time_)
+          break;
+
+        // aim a little above min_time, but never grow more than 10x from a run too short to be trusted
+        const double factor = elapsed.count() > 0 ? 1.2 * static_cast<double>(min_time_.count()) / static_cast<double>(elapsed.count()) : 10.0;
+        iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(factor, 2.0, 10.0));
+      }
+
+      std::vector<double> per_operation;
+      for (std::size_t i = 0; i < std::max<std::size_t>(repetitions_, 1); ++i)
+        per_operation.push_back(static_cast<double>(measure(function, iterations).count()) / static_cast<double>(iterations));
+      std::sort(per_operation.begin(), per_operation.end());
+
+      const Result& result = results.emplace_back(Result{name, iterations, per_operation.size(), per_operation.front(),
+                                                         per_operation[per_operation.size() / 2], per_operation.back()});
+      progress << fmt::format("{:<40} {:>12} {:>12.2f} {:>12.2f} {:>12.2f}\n", result.name, result.iterations, result.min_ns,
+                              result.median_ns, result.max_ns);
+      progress.flush();
+    }
+    return results;
+  }
+
+  /// @class Runner
+  /// @name writeJson
+  /// @brief Writes the results and the build context as JSON
+  /// @param[out] out : output
+  /// @param[in] results : results of run()
+  /// @throws None
+  void Runner::writeJson(std::ostream &out, const std::vector<Result> &results)
+  {
+    char date[32];
+    const std::time_t now = std::time(nullptr);
+    tm local{};
+    localtime_r(&now, &local);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &local);
+
+#ifdef NDEBUG
+    constexpr bool OPTIMIZED{true};
+#else
+    constexpr bool OPTIMIZED{false};
+#endif
+
+    out << "{\n  \"context\": {";
+    out << fmt::format(R"("date": "{}", "compiler": "{}", "ndebug": {}, "min_log_level": {}, "hardware_threads": {})",
+                       date, __VERSION__, OPTIMIZED, static_cast<int>(logging::MIN_LOG_LEVEL), std::thread::hardware_concurrency());
+    out << "},\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const Result& result = results[i];
+      out << fmt::format(R"(    {{"name": "{}", "iterations": {}, "repetitions": {}, "min_ns": {:.3f}, "median_ns": {:.3f}, "max_ns": {:.3f}}})",
+                         result.name, result.iterations, result.repetitions, result.min_ns, result.median_ns, result.max_ns);
+      out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+  }
+}
@@ -0,0 +1,70 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_BENCHMARK_HPP
+#define WEBSERVER_BENCHMARK_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace benchmark
+{
+  ///@brief Keeps the compiler from optimising a computed value away
+  template<typename T>
+  inline void doNotOptimize(const T& value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  ///@brief Body of a benchmark: performs the given number of operations. Setup belongs outside the returned function
+  using Function = std::function<void(uint64_t iterations)>;
+
+  struct Result
+  {
+    std::string name;
+    uint64_t iterations;          // per repetition
+    std::size_t repetitions;
+    double min_ns;                // per operation
+    double median_ns;
+    double max_ns;
+  };
+
+  ///@brief Minimal benchmark harness. The number of iterations is doubled until a run takes min_time, then the run is
+  ///       repeated and the minimum, median and maximum time per operation are reported. The median is the value to
+  ///       compare between commits, the spread tells how noisy the machine was
+  class Runner
+  {
+  private:
+    std::vector<std::pair<std::string, Function>> benchmarks_;
+    std::chrono::nanoseconds min_time_{std::chrono::milliseconds(200)};
+    std::size_t repetitions_{5};
+    std::string filter_;
+
+    [[nodiscard]] static std::chrono::nanoseconds measure(const Function& function, uint64_t iterations);
+
+  public:
+    void add(std::string name, Function function);
+
+    void setMinTime(std::chrono::nanoseconds min_time) { min_time_ = min_time; }
+    void setRepetitions(std::size_t repetitions) { repetitions_ = repetitions; }
+
+    ///@brief Only benchmarks whose name contains the filter are run
+    void setFilter(std::string filter) { filter_ = std::move(filter); }
+
+    ///@brief Runs the benchmarks in the order they were added, printing one line per benchmark to progress
+    std::vector<Result> run(std::ostream& progress) const;
+
+    ///@brief Writes the results and a description of the build as JSON, one benchmark per line so that two runs can
+    ///       be compared with diff
+    static void writeJson(std::ostream& out, const std::vector<Result>& results);
+  };
+}
+
+#endif //WEBSERVER_BENCHMARK_HPP
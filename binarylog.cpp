@@ -0,0 +1,283 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "binarylog.hpp"
+#include "logger.hpp"
+
+#include <fmt/args.h>
+#include <fmt/format.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace logging::binary
+{
+  namespace
+  {
+    constexpr uint8_t FLAG_THREAD_ID{1};
+
+    template<typename T>
+    void append(std::string &out, const T &value)
+    {
+      out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void appendString(std::string &out, std::string_view string)
+    {
+      append(out, static_cast<uint32_t>(string.size()));
+      out.append(string);
+    }
+
+    ///@brief Reads fixed size values and length prefixed strings from a byte range
+    class Reader
+    {
+    private:
+      const char* position_;
+      const char* const end_;
+
+    public:
+      explicit Reader(std::string_view data) : position_(data.data()), end_(data.data() + data.size())
+      {}
+
+      template<typename T>
+      bool read(T &value)
+      {
+        if (static_cast<std::size_t>(end_ - position_) < sizeof(T))
+          return false;
+        std::memcpy(&value, position_, sizeof(T));
+        position_ += sizeof(T);
+        return true;
+      }
+
+      bool readString(std::string_view &string)
+      {
+        uint32_t length;
+        if (!read(length) || static_cast<std::size_t>(end_ - position_) < length)
+          return false;
+        string = {position_, length};
+        position_ += length;
+        return true;
+      }
+    };
+
+    template<typename T>
+    bool readValue(std::istream &in, T &value)
+    {
+      return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    bool readString(std::istream &in, std::string &string)
+    {
+      uint32_t length;
+      if (!readValue(in, length))
+        return false;
+      string.resize(length);
+      return static_cast<bool>(in.read(string.data(), length));
+    }
+
+    struct Site
+    {
+      LogLevel level;
+      uint32_t line;
+      std::string file;
+      std::string function;
+      std::string format;
+    };
+
+    ///@brief Formats the arguments of an entry with the format string of its site
+    std::string formatEntry(std::string_view format, std::string_view file, std::string_view function, uint32_t line,
+                            std::string_view payload)
+    {
+      fmt::dynamic_format_arg_store<fmt::format_context> arguments;
+      Reader reader(payload);
+      ArgumentType type;
+      while (reader.read(type))
+      {
+        bool valid{false};
+        switch (type)
+        {
+          case ArgumentType::BOOL:
+          {
+            uint8_t value;
+            if ((valid = reader.read(value)))
+              arguments.push_back(value != 0);
+            break;
+          }
+          case ArgumentType::CHAR:
+          {
+            char value;
+            if ((valid = reader.read(value)))
+              arguments.push_back(value);
+            break;
+          }
+          case ArgumentType::SIGNED:
+          {
+            int64_t value;
+            if ((valid = reader.read(value)))
+              arguments.push_back(value);
+            break;
+          }
+          case ArgumentType::UNSIGNED:
+          {
+            uint64_t value;
+            if ((valid = reader.read(value)))
+              arguments.push_back(value);
+            break;
+          }
+          case ArgumentType::DOUBLE:
+          {
+            double value;
+            if ((valid = reader.read(value)))
+              arguments.push_back(value);
+            break;
+          }
+          case ArgumentType::STRING:
+          {
+            std::string_view value;
+            if ((valid = reader.readString(value)))
+              arguments.push_back(std::string{value});
+            break;
+          }
+        }
+
+        if (!valid)
+          break;
+      }
+
+      std::string message;
+      try
+      {
+        message = fmt::vformat(format, arguments);
+      }
+      catch (const fmt::format_error &)
+      {
+        // truncated entries lack arguments, the format string is the best there is
+        message = fmt::format("{} [truncated]", format);
+      }
+
+      if (line != 0)
+        message += fmt::format(" in File: {} Function: {} Line: {}", file, function, line);
+      return message;
+    }
+
+    ///@brief Formats an entry as a complete log line
+    std::string formatLine(const EntryHeader &header, LogLevel level, std::string_view message, const bool log_thread_id)
+    {
+      const timespec time{static_cast<time_t>(header.time / 1000000000U), static_cast<long>(header.time % 1000000000U)};
+      const std::optional<std::size_t> thread_id = log_thread_id ? std::optional<std::size_t>{header.thread_id} : std::nullopt;
+      return Logger::formatLine(Logger::formatTime(time), level, thread_id, message);
+    }
+  }
+
+  /// @name appendHeader
+  /// @brief Appends the magic number and the flags of a binary log
+  /// @param[out] out : output
+  /// @param[in] log_thread_id : the decoder shows the thread-ids
+  /// @throws None
+  void appendHeader(std::string &out, const bool log_thread_id)
+  {
+    out.append(MAGIC, sizeof(MAGIC));
+    append(out, static_cast<uint8_t>(log_thread_id ? FLAG_THREAD_ID : 0));
+  }
+
+  /// @name appendSite
+  /// @brief Appends the description of a site: id, level, line, file, function and format string
+  /// @param[out] out : output
+  /// @param[in] site : registered site
+  /// @throws None
+  void appendSite(std::string &out, const LogSite &site)
+  {
+    append(out, RecordType::SITE);
+    append(out, site.id.load(std::memory_order_relaxed));
+    append(out, static_cast<uint8_t>(site.level));
+    append(out, static_cast<uint32_t>(site.line));
+    appendString(out, site.file);
+    appendString(out, site.function);
+    appendString(out, site.format);
+  }
+
+  /// @name getEntrySite
+  /// @brief Id of the site an entry written by Encoder refers to
+  /// @param[in] entry : complete entry
+  /// @returns the site id, 0 if the entry is incomplete
+  /// @throws None
+  uint32_t getEntrySite(std::string_view entry)
+  {
+    EntryHeader header{};
+    if (entry.size() < sizeof(RecordType) + sizeof(EntryHeader))
+      return 0;
+    std::memcpy(&header, entry.data() + sizeof(RecordType), sizeof(header));
+    return header.site;
+  }
+
+  /// @name decodeEntry
+  /// @brief Converts a single entry written by Encoder into a text line, like decode() does
+  /// @param[in] entry : complete entry
+  /// @param[in] site : site the entry refers to
+  /// @param[in] log_thread_id : the line shows the thread-id
+  /// @returns the line, empty if the entry is incomplete
+  /// @throws None
+  std::string decodeEntry(std::string_view entry, const LogSite &site, const bool log_thread_id)
+  {
+    EntryHeader header{};
+    if (entry.size() < sizeof(RecordType) + sizeof(EntryHeader))
+      return {};
+    std::memcpy(&header, entry.data() + sizeof(RecordType), sizeof(header));
+
+    const std::string_view payload = entry.substr(sizeof(RecordType) + sizeof(EntryHeader), header.payload_size);
+    return formatLine(header, site.level, formatEntry(site.format, site.file, site.function, site.line, payload), log_thread_id);
+  }
+
+  /// @name decode
+  /// @brief Converts a binary log into the text format, one line per entry
+  /// @param[in] in : binary log
+  /// @param[out] out : text output
+  /// @returns false if the input is no binary log or is truncated
+  /// @throws None
+  bool decode(std::istream &in, std::ostream &out)
+  {
+    char magic[sizeof(MAGIC)];
+    uint8_t flags;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !readValue(in, flags))
+      return false;
+
+    std::unordered_map<uint32_t, Site> sites;
+    std::string payload;
+    RecordType type;
+    while (readValue(in, type))
+    {
+      if (type == RecordType::SITE)
+      {
+        uint32_t id;
+        uint8_t level;
+        Site site;
+        if (!readValue(in, id) || !readValue(in, level) || !readValue(in, site.line) || !readString(in, site.file) ||
+            !readString(in, site.function) || !readString(in, site.format))
+          return false;
+
+        site.level = static_cast<LogLevel>(level);
+        sites[id] = std::move(site);
+        continue;
+      }
+
+      EntryHeader header{};
+      if (type != RecordType::ENTRY || !readValue(in, header))
+        return false;
+
+      payload.resize(header.payload_size);
+      if (!in.read(payload.data(), header.payload_size))
+        return false;
+
+      const auto site = sites.find(header.site);
+      if (site == sites.end())
+        return false;
+
+      const Site& entry_site = site->second;
+      out << formatLine(header, entry_site.level,
+                        formatEntry(entry_site.format, entry_site.file, entry_site.function, entry_site.line, payload),
+                        (flags & FLAG_THREAD_ID) != 0);
+    }
+    return in.eof();
+  }
+}
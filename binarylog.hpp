@@ -0,0 +1,187 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_BINARYLOG_HPP
+#define WEBSERVER_BINARYLOG_HPP
+
+#include "loglevel.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace logging
+{
+  ///@brief Static description of a logging call site. Every LOG_* macro expansion owns one; in binary mode its
+  ///       location and format string are written to the log once, the records only refer to its id. A line of 0
+  ///       marks a site without location, e.g. Trace or plain Logger::log() calls
+  class LogSite
+  {
+  public:
+    const LogLevel level;
+    const char* const file;
+    const char* const function;
+    const unsigned line;
+
+    std::atomic<uint32_t> id{0};      // 0 until registered with the binary log
+    std::string_view format;          // set once on registration
+
+    constexpr LogSite(LogLevel level, const char* file, const char* function, unsigned line) : level(level), file(file),
+                                                                                             function(function), line(line)
+    {}
+
+    LogSite(const LogSite&) = delete;
+    LogSite& operator=(const LogSite&) = delete;
+  };
+
+  ///@brief Binary log file: a header followed by site and entry records in native byte order.
+  ///       Site records precede the first entry referring to them. Entries hold the raw arguments with a type tag each,
+  ///       the decoder formats them with the format string of the site
+  namespace binary
+  {
+    constexpr char MAGIC[8]{'W', 'S', 'B', 'L', 'O', 'G', '0', '1'};
+
+    ///@brief Entries larger than this are truncated: string arguments are cut, later arguments dropped
+    constexpr std::size_t MAX_ENTRY_SIZE{1024};
+
+    enum class RecordType : uint8_t
+    {
+      SITE = 1,
+      ENTRY = 2,
+    };
+
+    enum class ArgumentType : uint8_t
+    {
+      BOOL,
+      CHAR,
+      SIGNED,
+      UNSIGNED,
+      DOUBLE,
+      STRING,
+    };
+
+    ///@brief Fixed part of an entry, followed by payload_size bytes of arguments
+    struct EntryHeader
+    {
+      uint64_t time;        // nanoseconds since the epoch
+      uint64_t thread_id;
+      uint32_t site;
+      uint16_t payload_size;
+      uint16_t reserved;
+    };
+
+    ///@brief Writes an entry into a caller provided buffer. Running out of space truncates the entry instead of failing
+    class Encoder
+    {
+    private:
+      char* data_;
+      std::size_t capacity_;
+      std::size_t size_;
+
+      template<typename T>
+      void put(const T& value)
+      {
+        if (size_ + sizeof(T) > capacity_)
+        {
+          capacity_ = size_;   // nothing else fits behind a truncated argument either
+          return;
+        }
+        std::memcpy(data_ + size_, &value, sizeof(T));
+        size_ += sizeof(T);
+      }
+
+      void putString(std::string_view string)
+      {
+        if (size_ + sizeof(ArgumentType) + sizeof(uint32_t) > capacity_)
+        {
+          capacity_ = size_;
+          return;
+        }
+        put(ArgumentType::STRING);
+        const auto length = static_cast<uint32_t>(std::min(string.size(), capacity_ - size_ - sizeof(uint32_t)));
+        put(length);
+        std::memcpy(data_ + size_, string.data(), length);
+        size_ += length;
+      }
+
+      template<typename T>
+      void putTagged(ArgumentType type, const T& value)
+      {
+        if (size_ + sizeof(ArgumentType) + sizeof(T) > capacity_)
+        {
+          capacity_ = size_;
+          return;
+        }
+        put(type);
+        put(value);
+      }
+
+    public:
+      ///@brief Starts an entry, the header is completed by finish()
+      Encoder(char* data, std::size_t capacity, uint32_t site, uint64_t time, uint64_t thread_id) : data_(data),
+                                                                                                    capacity_(capacity),
+                                                                                                    size_(0)
+      {
+        put(RecordType::ENTRY);
+        put(EntryHeader{time, thread_id, site, 0, 0});
+      }
+
+      template<typename T>
+      void putArgument(const T& value)
+      {
+        using Type = std::decay_t<T>;
+        if constexpr (std::is_same_v<Type, bool>)
+          putTagged(ArgumentType::BOOL, static_cast<uint8_t>(value));
+        else if constexpr (std::is_same_v<Type, char>)
+          putTagged(ArgumentType::CHAR, value);
+        else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>)
+          putTagged(ArgumentType::SIGNED, static_cast<int64_t>(value));
+        else if constexpr (std::is_integral_v<Type>)
+          putTagged(ArgumentType::UNSIGNED, static_cast<uint64_t>(value));
+        else if constexpr (std::is_floating_point_v<Type>)
+          putTagged(ArgumentType::DOUBLE, static_cast<double>(value));
+        else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+          putString(std::string_view{value});
+        else
+          putString(fmt::format("{}", value));   // anything else fmt can format is sent as text
+      }
+
+      ///@brief Fills in the payload size, returns the complete entry
+      std::string_view finish()
+      {
+        const auto payload_size = static_cast<uint16_t>(size_ - sizeof(RecordType) - sizeof(EntryHeader));
+        std::memcpy(data_ + sizeof(RecordType) + offsetof(EntryHeader, payload_size), &payload_size, sizeof(payload_size));
+        return {data_, size_};
+      }
+    };
+
+    ///@brief Appends the file header
+    void appendHeader(std::string& out, bool log_thread_id);
+
+    ///@brief Appends the description of a registered site
+    void appendSite(std::string& out, const LogSite& site);
+
+    ///@brief Id of the site an entry refers to, 0 if the entry is incomplete
+    uint32_t getEntrySite(std::string_view entry);
+
+    ///@brief Converts a single entry into a line of the text format, for entries which cannot go to a binary log
+    ///       anymore. Returns an empty string if the entry is incomplete
+    std::string decodeEntry(std::string_view entry, const LogSite& site, bool log_thread_id);
+
+    ///@brief Converts a binary log into the text format of the Logger. Returns false if the input is no binary log or
+    ///       ends in the middle of a record; everything before is still written
+    bool decode(std::istream& in, std::ostream& out);
+  }
+}
+
+#endif //WEBSERVER_BINARYLOG_HPP
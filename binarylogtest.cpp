@@ -0,0 +1,147 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "binarylog.hpp"
+#include "logger.hpp"
+
+#include <fmt/format.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+  namespace binary = logging::binary;
+
+  std::size_t failures{0};
+
+  constexpr uint64_t TIME{1760688000123456789};   // nanoseconds since the epoch
+  constexpr uint64_t THREAD_ID{4242};
+
+  void expectEqual(const std::string &check, const std::string &expected, const std::string &actual)
+  {
+    if (expected != actual)
+    {
+      ++failures;
+      std::cerr << check << ":\n  expected: " << expected << "  got:      " << actual << std::endl;
+    }
+  }
+
+  ///@brief The line Logger writes in text mode for a message logged at the given time
+  std::string textLine(logging::LogLevel level, const std::string &message, const bool log_thread_id)
+  {
+    const timespec time{static_cast<time_t>(TIME / 1000000000U), static_cast<long>(TIME % 1000000000U)};
+    return logging::Logger::formatLine(logging::Logger::formatTime(time), level,
+                                       log_thread_id ? std::optional<std::size_t>{THREAD_ID} : std::nullopt, message);
+  }
+
+  void registerSite(logging::LogSite &site, const uint32_t id, std::string_view format, std::string &log)
+  {
+    site.format = format;
+    site.id.store(id, std::memory_order_relaxed);
+    binary::appendSite(log, site);
+  }
+
+  template<typename... Args>
+  std::string encode(const logging::LogSite &site, const std::size_t capacity, const Args&... args)
+  {
+    char data[binary::MAX_ENTRY_SIZE];
+    binary::Encoder encoder(data, capacity, site.id.load(std::memory_order_relaxed), TIME, THREAD_ID);
+    (encoder.putArgument(args), ...);
+    return std::string{encoder.finish()};
+  }
+
+  std::string decode(const std::string &log, bool &valid)
+  {
+    std::istringstream in(log);
+    std::ostringstream out;
+    valid = binary::decode(in, out);
+    return out.str();
+  }
+}
+
+// Encodes entries, decodes them back and compares the result with the text format of the Logger
+int main()
+{
+  const std::string location{" in File: binarylogtest.cpp Function: main Line: 7"};
+  logging::LogSite typed{logging::LogLevel::WARNING, "binarylogtest.cpp", "main", 7};
+  logging::LogSite plain{logging::LogLevel::INFO, "", "", 0};
+
+  const void* pointer = reinterpret_cast<const void*>(0x1234);
+  const std::string long_string(2 * binary::MAX_ENTRY_SIZE, 'x');
+
+  for (const bool log_thread_id : {true, false})
+  {
+    std::string log;
+    binary::appendHeader(log, log_thread_id);
+    registerSite(typed, 1, "{} {} {} {} {} {} {} {}", log);
+    registerSite(plain, 2, "{}|{}", log);
+
+    std::string expected;
+
+    // every argument type, including one fmt formats before encoding
+    log += encode(typed, binary::MAX_ENTRY_SIZE, true, 'c', -42, 42U, 0.5, "text", std::string{"string"}, pointer);
+    expected += textLine(logging::LogLevel::WARNING, "true c -42 42 0.5 text string 0x1234" + location, log_thread_id);
+
+    // the extremes of the integer types survive the widening to 64 bits
+    log += encode(plain, binary::MAX_ENTRY_SIZE, INT64_MIN, UINT64_MAX);
+    expected += textLine(logging::LogLevel::INFO, fmt::format("{}|{}", INT64_MIN, UINT64_MAX), log_thread_id);
+
+    // a string longer than an entry is cut to the space left, the entry stays complete
+    const std::size_t kept = binary::MAX_ENTRY_SIZE - sizeof(binary::RecordType) - sizeof(binary::EntryHeader) -
+                             sizeof(binary::ArgumentType) - sizeof(uint32_t) - sizeof(binary::ArgumentType) - sizeof(int64_t);
+    log += encode(plain, binary::MAX_ENTRY_SIZE, 1, long_string);
+    expected += textLine(logging::LogLevel::INFO, "1|" + long_string.substr(0, kept), log_thread_id);
+
+    // an argument which does not fit is dropped with all behind it, the format string is shown instead
+    const std::size_t one_argument = sizeof(binary::RecordType) + sizeof(binary::EntryHeader) + sizeof(binary::ArgumentType) + sizeof(int64_t);
+    const std::string truncated = encode(typed, one_argument + 3, 1, 2, 3);
+    log += truncated;
+    expected += textLine(logging::LogLevel::WARNING, "{} {} {} {} {} {} {} {} [truncated]" + location, log_thread_id);
+
+    bool valid{false};
+    expectEqual(fmt::format("decode thread_id={}", log_thread_id), expected, decode(log, valid));
+    if (!valid)
+    {
+      ++failures;
+      std::cerr << "decode failed on a complete log" << std::endl;
+    }
+
+    // a single entry converts like in a complete log
+    expectEqual("decodeEntry", textLine(logging::LogLevel::WARNING, "{} {} {} {} {} {} {} {} [truncated]" + location, log_thread_id),
+                binary::decodeEntry(truncated, typed, log_thread_id));
+    if (binary::getEntrySite(truncated) != 1)
+    {
+      ++failures;
+      std::cerr << "getEntrySite: expected 1" << std::endl;
+    }
+
+    // a log cut in the middle of the last record keeps everything before it
+    const std::string last_line = textLine(logging::LogLevel::WARNING, "{} {} {} {} {} {} {} {} [truncated]" + location, log_thread_id);
+    const std::string cut = decode(log.substr(0, log.size() - 1), valid);
+    expectEqual("cut log", expected.substr(0, expected.size() - last_line.size()), cut);
+    if (valid)
+    {
+      ++failures;
+      std::cerr << "decode accepted a cut log" << std::endl;
+    }
+  }
+
+  bool valid{true};
+  decode("no binary log", valid);
+  if (valid)
+  {
+    ++failures;
+    std::cerr << "decode accepted a log without header" << std::endl;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "passed" << std::endl;
+  return 0;
+}
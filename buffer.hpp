@@ -0,0 +1,115 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_BUFFER_HPP
+#define WEBSERVER_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace container::buffer
+{
+  class BufferPool;
+
+  ///@brief Byte buffer with a fixed capacity which is filled from the front. Shared between the connection writing
+  ///       into it and the slices handed out to the application. The memory either comes from a BufferPool, which
+  ///       gets it back on destruction, or from the heap
+  class Buffer
+  {
+  private:
+    char* data_;
+    std::size_t capacity_;
+    std::size_t size_{0};
+    BufferPool* pool_{nullptr};
+
+  public:
+    // not value-initialised on purpose: every byte gets written by read() before it is exposed
+    explicit Buffer(std::size_t capacity) : data_(new char[capacity]), capacity_(capacity)
+    {}
+
+    Buffer(char* data, std::size_t capacity, BufferPool* pool) : data_(data), capacity_(capacity), pool_(pool)
+    {}
+
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    [[nodiscard]] const char* data() const { return data_; }
+    [[nodiscard]] char* data() { return data_; }
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] std::size_t capacity() const { return capacity_; }
+
+    [[nodiscard]] char* writePosition() { return data_ + size_; }
+    [[nodiscard]] std::size_t available() const { return capacity_ - size_; }
+
+    ///@brief Marks bytes written to writePosition() as used
+    void commit(std::size_t bytes) { size_ += bytes; }
+
+    ///@brief Drops the content. Only allowed while nobody else refers to it
+    void clear() { size_ = 0; }
+  };
+
+  ///@brief Read-only view into bytes which are kept alive by a reference counted owner. Copying a slice only
+  ///       touches the reference count, never the bytes
+  class BufferSlice
+  {
+  private:
+    std::shared_ptr<const void> owner_;
+    std::string_view view_;
+
+  public:
+    BufferSlice() = default;
+
+    BufferSlice(std::shared_ptr<const void> owner, std::string_view view) : owner_(std::move(owner)), view_(view)
+    {}
+
+    ///@brief Takes ownership of a string without copying its bytes
+    BufferSlice(std::string data)
+    {
+      auto owned = std::make_shared<const std::string>(std::move(data));
+      view_ = *owned;
+      owner_ = std::move(owned);
+    }
+
+    ///@brief Refers to bytes with static storage duration, e.g. string literals
+    static BufferSlice fromStatic(std::string_view data)
+    {
+      return {nullptr, data};
+    }
+
+    [[nodiscard]] std::string_view view() const { return view_; }
+    [[nodiscard]] const char* data() const { return view_.data(); }
+    [[nodiscard]] std::size_t size() const { return view_.size(); }
+    [[nodiscard]] bool empty() const { return view_.empty(); }
+
+    ///@brief Returns a slice of this slice sharing the same owner
+    [[nodiscard]] BufferSlice subslice(std::size_t offset, std::size_t length = std::string_view::npos) const
+    {
+      return {owner_, view_.substr(offset, length)};
+    }
+  };
+
+  ///@brief Bytes which are sent as one unit without joining them first, e.g. status line, headers and body of a response
+  using BufferSegments = std::vector<BufferSlice>;
+
+  ///@brief Part of an open file which is sent from the page cache (sendfile) instead of through a buffer. The owner
+  ///       keeps the file descriptor open until the region is sent
+  struct FileRegion
+  {
+    std::shared_ptr<const void> owner;
+    int fd{-1};
+    uint64_t offset{0};
+    std::size_t length{0};
+
+    [[nodiscard]] bool empty() const { return length == 0; }
+  };
+}
+
+#endif //WEBSERVER_BUFFER_HPP
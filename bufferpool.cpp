@@ -0,0 +1,166 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "bufferpool.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+
+#include <sys/mman.h>
+
+namespace container::buffer
+{
+  /// @class Buffer
+  /// @name ~Buffer
+  /// @brief destructor which hands pooled memory back to its pool and frees heap memory
+  /// @throws None
+  Buffer::~Buffer()
+  {
+    if (pool_)
+      pool_->release(data_, capacity_);
+    else
+      delete[] data_;
+  }
+
+  /// @class BufferPool
+  /// @name getInstance
+  /// @brief returns the process wide buffer pool. It is never destroyed, buffers may be released during static
+  ///        destruction
+  /// @throws None
+  BufferPool& BufferPool::getInstance()
+  {
+    static BufferPool* instance{new BufferPool()};
+    return *instance;
+  }
+
+  /// @class BufferPool
+  /// @name ~BufferPool
+  /// @brief destructor which unmaps all slabs
+  /// @throws None
+  BufferPool::~BufferPool()
+  {
+    for (void* slab : slabs_)
+    {
+      munmap(slab, SLAB_SIZE);
+    }
+  }
+
+  /// @class BufferPool
+  /// @name setUseHugePages
+  /// @brief Controls if slabs mapped from now on are backed by explicit huge pages (MAP_HUGETLB). If none are
+  ///        reserved the pool falls back to regular pages and asks for transparent huge pages instead
+  /// @param[in] use_huge_pages : true = map slabs with MAP_HUGETLB
+  /// @throws None
+  void BufferPool::setUseHugePages(bool use_huge_pages)
+  {
+    use_huge_pages_ = use_huge_pages;
+  }
+
+  /// @class BufferPool
+  /// @name acquire
+  /// @brief Returns an empty buffer of the smallest size class holding the requested number of bytes
+  /// @param[in] minimum_capacity : required capacity in bytes
+  /// @throws logging::SystemError
+  std::shared_ptr<Buffer> BufferPool::acquire(const std::size_t minimum_capacity)
+  {
+    std::size_t class_index{0};
+    while (class_index < SIZE_CLASSES.size() && SIZE_CLASSES[class_index] < minimum_capacity)
+    {
+      ++class_index;
+    }
+
+    if (class_index == SIZE_CLASSES.size())
+      return std::make_shared<Buffer>(minimum_capacity);
+
+    SizeClass& size_class = classes_[class_index];
+    std::lock_guard<std::mutex> guard(size_class.mutex);
+    if (size_class.free_blocks.empty())
+      refill(class_index);
+
+    char* block = size_class.free_blocks.back();
+    size_class.free_blocks.pop_back();
+    return std::make_shared<Buffer>(block, SIZE_CLASSES[class_index], this);
+  }
+
+  /// @class BufferPool
+  /// @name release
+  /// @brief Puts a block back onto the free list of its size class
+  /// @param[in] data : block handed out by acquire()
+  /// @param[in] capacity : size class of the block
+  /// @throws None
+  void BufferPool::release(char *data, const std::size_t capacity)
+  {
+    for (std::size_t class_index = 0; class_index < SIZE_CLASSES.size(); ++class_index)
+    {
+      if (SIZE_CLASSES[class_index] != capacity)
+        continue;
+
+      SizeClass& size_class = classes_[class_index];
+      std::lock_guard<std::mutex> guard(size_class.mutex);
+      size_class.free_blocks.push_back(data);
+      return;
+    }
+  }
+
+  /// @class BufferPool
+  /// @name getNumberSlabs
+  /// @brief Returns the number of slabs mapped so far
+  /// @throws None
+  std::size_t BufferPool::getNumberSlabs()
+  {
+    std::lock_guard<std::mutex> guard(slabs_mutex_);
+    return slabs_.size();
+  }
+
+  /// @class BufferPool
+  /// @name refill
+  /// @brief Maps a new slab and splits it into blocks of the given size class. Called with the class mutex held
+  /// @param[in] class_index : index into SIZE_CLASSES
+  /// @throws logging::SystemError
+  void BufferPool::refill(const std::size_t class_index)
+  {
+    const logging::Trace trace(__func__);
+    char* slab = static_cast<char*>(mapSlab());
+
+    const std::size_t block_size = SIZE_CLASSES[class_index];
+    std::vector<char*>& free_blocks = classes_[class_index].free_blocks;
+    free_blocks.reserve(free_blocks.size() + SLAB_SIZE / block_size);
+    // pushed backwards so blocks are handed out in address order
+    for (std::size_t offset = SLAB_SIZE; offset >= block_size; offset -= block_size)
+    {
+      free_blocks.push_back(slab + offset - block_size);
+    }
+  }
+
+  /// @class BufferPool
+  /// @name mapSlab
+  /// @brief Maps one slab of anonymous memory
+  /// @throws logging::SystemError
+  void* BufferPool::mapSlab()
+  {
+    void* slab{MAP_FAILED};
+    if (use_huge_pages_)
+    {
+      slab = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (slab == MAP_FAILED)
+      {
+        LOG_WARNING("Mapping huge pages failed, using regular pages ({})", strerror(errno));
+        use_huge_pages_ = false;
+      }
+    }
+
+    if (slab == MAP_FAILED)
+    {
+      slab = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slab == MAP_FAILED)
+      {
+        throw logging::SystemError(LOC, "Mapping buffer slab failed");
+      }
+      madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+    }
+
+    std::lock_guard<std::mutex> guard(slabs_mutex_);
+    slabs_.push_back(slab);
+    return slab;
+  }
+}
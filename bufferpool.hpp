@@ -0,0 +1,66 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_BUFFERPOOL_HPP
+#define WEBSERVER_BUFFERPOOL_HPP
+
+#include "buffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace container::buffer
+{
+  ///@brief Hands out buffers of a few fixed size classes. The memory of every class is carved out of 2 MiB slabs
+  ///       (optionally huge pages) and recycled through a free list, so steady state traffic does not allocate.
+  ///       Requests larger than the largest class fall back to the heap
+  class BufferPool
+  {
+  public:
+    static constexpr std::size_t SLAB_SIZE{2 * 1024 * 1024};
+    static constexpr std::array<std::size_t, 5> SIZE_CLASSES{4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024};
+
+  private:
+    struct SizeClass
+    {
+      std::mutex mutex;
+      std::vector<char*> free_blocks;
+    };
+
+    std::array<SizeClass, SIZE_CLASSES.size()> classes_;
+
+    std::mutex slabs_mutex_;
+    std::vector<void*> slabs_;
+    std::atomic<bool> use_huge_pages_{false};
+
+    BufferPool() = default;
+    ~BufferPool();
+
+    void* mapSlab();
+    void refill(std::size_t class_index);
+
+  public:
+    static BufferPool& getInstance();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ///@brief Controls if slabs mapped from now on are backed by explicit huge pages
+    void setUseHugePages(bool use_huge_pages);
+
+    ///@brief Returns an empty buffer with a capacity of at least the given number of bytes
+    std::shared_ptr<Buffer> acquire(std::size_t minimum_capacity);
+
+    ///@brief Gives a block of memory handed out by acquire() back to the pool
+    void release(char* data, std::size_t capacity);
+
+    [[nodiscard]] std::size_t getNumberSlabs();
+  };
+}
+
+#endif //WEBSERVER_BUFFERPOOL_HPP
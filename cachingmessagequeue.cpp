@@ -0,0 +1,204 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "cachingmessagequeue.hpp"
+#include "httprequest.hpp"
+
+namespace network::tcp
+{
+  std::size_t CachingMessageQueue::PendingKeyHash::operator()(const PendingKey &key) const
+  {
+    // sequence numbers count up per connection, mixing them in spreads the requests of one connection over the shards
+    const uint64_t value = (static_cast<uint64_t>(key.connection.getReactor()) << 48 | key.connection.getId()) ^
+                           (key.sequence * 0x9E3779B97F4A7C15ULL);
+    return static_cast<std::size_t>(value ^ (value >> 29));
+  }
+
+  /// @class CachingMessageQueue
+  /// @name CachingMessageQueue
+  /// @brief constructor
+  /// @param[in] queue : queue the requests missing the cache are passed on to, owned from now on
+  /// @param[in] cache : cache shared by all reactors and handlers
+  /// @throws None
+  CachingMessageQueue::CachingMessageQueue(std::unique_ptr<container::message_queue::Queue> queue, http::ResponseCache &cache) :
+    queue_(std::move(queue)), cache_(cache), pending_(std::make_unique<PendingShard[]>(NUMBER_PENDING_SHARDS))
+  {}
+
+  CachingMessageQueue::PendingShard& CachingMessageQueue::getPendingShard(const PendingKey &key) const
+  {
+    return pending_[PendingKeyHash{}(key) % NUMBER_PENDING_SHARDS];
+  }
+
+  /// @class CachingMessageQueue
+  /// @name answerFromCache
+  /// @brief Answers a request from the cache. On a miss of a cacheable request its key is kept for the response
+  /// @param[in] message : received request, moved from on a hit
+  /// @returns true if the request was answered
+  /// @throws None
+  bool CachingMessageQueue::answerFromCache(container::message_queue::Message &message)
+  {
+    const std::string_view data = message.getMessageString();
+    if (data.substr(0, 4) != "GET " && data.substr(0, 5) != "HEAD ")
+      return false;
+
+    http::RequestParser parser;
+    if (parser.parse(data) != http::RequestParser::Status::COMPLETE)
+      return false;
+
+    std::optional<std::string> key = http::ResponseCache::makeKey(parser.getRequest());
+    if (!key)
+      return false;
+
+    std::optional<OutboundResponse> cached = cache_.lookup(*key);
+    if (cached)
+    {
+      queue_->enqueueResponseMessage(message.respond(std::move(cached->segments), std::move(cached->file)));
+      return true;
+    }
+
+    const PendingKey pending_key{message.getConnection(), message.getSequence()};
+    PendingShard& shard = getPendingShard(pending_key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.keys.insert_or_assign(pending_key, std::move(*key));
+    return false;
+  }
+
+  /// @class CachingMessageQueue
+  /// @name forgetPending
+  /// @brief Drops the cache key of a request the queue refused, it is answered without a handler
+  /// @param[in] message : refused request
+  /// @throws None
+  void CachingMessageQueue::forgetPending(const container::message_queue::Message &message)
+  {
+    const PendingKey pending_key{message.getConnection(), message.getSequence()};
+    PendingShard& shard = getPendingShard(pending_key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.keys.erase(pending_key);
+  }
+
+  bool CachingMessageQueue::enqueueReceivedMessage(container::message_queue::Message &&message)
+  {
+    if (answerFromCache(message))
+      return true;
+
+    if (queue_->enqueueReceivedMessage(std::move(message)))
+      return true;
+
+    forgetPending(message);
+    return false;
+  }
+
+  container::message_queue::Message CachingMessageQueue::retrieveReceivedMessage()
+  {
+    return queue_->retrieveReceivedMessage();
+  }
+
+  /// @class CachingMessageQueue
+  /// @name enqueueReceivedMessages
+  /// @brief Answers the hits and passes the misses on in one batch
+  /// @param[in] messages : received requests, moved from
+  /// @param[in] count : number of requests
+  /// @returns number of requests answered or accepted; the ones the queue refused are moved to the end of the array
+  /// @throws None
+  std::size_t CachingMessageQueue::enqueueReceivedMessages(container::message_queue::Message *messages, const std::size_t count)
+  {
+    // the misses are moved together and passed on in one batch
+    std::size_t misses{0};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (answerFromCache(messages[i]))
+        continue;
+
+      if (misses != i)
+        messages[misses] = std::move(messages[i]);
+      ++misses;
+    }
+
+    const std::size_t accepted = queue_->enqueueReceivedMessages(messages, misses);
+    const std::size_t refused = misses - accepted;
+    for (std::size_t i = 1; i <= refused; ++i)
+    {
+      if (count != misses)
+        messages[count - i] = std::move(messages[misses - i]);
+      forgetPending(messages[count - i]);
+    }
+    return count - refused;
+  }
+
+  std::size_t CachingMessageQueue::retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, const std::size_t max_messages)
+  {
+    return queue_->retrieveReceivedMessages(messages, max_messages);
+  }
+
+  std::optional<container::message_queue::Message> CachingMessageQueue::retrieveResponseMessageNonBlocking()
+  {
+    return queue_->retrieveResponseMessageNonBlocking();
+  }
+
+  container::message_queue::Message CachingMessageQueue::retrieveResponseMessage()
+  {
+    return queue_->retrieveResponseMessage();
+  }
+
+  /// @class CachingMessageQueue
+  /// @name enqueueResponseMessage
+  /// @brief Stores the response to a request which missed the cache, then passes it on
+  /// @param[in] message : response created by a handler
+  /// @throws None
+  void CachingMessageQueue::enqueueResponseMessage(container::message_queue::Message &&message)
+  {
+    const PendingKey pending_key{message.getConnection(), message.getSequence()};
+    std::string key;
+    {
+      PendingShard& shard = getPendingShard(pending_key);
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      const auto it = shard.keys.find(pending_key);
+      if (it != shard.keys.end())
+      {
+        key = std::move(it->second);
+        shard.keys.erase(it);
+      }
+    }
+
+    if (!key.empty())
+    {
+      OutboundResponse response{message.releaseSegments(), message.releaseFile()};
+      if (http::ResponseCache::isCacheable(response))
+        cache_.store(std::move(key), response);
+
+      message = message.respond(std::move(response.segments), std::move(response.file));
+    }
+    queue_->enqueueResponseMessage(std::move(message));
+  }
+
+  void CachingMessageQueue::setResponseRouter(container::message_queue::ResponseRouter *router)
+  {
+    queue_->setResponseRouter(router);
+  }
+
+  void CachingMessageQueue::setCapacity(const std::size_t capacity, const container::message_queue::OverloadPolicy policy)
+  {
+    queue_->setCapacity(capacity, policy);
+  }
+
+  std::size_t CachingMessageQueue::getCapacity() const
+  {
+    return queue_->getCapacity();
+  }
+
+  container::message_queue::OverloadPolicy CachingMessageQueue::getOverloadPolicy() const
+  {
+    return queue_->getOverloadPolicy();
+  }
+
+  std::size_t CachingMessageQueue::getNumberReceivedMessages() const
+  {
+    return queue_->getNumberReceivedMessages();
+  }
+
+  void CachingMessageQueue::shutdown()
+  {
+    queue_->shutdown();
+  }
+}
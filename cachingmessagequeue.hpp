@@ -0,0 +1,88 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_CACHINGMESSAGEQUEUE_HPP
+#define WEBSERVER_CACHINGMESSAGEQUEUE_HPP
+
+#include "messagequeue.hpp"
+#include "responsecache.hpp"
+#include "ringbuffer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace network::tcp
+{
+  ///@brief Puts a ResponseCache in front of another message queue. Received requests are looked up by the reactor
+  ///       thread which read them; a hit is answered right away and never reaches the queue, so no handler thread
+  ///       wakes up for it. For a miss the key is remembered until the handler responds, then the response is stored
+  class CachingMessageQueue : public container::message_queue::Queue
+  {
+  private:
+    static constexpr std::size_t NUMBER_PENDING_SHARDS{16};
+
+    struct PendingKey
+    {
+      container::message_queue::ConnectionHandle connection;
+      uint64_t sequence;
+
+      bool operator==(const PendingKey& other) const
+      { return connection == other.connection && sequence == other.sequence; }
+    };
+
+    struct PendingKeyHash
+    {
+      std::size_t operator()(const PendingKey& key) const;
+    };
+
+    ///@brief Cache keys of the requests passed on to the handlers, by connection and sequence number
+    struct alignas(container::CACHE_LINE_SIZE) PendingShard
+    {
+      std::mutex mutex;
+      std::unordered_map<PendingKey, std::string, PendingKeyHash> keys;
+    };
+
+    std::unique_ptr<container::message_queue::Queue> queue_;
+    http::ResponseCache& cache_;
+    std::unique_ptr<PendingShard[]> pending_;
+
+    [[nodiscard]] PendingShard& getPendingShard(const PendingKey& key) const;
+    bool answerFromCache(container::message_queue::Message& message);
+    void forgetPending(const container::message_queue::Message& message);
+
+  public:
+    CachingMessageQueue(std::unique_ptr<container::message_queue::Queue> queue, http::ResponseCache& cache);
+
+    bool enqueueReceivedMessage(container::message_queue::Message &&message) override;
+
+    container::message_queue::Message retrieveReceivedMessage() override;
+
+    std::size_t enqueueReceivedMessages(container::message_queue::Message *messages, std::size_t count) override;
+
+    std::size_t retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, std::size_t max_messages) override;
+
+    std::optional<container::message_queue::Message> retrieveResponseMessageNonBlocking() override;
+
+    container::message_queue::Message retrieveResponseMessage() override;
+
+    void enqueueResponseMessage(container::message_queue::Message &&message) override;
+
+    void setResponseRouter(container::message_queue::ResponseRouter *router) override;
+
+    void setCapacity(std::size_t capacity, container::message_queue::OverloadPolicy policy) override;
+
+    [[nodiscard]] std::size_t getCapacity() const override;
+
+    [[nodiscard]] container::message_queue::OverloadPolicy getOverloadPolicy() const override;
+
+    [[nodiscard]] std::size_t getNumberReceivedMessages() const override;
+
+    void shutdown() override;
+  };
+}
+
+#endif //WEBSERVER_CACHINGMESSAGEQUEUE_HPP
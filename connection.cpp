@@ -0,0 +1,138 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "connection.hpp"
+#include "trace.hpp"
+#include "servermetrics.hpp"
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace network::tcp
+{
+  /// @class Connection
+  /// @name receive
+  /// @brief Reads from the non-blocking socket until the kernel buffer is drained (required by edge-triggered epoll).
+  ///        The bytes are read straight into the pooled receive buffer, which grows while a request keeps arriving,
+  ///        and complete requests are handed out as slices of it without copying. Reading stops for good after the
+  ///        last request of the connection
+  /// @param[in] handle : handle of the connection, the messages are addressed with it
+  /// @param[out] messages : one message per complete request gets appended
+  /// @param[in] now : time of the current loop iteration of the reactor
+  /// @returns WOULD_BLOCK unless reading failed
+  /// @throws None
+  Connection::ReadResult Connection::receive(const container::message_queue::ConnectionHandle handle,
+                                             std::vector<container::message_queue::Message> &messages,
+                                             const std::chrono::steady_clock::time_point now)
+  {
+    container::buffer::ReceiveBuffer& receive_buffer = protocol_.getReceiveBuffer();
+    while (protocol_.isAcceptingRequests())
+    {
+      if (!receive_buffer.prepare())
+      {
+        // taking the complete requests out may free enough room, otherwise the current request is too large
+        if (!protocol_.extractRequests(handle, messages, now))
+          break;
+
+        if (!receive_buffer.prepare())
+        {
+          protocol_.rejectTooLarge();
+          break;
+        }
+      }
+
+      const ssize_t bytes_received = read(socket_, receive_buffer.writePosition(), receive_buffer.writable());
+      if (bytes_received > 0)
+      {
+        receive_buffer.commit(bytes_received);
+        ServerMetrics::get().bytes_received.add(static_cast<uint64_t>(bytes_received));
+        continue;
+      }
+
+      if (bytes_received < 0 && errno == EINTR)
+        continue;
+
+      const int read_error = errno;
+      protocol_.extractRequests(handle, messages, now);
+
+      if (bytes_received == 0)
+      {
+        // the peer may shut down its side after the last request and still wait for the responses
+        protocol_.setLastRequest();
+        break;
+      }
+
+      if (read_error == EAGAIN || read_error == EWOULDBLOCK)
+        break;
+
+      LOG_WARNING("Read failed! fd: {} ({})", socket_.operator int(), strerror(read_error));
+      return ReadResult::FAILED;
+    }
+    protocol_.updateDeadline(false, now);
+    return ReadResult::WOULD_BLOCK;
+  }
+
+  /// @class Connection
+  /// @name flush
+  /// @brief Writes as much of the outbound queue as the socket accepts without blocking. Every call to sendmsg() gathers
+  ///        up to SendQueue::MAX_VECTORS slices, so headers and body of a response are never copied together; file
+  ///        regions go from the page cache to the socket with sendfile()
+  /// @param[in] now : time of the current loop iteration of the reactor
+  /// @returns false if sending failed and the connection should be closed
+  /// @throws None
+  bool Connection::flush(const std::chrono::steady_clock::time_point now)
+  {
+    SendQueue& send_queue = protocol_.getSendQueue();
+    iovec vectors[SendQueue::MAX_VECTORS];
+    bool progress{false};
+    while (hasPendingOutput())
+    {
+      ssize_t bytes_sent;
+      int file_fd;
+      off_t file_offset;
+      std::size_t file_length;
+      if (send_queue.getFrontFile(file_fd, file_offset, file_length))
+      {
+        bytes_sent = sendfile(socket_, file_fd, &file_offset, file_length);
+      }
+      else
+      {
+        msghdr message{};
+        message.msg_iov = vectors;
+        message.msg_iovlen = send_queue.gather(vectors, SendQueue::MAX_VECTORS);
+        bytes_sent = sendmsg(socket_, &message, MSG_NOSIGNAL);
+      }
+
+      if (bytes_sent > 0)
+      {
+        ServerMetrics::get().bytes_sent.add(static_cast<uint64_t>(bytes_sent));
+        send_queue.advance(bytes_sent);
+        progress = true;
+        continue;
+      }
+
+      if (bytes_sent < 0 && errno == EINTR)
+        continue;
+
+      if (bytes_sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      {
+        protocol_.updateDeadline(progress, now);
+        return true;
+      }
+
+      // sendfile() sends nothing once the file was truncated, the promised Content-Length can no longer be kept
+      if (bytes_sent == 0)
+        errno = EIO;
+
+      LOG_INFO("Send failed! fd: {} ({})", socket_.operator int(), strerror(errno));
+      ServerMetrics::get().send_failures.add();
+      return false;
+    }
+
+    if (progress)
+      LOG_DEBUG("Send successful! fd: {}", socket_.operator int());
+    protocol_.updateDeadline(progress, now);
+    return true;
+  }
+}
@@ -0,0 +1,58 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_CONNECTION_HPP
+#define WEBSERVER_CONNECTION_HPP
+
+#include "connectionprotocol.hpp"
+#include "messagequeue.hpp"
+#include "socketfiledescriptor.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace network::tcp
+{
+  ///@brief State of a single accepted, non-blocking persistent client connection. Requests are read until one of them
+  ///       closes the connection or the peer shuts its side down; responses are sent in request order. Instances are
+  ///       owned and accessed by exactly one reactor thread
+  class Connection
+  {
+  public:
+    enum class ReadResult
+    {
+      WOULD_BLOCK,
+      FAILED, ///< reading failed, the connection shall be closed right away
+    };
+
+  private:
+    SocketFileDescriptor socket_;
+    ConnectionProtocol protocol_;
+
+  public:
+    Connection(SocketFileDescriptor socket, std::chrono::steady_clock::time_point now)
+      : socket_(std::move(socket)), protocol_(socket_, SendQueue::FileTransfer::SENDFILE, now)
+    {}
+
+    Connection(Connection&&) noexcept = default;
+    Connection& operator=(Connection&&) noexcept = default;
+
+    [[nodiscard]] int getSocket() const { return socket_; }
+
+    [[nodiscard]] bool hasPendingOutput() const { return protocol_.hasPendingOutput(); }
+
+    ///@brief True once the response to the last request was sent completely
+    [[nodiscard]] bool isFinished() const { return protocol_.isFinished(); }
+
+    ///@brief Timeout currently applying to the connection, updated by receive() and flush()
+    [[nodiscard]] ConnectionDeadline& getDeadline() { return protocol_.getDeadline(); }
+
+    ReadResult receive(container::message_queue::ConnectionHandle handle, std::vector<container::message_queue::Message>& messages,
+                       std::chrono::steady_clock::time_point now);
+    void respond(uint64_t sequence, OutboundResponse response) { protocol_.respond(sequence, std::move(response)); }
+    bool flush(std::chrono::steady_clock::time_point now);
+  };
+}
+
+#endif //WEBSERVER_CONNECTION_HPP
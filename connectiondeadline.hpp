@@ -0,0 +1,117 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_CONNECTIONDEADLINE_HPP
+#define WEBSERVER_CONNECTIONDEADLINE_HPP
+
+#include "timerwheel.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace network::tcp
+{
+  ///@brief A request has to arrive completely within this time, counted from its first byte or, for the first
+  ///       request, from accepting the connection. Stops clients which trickle in their headers (Slowloris)
+  constexpr std::chrono::seconds HEADER_TIMEOUT{10};
+
+  ///@brief Outstanding responses have to make progress within this time: the worker pool has this long to answer a
+  ///       request, the client this long to accept more of a response
+  constexpr std::chrono::seconds REQUEST_TIMEOUT{30};
+
+  ///@brief Persistent connections without outstanding requests are closed after this time without receiving anything
+  constexpr std::chrono::seconds IDLE_TIMEOUT{30};
+
+  ///@brief Resolution of the timer wheels driving the timeouts, connections are closed up to this much late
+  constexpr std::chrono::milliseconds TIMER_RESOLUTION{10};
+
+  ///@brief Decides which timeout applies to a connection and keeps a timer armed for it. The timer is only moved if
+  ///       the deadline gets earlier; a timer expiring before the deadline is simply re-armed, so a busy connection
+  ///       costs no timer operations per request. Owned by the reactor thread like the connection
+  class ConnectionDeadline
+  {
+  public:
+    enum class Kind : uint8_t
+    {
+      HEADER,  ///< waiting for the rest of a request
+      REQUEST, ///< responses outstanding
+      IDLE,    ///< waiting for the next request
+    };
+
+  private:
+    Kind kind_{Kind::HEADER};
+    std::chrono::steady_clock::time_point since_;
+    container::TimerWheel::Handle timer_{container::TimerWheel::NO_TIMER};
+    std::chrono::steady_clock::time_point timer_expiry_;
+
+  public:
+    explicit ConnectionDeadline(std::chrono::steady_clock::time_point now = {}) : since_(now) {}
+
+    ///@brief Re-evaluates the timeout after reading or sending. The time restarts when the kind changes and when
+    ///       responses made progress
+    ///@param busy : requests without a completely sent response
+    ///@param request_started : part of a request was received, or no request yet
+    ///@param response_progress : bytes of a response were sent since the last update
+    void update(bool busy, bool request_started, bool response_progress, std::chrono::steady_clock::time_point now)
+    {
+      const Kind kind = busy ? Kind::REQUEST : (request_started ? Kind::HEADER : Kind::IDLE);
+      if (kind != kind_ || (kind == Kind::REQUEST && response_progress))
+      {
+        kind_ = kind;
+        since_ = now;
+      }
+    }
+
+    [[nodiscard]] Kind getKind() const { return kind_; }
+
+    [[nodiscard]] std::string_view getName() const
+    { return kind_ == Kind::HEADER ? "header" : (kind_ == Kind::REQUEST ? "request" : "idle"); }
+
+    [[nodiscard]] std::chrono::steady_clock::time_point get() const
+    {
+      switch (kind_)
+      {
+        case Kind::HEADER:
+          return since_ + HEADER_TIMEOUT;
+        case Kind::REQUEST:
+          return since_ + REQUEST_TIMEOUT;
+        default:
+          return since_ + IDLE_TIMEOUT;
+      }
+    }
+
+    ///@brief Makes sure a timer carrying the id expires no later than the deadline
+    void arm(container::TimerWheel& timers, uint64_t id)
+    {
+      const std::chrono::steady_clock::time_point deadline = get();
+      if (timer_ != container::TimerWheel::NO_TIMER && timer_expiry_ <= deadline)
+        return;
+
+      timers.cancel(timer_);
+      timer_ = timers.schedule(deadline, id);
+      timer_expiry_ = deadline;
+    }
+
+    ///@brief Called when the timer expired. Returns true if the deadline passed, otherwise the timer is re-armed
+    bool expire(container::TimerWheel& timers, uint64_t id, std::chrono::steady_clock::time_point now)
+    {
+      timer_ = container::TimerWheel::NO_TIMER;
+      if (now >= get())
+        return true;
+
+      arm(timers, id);
+      return false;
+    }
+
+    ///@brief Cancels the timer, e.g. when the connection is closed
+    void disarm(container::TimerWheel& timers)
+    {
+      timers.cancel(timer_);
+      timer_ = container::TimerWheel::NO_TIMER;
+    }
+  };
+}
+
+#endif //WEBSERVER_CONNECTIONDEADLINE_HPP
@@ -0,0 +1,100 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "connectionprotocol.hpp"
+#include "trace.hpp"
+#include "servermetrics.hpp"
+
+namespace network::tcp
+{
+  /// @class ConnectionProtocol
+  /// @name extractRequests
+  /// @brief Takes the complete requests out of the receive buffer and numbers them for the response order. A malformed
+  ///        request is answered with an error response and ends the connection
+  /// @param[in] handle : handle of the connection, the messages are addressed with it
+  /// @param[out] messages : one message per complete request gets appended
+  /// @param[in] now : time of the current loop iteration of the reactor, recorded as time of receipt
+  /// @returns false if no further requests are read from the connection
+  /// @throws None
+  bool ConnectionProtocol::extractRequests(const container::message_queue::ConnectionHandle handle,
+                                           std::vector<container::message_queue::Message> &messages,
+                                           const std::chrono::steady_clock::time_point now)
+  {
+    requests_.clear();
+    const http::RequestParser::Status status = parser_.extract(receive_buffer_, requests_);
+    for (auto& request : requests_)
+    {
+      LOG_INFO("Message received: {}", request.view());
+      messages.emplace_back(std::move(request), handle, sequencer_.admit(), now);
+    }
+
+    if (status == http::RequestParser::Status::COMPLETE)
+    {
+      sequencer_.setLastRequest();
+      return false;
+    }
+
+    if (status == http::RequestParser::Status::ERROR)
+    {
+      rejectRequest();
+      return false;
+    }
+    return true;
+  }
+
+  /// @class ConnectionProtocol
+  /// @name rejectTooLarge
+  /// @brief Answers the request which does not fit into the receive buffer, see rejectRequest()
+  /// @throws None
+  void ConnectionProtocol::rejectTooLarge()
+  {
+    parser_.rejectTooLarge();
+    rejectRequest();
+  }
+
+  /// @class ConnectionProtocol
+  /// @name rejectRequest
+  /// @brief Answers the request the parser rejected with an error response, which is the last one of the connection.
+  ///        It is sent after the responses to the requests before it
+  /// @throws None
+  void ConnectionProtocol::rejectRequest()
+  {
+    LOG_INFO("Rejecting malformed request! fd: {} status: {}", socket_, parser_.getErrorStatus());
+    ServerMetrics::get().rejected_requests.add();
+    const uint64_t sequence = sequencer_.admit();
+    sequencer_.setLastRequest();
+    sequencer_.release(sequence, {{http::errorResponse(parser_.getErrorStatus())}, {}}, send_queue_);
+  }
+
+  /// @class ConnectionProtocol
+  /// @name respond
+  /// @brief Hands over the response to a request. It is queued once the responses to all earlier requests are queued
+  /// @param[in] sequence : sequence number of the request
+  /// @param[in] response : segments and file region to send, kept alive until they are written. Empty to close the connection
+  /// @returns false if no response was expected for the sequence number, it is dropped
+  /// @throws None
+  bool ConnectionProtocol::respond(const uint64_t sequence, OutboundResponse response)
+  {
+    if (!sequencer_.release(sequence, std::move(response), send_queue_))
+    {
+      LOG_WARNING("Dropping unexpected response! fd: {} sequence: {}", socket_, sequence);
+      return false;
+    }
+    return true;
+  }
+
+  /// @class ConnectionProtocol
+  /// @name updateDeadline
+  /// @brief Picks the timeout for the state of the connection: the request timeout while responses are outstanding,
+  ///        the header timeout before the first request and while a request is arriving, the idle timeout otherwise
+  /// @param[in] response_progress : bytes of a response were sent since the last update
+  /// @param[in] now : time of the current loop iteration of the reactor
+  /// @throws None
+  void ConnectionProtocol::updateDeadline(const bool response_progress, const std::chrono::steady_clock::time_point now)
+  {
+    const bool busy = !sequencer_.isIdle() || hasPendingOutput();
+    const bool request_started = !sequencer_.hasRequests() || !receive_buffer_.pending().empty();
+    deadline_.update(busy, request_started, response_progress, now);
+  }
+}
@@ -0,0 +1,76 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_CONNECTIONPROTOCOL_HPP
+#define WEBSERVER_CONNECTIONPROTOCOL_HPP
+
+#include "buffer.hpp"
+#include "connectiondeadline.hpp"
+#include "httprequest.hpp"
+#include "messagequeue.hpp"
+#include "receivebuffer.hpp"
+#include "responsesequencer.hpp"
+#include "sendqueue.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace network::tcp
+{
+  ///@brief HTTP state of a persistent connection, independent of how its bytes are read and written: the receive
+  ///       buffer requests are parsed from, the order of their responses, the outbound queue and the timeout. Shared by
+  ///       the reactor backends, which only move bytes between the socket and these buffers. Owned and accessed by
+  ///       exactly one reactor thread
+  class ConnectionProtocol
+  {
+  private:
+    int socket_;   // only used in log messages
+    container::buffer::ReceiveBuffer receive_buffer_;
+    http::RequestParser parser_;
+    ResponseSequencer sequencer_;
+    std::vector<container::buffer::BufferSlice> requests_;
+    SendQueue send_queue_;
+    ConnectionDeadline deadline_;
+
+    void rejectRequest();
+
+  public:
+    ///@param socket : socket of the connection, for log messages
+    ///@param file_transfer : how the backend sends file regions
+    ///@param now : time the connection was accepted, the header timeout starts with it
+    ConnectionProtocol(int socket, SendQueue::FileTransfer file_transfer, std::chrono::steady_clock::time_point now)
+      : socket_(socket), send_queue_(file_transfer), deadline_(now)
+    {}
+
+    ConnectionProtocol(ConnectionProtocol&&) noexcept = default;
+    ConnectionProtocol& operator=(ConnectionProtocol&&) noexcept = default;
+
+    [[nodiscard]] container::buffer::ReceiveBuffer& getReceiveBuffer() { return receive_buffer_; }
+
+    [[nodiscard]] SendQueue& getSendQueue() { return send_queue_; }
+
+    [[nodiscard]] bool hasPendingOutput() const { return !send_queue_.empty(); }
+
+    ///@brief False once the last request of the connection was received
+    [[nodiscard]] bool isAcceptingRequests() const { return sequencer_.isAcceptingRequests(); }
+
+    ///@brief True once the response to the last request was queued and sent completely
+    [[nodiscard]] bool isFinished() const { return sequencer_.isFinished() && !hasPendingOutput(); }
+
+    ///@brief Timeout currently applying to the connection, picked by updateDeadline()
+    [[nodiscard]] ConnectionDeadline& getDeadline() { return deadline_; }
+
+    ///@brief No further requests are read, e.g. because the peer shut down its side
+    void setLastRequest() { sequencer_.setLastRequest(); }
+
+    bool extractRequests(container::message_queue::ConnectionHandle handle, std::vector<container::message_queue::Message>& messages,
+                         std::chrono::steady_clock::time_point now);
+    void rejectTooLarge();
+    bool respond(uint64_t sequence, OutboundResponse response);
+    void updateDeadline(bool response_progress, std::chrono::steady_clock::time_point now);
+  };
+}
+
+#endif //WEBSERVER_CONNECTIONPROTOCOL_HPP
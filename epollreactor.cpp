@@ -0,0 +1,500 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "epollreactor.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+#include "servermetrics.hpp"
+#include "httprequest.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+
+namespace network::tcp
+{
+  /// @class EpollReactor
+  /// @name EpollReactor
+  /// @brief constructor
+  /// @param[in] message_queue : queue which receives all messages read by this reactor
+  /// @param[in] index : index of the reactor, part of the handles of its connections
+  /// @throws logging::SystemError
+  EpollReactor::EpollReactor(container::message_queue::Queue &message_queue, const uint16_t index) : message_queue_(message_queue),
+                                                                                                    index_(index)
+  {
+    const logging::Trace trace(__func__);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+      throw logging::SystemError(LOC, "Creating epoll instance failed");
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0)
+    {
+      close(epoll_fd_);
+      throw logging::SystemError(LOC, "Creating eventfd failed");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = WAKEUP_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) < 0)
+    {
+      close(wakeup_fd_);
+      close(epoll_fd_);
+      throw logging::SystemError(LOC, "Registering eventfd failed");
+    }
+  }
+
+  /// @class EpollReactor
+  /// @name ~EpollReactor
+  /// @brief destructor which stops the reactor thread and closes all connections
+  /// @throws None
+  EpollReactor::~EpollReactor()
+  {
+    const logging::Trace trace(__func__);
+    stop();
+    connections_.clear();
+    close(wakeup_fd_);
+    close(epoll_fd_);
+  }
+
+  /// @class EpollReactor
+  /// @name watchListeningSocket
+  /// @brief Registers a non-blocking listening socket. Pending connections are accepted on the reactor thread
+  ///        and passed to the handler
+  /// @param[in] listen_fd : listening socket
+  /// @param[in] handler : accept handler
+  /// @throws logging::SystemError
+  void EpollReactor::watchListeningSocket(int listen_fd, AcceptHandler handler)
+  {
+    const logging::Trace trace(__func__);
+    listen_fd_ = listen_fd;
+    accept_handler_ = std::move(handler);
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = LISTENER_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) < 0)
+    {
+      throw logging::SystemError(LOC, "Registering listening socket failed");
+    }
+  }
+
+  /// @class EpollReactor
+  /// @name addConnection
+  /// @brief Hands an accepted connection over to this reactor. May be called from any thread
+  /// @param[in] socket : accepted, non-blocking socket
+  /// @throws None
+  void EpollReactor::addConnection(SocketFileDescriptor socket)
+  {
+    auto shared_socket = std::make_shared<SocketFileDescriptor>(std::move(socket));
+    post([this, shared_socket]() { registerConnection(std::move(*shared_socket)); });
+  }
+
+  /// @class EpollReactor
+  /// @name adoptConnection
+  /// @brief Registers a connection accepted by this reactor. Called by the accept handler on the reactor thread
+  /// @param[in] socket : accepted socket
+  /// @throws None
+  void EpollReactor::adoptConnection(SocketFileDescriptor socket)
+  {
+    registerConnection(std::move(socket));
+  }
+
+  /// @class EpollReactor
+  /// @name sendResponse
+  /// @brief Hands a response over to a connection owned by this reactor and flushes everything which is in order.
+  ///        May be called from any thread
+  /// @param[in] connection : handle of the connection
+  /// @param[in] sequence : sequence number of the request
+  /// @param[in] response : segments to send, none to close the connection
+  /// @param[in] file : file region sent behind the segments, may be empty
+  /// @throws None
+  void EpollReactor::sendResponse(const container::message_queue::ConnectionHandle connection, const uint64_t sequence, container::buffer::BufferSegments response,
+                                  container::buffer::FileRegion file)
+  {
+    post([this, id = connection.getId(), sequence, response = OutboundResponse{std::move(response), std::move(file)}]() mutable {
+      const auto it = connections_.find(id);
+      if (it == connections_.end())
+      {
+        LOG_DEBUG("Dropping response for closed connection! id: {}", id);
+        return;
+      }
+
+      it->second.respond(sequence, std::move(response));
+      flushConnection(id, it->second);
+    });
+  }
+
+  /// @class EpollReactor
+  /// @name setCpuAffinity
+  /// @brief Sets the CPU the reactor thread gets pinned to when it starts
+  /// @param[in] cpu : CPU index or NO_CPU_AFFINITY
+  /// @throws None
+  void EpollReactor::setCpuAffinity(int cpu)
+  {
+    cpu_ = cpu;
+  }
+
+  /// @class EpollReactor
+  /// @name start
+  /// @brief Starts the reactor thread
+  /// @throws None
+  void EpollReactor::start()
+  {
+    running_ = true;
+    worker_ = std::thread([this]() { run(); });
+    LOG_DEBUG("Started reactor thread (TID: {})", logging::formatThreadId(worker_.get_id()));
+  }
+
+  /// @class EpollReactor
+  /// @name stop
+  /// @brief Signals the reactor thread to leave its event loop and joins it
+  /// @throws None
+  void EpollReactor::stop()
+  {
+    running_ = false;
+    wakeup();
+
+    if (worker_.joinable() && worker_.get_id() != std::this_thread::get_id())
+      worker_.join();
+  }
+
+  /// @class EpollReactor
+  /// @name run
+  /// @brief Event loop executed by the reactor thread
+  /// @throws None
+  void EpollReactor::run()
+  {
+    const logging::Trace trace(__func__);
+    if (cpu_ != NO_CPU_AFFINITY && !pinCurrentThreadToCpu(cpu_))
+    {
+      LOG_WARNING("Pinning reactor thread to CPU {} failed", cpu_);
+    }
+
+    epoll_event events[MAX_EVENTS];
+    while (running_)
+    {
+      const int number_events = epoll_wait(epoll_fd_, events, MAX_EVENTS, getWaitTimeout());
+      if (number_events < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        LOG_ERROR("epoll_wait failed! ({})", strerror(errno));
+        return;
+      }
+
+      now_ = std::chrono::steady_clock::now();
+      for (int i = 0; i < number_events; ++i)
+      {
+        handleEvent(events[i].data.u64, events[i].events);
+      }
+
+      flushReceivedMessages();
+
+      if (reading_paused_ && hasQueueDrained(message_queue_))
+        resumeReading();
+
+      expireTimers();
+    }
+  }
+
+  /// @class EpollReactor
+  /// @name getWaitTimeout
+  /// @brief Milliseconds epoll_wait may block: until the next timer of the wheel, at most BACKPRESSURE_CHECK_INTERVAL
+  ///        while reading is paused
+  /// @returns timeout for epoll_wait, -1 to block until an event arrives
+  /// @throws None
+  int EpollReactor::getWaitTimeout() const
+  {
+    int timeout{-1};
+    if (const auto next_expiry = timers_.getNextExpiry())
+    {
+      const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*next_expiry - now_);
+      timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+    }
+
+    if (reading_paused_)
+    {
+      const auto backpressure_timeout = static_cast<int>(BACKPRESSURE_CHECK_INTERVAL.count());
+      timeout = timeout < 0 ? backpressure_timeout : std::min(timeout, backpressure_timeout);
+    }
+    return timeout;
+  }
+
+  /// @class EpollReactor
+  /// @name expireTimers
+  /// @brief Closes the connections whose deadline passed. A timer expiring before the deadline of its connection,
+  ///        because the connection moved on to a later one, is re-armed
+  /// @throws None
+  void EpollReactor::expireTimers()
+  {
+    timers_.advance(now_, expired_timers_);
+    for (const uint64_t id : expired_timers_)
+    {
+      const auto it = connections_.find(id);
+      if (it == connections_.end() || !it->second.getDeadline().expire(timers_, id, now_))
+        continue;
+
+      LOG_DEBUG("Closing connection after {} timeout! id: {}", it->second.getDeadline().getName(), id);
+      ServerMetrics::get().connection_timeouts.add();
+      closeConnection(id);
+    }
+    expired_timers_.clear();
+  }
+
+  /// @class EpollReactor
+  /// @name flushReceivedMessages
+  /// @brief Hands all messages read during one loop iteration to the message queue in a single batch. The messages
+  ///        the queue refuses are shed, once it is full under backpressure reading stops
+  /// @throws None
+  void EpollReactor::flushReceivedMessages()
+  {
+    if (received_messages_.empty())
+      return;
+
+    const std::size_t accepted = message_queue_.enqueueReceivedMessages(received_messages_.data(), received_messages_.size());
+    for (std::size_t i = accepted; i < received_messages_.size(); ++i)
+    {
+      shedRequest(received_messages_[i]);
+    }
+    received_messages_.clear();
+
+    if (!reading_paused_ && isQueueFull(message_queue_))
+    {
+      LOG_DEBUG("Message queue full, pausing reads! reactor: {}", index_);
+      ServerMetrics::get().read_pauses.add();
+      reading_paused_ = true;
+    }
+  }
+
+  /// @class EpollReactor
+  /// @name shedRequest
+  /// @brief Answers a request the message queue refused with 503 right away, in order with the other responses
+  /// @param[in] message : refused request
+  /// @throws None
+  void EpollReactor::shedRequest(const container::message_queue::Message &message)
+  {
+    ServerMetrics::get().shed_requests.add();
+    const uint64_t id = message.getConnection().getId();
+    const auto it = connections_.find(id);
+    if (it == connections_.end())
+      return;
+
+    it->second.respond(message.getSequence(), {{http::serviceUnavailableResponse()}, {}});
+    flushConnection(id, it->second);
+  }
+
+  /// @class EpollReactor
+  /// @name resumeReading
+  /// @brief Reads from the connections which became readable while reading was paused. Edge-triggered epoll does not
+  ///        report them again
+  /// @throws None
+  void EpollReactor::resumeReading()
+  {
+    LOG_DEBUG("Message queue drained, resuming reads! reactor: {}", index_);
+    reading_paused_ = false;
+
+    std::vector<uint64_t> deferred_reads;
+    deferred_reads.swap(deferred_reads_);
+    std::sort(deferred_reads.begin(), deferred_reads.end());
+    deferred_reads.erase(std::unique(deferred_reads.begin(), deferred_reads.end()), deferred_reads.end());
+    for (const uint64_t id : deferred_reads)
+    {
+      const auto it = connections_.find(id);
+      if (it == connections_.end())
+        continue;
+
+      Connection& connection = it->second;
+      if (connection.receive({index_, id}, received_messages_, now_) == Connection::ReadResult::FAILED)
+        closeConnection(id);
+      else
+        flushConnection(id, connection);
+    }
+
+    flushReceivedMessages();
+  }
+
+  /// @class EpollReactor
+  /// @name handleEvent
+  /// @brief Dispatches a single readiness notification
+  /// @param[in] id : epoll user data, the connection id or one of the reserved ids
+  /// @param[in] events : epoll event mask
+  /// @throws None
+  void EpollReactor::handleEvent(const uint64_t id, const uint32_t events)
+  {
+    if (id == WAKEUP_ID)
+    {
+      uint64_t counter;
+      while (read(wakeup_fd_, &counter, sizeof(counter)) > 0) {}
+      runPendingTasks();
+      return;
+    }
+
+    if (id == LISTENER_ID)
+    {
+      acceptConnections();
+      return;
+    }
+
+    const auto it = connections_.find(id);
+    if (it == connections_.end())
+      return;
+
+    Connection& connection = it->second;
+
+    if ((events & EPOLLIN) && reading_paused_)
+    {
+      deferred_reads_.push_back(id);
+    }
+    else if ((events & EPOLLIN) && connection.receive({index_, id}, received_messages_, now_) == Connection::ReadResult::FAILED)
+    {
+      closeConnection(id);
+      return;
+    }
+
+    if (events & (EPOLLHUP | EPOLLERR))
+    {
+      closeConnection(id);
+      return;
+    }
+
+    // rejected requests are answered right away
+    flushConnection(id, connection);
+  }
+
+  /// @class EpollReactor
+  /// @name flushConnection
+  /// @brief Writes what is queued for a connection after reading or responding. Once the last response is out the
+  ///        connection is done, otherwise its deadline timer follows the state it is left in
+  /// @param[in] id : id of the connection
+  /// @param[in] connection : the connection
+  /// @throws None
+  void EpollReactor::flushConnection(const uint64_t id, Connection &connection)
+  {
+    if (!connection.flush(now_) || connection.isFinished())
+    {
+      closeConnection(id);
+      return;
+    }
+
+    connection.getDeadline().arm(timers_, id);
+  }
+
+  /// @class EpollReactor
+  /// @name acceptConnections
+  /// @brief Accepts connections until accept() would block (required by edge-triggered epoll)
+  /// @throws None
+  void EpollReactor::acceptConnections()
+  {
+    const logging::Trace trace(__func__);
+    while (true)
+    {
+      const int accepted_socket = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (accepted_socket < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+          LOG_WARNING("Failed to accept incoming connection ({})", strerror(errno));
+        }
+        return;
+      }
+
+      accept_handler_(accepted_socket);
+    }
+  }
+
+  /// @class EpollReactor
+  /// @name registerConnection
+  /// @brief Adds an accepted connection to the epoll interest list. Executed by the reactor thread
+  /// @param[in] socket : accepted, non-blocking socket
+  /// @throws None
+  void EpollReactor::registerConnection(SocketFileDescriptor socket)
+  {
+    const int fd = socket;
+    const uint64_t id = next_connection_id_++;
+
+    // edge-triggered: EPOLLOUT only fires on transitions, so it can stay registered for the whole lifetime
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+      LOG_WARNING("Registering connection failed! fd: {} ({})", fd, strerror(errno));
+      return;
+    }
+
+    const auto it = connections_.emplace(id, Connection(std::move(socket), now_)).first;
+    it->second.getDeadline().arm(timers_, id);
+    ServerMetrics::get().open_connections.add();
+    LOG_DEBUG("Connection registered! fd: {} id: {}", fd, id);
+  }
+
+  /// @class EpollReactor
+  /// @name closeConnection
+  /// @brief Removes a connection from the reactor and closes its socket
+  /// @param[in] id : id of the connection
+  /// @throws None
+  void EpollReactor::closeConnection(const uint64_t id)
+  {
+    const auto it = connections_.find(id);
+    if (it == connections_.end())
+      return;
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.getSocket(), nullptr);
+    it->second.getDeadline().disarm(timers_);
+    connections_.erase(it);
+    ServerMetrics::get().open_connections.sub();
+  }
+
+  /// @class EpollReactor
+  /// @name post
+  /// @brief Queues a task for execution on the reactor thread
+  /// @param[in] task : task to execute
+  /// @throws None
+  void EpollReactor::post(std::function<void(void)> task)
+  {
+    {
+      std::lock_guard<std::mutex> guard(pending_tasks_mutex_);
+      pending_tasks_.emplace_back(std::move(task));
+    }
+    wakeup();
+  }
+
+  /// @class EpollReactor
+  /// @name wakeup
+  /// @brief Interrupts epoll_wait of the reactor thread
+  /// @throws None
+  void EpollReactor::wakeup() const
+  {
+    const uint64_t one{1};
+    [[maybe_unused]] const ssize_t result = write(wakeup_fd_, &one, sizeof(one));
+  }
+
+  /// @class EpollReactor
+  /// @name runPendingTasks
+  /// @brief Executes all tasks posted from other threads
+  /// @throws None
+  void EpollReactor::runPendingTasks()
+  {
+    std::vector<std::function<void(void)>> tasks;
+    {
+      std::lock_guard<std::mutex> guard(pending_tasks_mutex_);
+      tasks.swap(pending_tasks_);
+    }
+
+    for (auto& task : tasks)
+    {
+      task();
+    }
+  }
+}
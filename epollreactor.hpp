@@ -0,0 +1,94 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_EPOLLREACTOR_HPP
+#define WEBSERVER_EPOLLREACTOR_HPP
+
+#include "connection.hpp"
+#include "timerwheel.hpp"
+#include "reactor.hpp"
+#include "messagequeue.hpp"
+#include "socketfiledescriptor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace network::tcp
+{
+  ///@brief Edge-triggered epoll event loop running on its own thread. Drives accept, read and write for all connections registered with it
+  class EpollReactor : public Reactor
+  {
+  private:
+    static constexpr int MAX_EVENTS{128};
+
+    // epoll user data of the non-connection file descriptors, connection ids start above them
+    static constexpr uint64_t WAKEUP_ID{0};
+    static constexpr uint64_t LISTENER_ID{1};
+
+    int epoll_fd_{-1};
+    int wakeup_fd_{-1};
+    int listen_fd_{-1};
+    AcceptHandler accept_handler_;
+
+    container::message_queue::Queue& message_queue_;
+    const uint16_t index_;
+
+    // only accessed by the reactor thread
+    uint64_t next_connection_id_{LISTENER_ID + 1};
+    std::unordered_map<uint64_t, Connection> connections_;
+    std::vector<container::message_queue::Message> received_messages_;
+    std::chrono::steady_clock::time_point now_{std::chrono::steady_clock::now()};
+    container::TimerWheel timers_{TIMER_RESOLUTION, now_};   // one deadline timer per connection, the payload is its id
+    std::vector<uint64_t> expired_timers_;
+    bool reading_paused_{false};
+    std::vector<uint64_t> deferred_reads_;   // connections which became readable while reading was paused
+
+    std::mutex pending_tasks_mutex_;
+    std::vector<std::function<void(void)>> pending_tasks_;
+
+    int cpu_{NO_CPU_AFFINITY};
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+
+    void run();
+    [[nodiscard]] int getWaitTimeout() const;
+    void expireTimers();
+    void post(std::function<void(void)> task);
+    void wakeup() const;
+    void runPendingTasks();
+    void flushReceivedMessages();
+    void shedRequest(const container::message_queue::Message& message);
+    void resumeReading();
+
+    void acceptConnections();
+    void registerConnection(SocketFileDescriptor socket);
+    void handleEvent(uint64_t id, uint32_t events);
+    void closeConnection(uint64_t id);
+    void flushConnection(uint64_t id, Connection& connection);
+
+  public:
+    EpollReactor(container::message_queue::Queue& message_queue, uint16_t index);
+    ~EpollReactor() override;
+
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+    void watchListeningSocket(int listen_fd, AcceptHandler handler) override;
+    void addConnection(SocketFileDescriptor socket) override;
+    void adoptConnection(SocketFileDescriptor socket) override;
+    void sendResponse(container::message_queue::ConnectionHandle connection, uint64_t sequence, container::buffer::BufferSegments response,
+                      container::buffer::FileRegion file) override;
+
+    void setCpuAffinity(int cpu) override;
+    void start() override;
+    void stop() override;
+  };
+}
+
+#endif //WEBSERVER_EPOLLREACTOR_HPP
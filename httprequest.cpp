@@ -0,0 +1,349 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "httprequest.hpp"
+#include "simdscan.hpp"
+
+#include <limits>
+
+namespace network::http
+{
+  namespace
+  {
+    constexpr std::string_view CRLF{"\r\n"};
+    constexpr std::string_view HEADER_END{"\r\n\r\n"};
+
+    ///@brief Request targets may contain any visible character
+    bool isTarget(std::string_view value)
+    {
+      if (value.empty())
+        return false;
+
+      for (const char c : value)
+      {
+        if (static_cast<unsigned char>(c) <= ' ' || c == '\x7f')
+          return false;
+      }
+      return true;
+    }
+
+    std::string_view trimWhitespace(std::string_view value)
+    {
+      while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        value.remove_prefix(1);
+      while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+        value.remove_suffix(1);
+      return value;
+    }
+
+    ///@brief Parses a Content-Length value. Returns false for anything but plain decimal digits or on overflow
+    bool parseContentLength(std::string_view value, std::size_t& length)
+    {
+      if (value.empty())
+        return false;
+
+      length = 0;
+      for (const char c : value)
+      {
+        if (c < '0' || c > '9')
+          return false;
+
+        const auto digit = static_cast<std::size_t>(c - '0');
+        if (length > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+          return false;
+        length = length * 10 + digit;
+      }
+      return true;
+    }
+  }
+
+  /// @name equalsIgnoreCase
+  /// @brief Case-insensitive comparison of ASCII strings
+  /// @throws None
+  bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs)
+  {
+    if (lhs.size() != rhs.size())
+      return false;
+
+    for (std::size_t i = 0; i < lhs.size(); ++i)
+    {
+      // folding bit 0x20 is only valid for letters, the second check rejects pairs like '@' and '`'
+      if ((lhs[i] | 0x20) != (rhs[i] | 0x20))
+        return false;
+      if (lhs[i] != rhs[i] && ((lhs[i] | 0x20) < 'a' || (lhs[i] | 0x20) > 'z'))
+        return false;
+    }
+    return true;
+  }
+
+  /// @class Request
+  /// @name getHeader
+  /// @brief Looks a header up by name (case-insensitive)
+  /// @param[in] name : header name
+  /// @returns value of the first matching header, empty if there is none
+  /// @throws None
+  std::optional<std::string_view> Request::getHeader(std::string_view name) const
+  {
+    for (const Header& header : *this)
+    {
+      if (equalsIgnoreCase(header.name, name))
+        return header.value;
+    }
+    return {};
+  }
+
+  /// @class Request
+  /// @name isKeepAlive
+  /// @brief Evaluates the "Connection" header fields (RFC 9112 9.3), which hold comma separated options
+  /// @returns true if the connection persists after the response
+  /// @throws None
+  bool Request::isKeepAlive() const
+  {
+    bool keep_alive = minor_version_ >= 1;
+    for (const Header& header : *this)
+    {
+      if (!equalsIgnoreCase(header.name, "Connection"))
+        continue;
+
+      std::string_view options = header.value;
+      while (!options.empty())
+      {
+        const std::size_t separator = options.find(',');
+        const std::string_view option = trimWhitespace(options.substr(0, separator));
+        options.remove_prefix(separator == std::string_view::npos ? options.size() : separator + 1);
+
+        if (equalsIgnoreCase(option, "close"))
+          return false;
+        if (equalsIgnoreCase(option, "keep-alive"))
+          keep_alive = true;
+      }
+    }
+    return keep_alive;
+  }
+
+  /// @class RequestParser
+  /// @name parse
+  /// @brief Continues parsing the current request. The header section is searched from where the previous call
+  ///        stopped and parsed once it is complete; only if the buffer moved while the body was still arriving the
+  ///        header section is parsed a second time to refresh the views
+  /// @param[in] data : bytes of the current request received so far
+  /// @returns COMPLETE once header section and body are available, ERROR if the request is malformed
+  /// @throws None
+  RequestParser::Status RequestParser::parse(std::string_view data)
+  {
+    if (error_status_ != 0)
+      return Status::ERROR;
+
+    if (header_length_ == 0)
+    {
+      // the terminator may straddle the previous end of data
+      const std::size_t from = scanned_ >= HEADER_END.size() ? scanned_ - (HEADER_END.size() - 1) : 0;
+      const std::size_t end = scan::findHeaderEnd(data, from);
+      if (end == std::string_view::npos)
+      {
+        scanned_ = data.size();
+        return data.size() > MAX_HEADER_SIZE ? fail(431) : Status::INCOMPLETE;
+      }
+
+      header_length_ = end + HEADER_END.size();
+      if (header_length_ > MAX_HEADER_SIZE)
+        return fail(431);
+
+      const Status status = parseHeaderSection(data.substr(0, header_length_));
+      if (status == Status::ERROR)
+        return status;
+      parsed_data_ = data.data();
+    }
+
+    if (data.size() - header_length_ < body_length_)
+      return Status::INCOMPLETE;
+
+    if (parsed_data_ != data.data())
+    {
+      parseHeaderSection(data.substr(0, header_length_));
+      parsed_data_ = data.data();
+    }
+
+    request_.body_ = data.substr(header_length_, body_length_);
+    return Status::COMPLETE;
+  }
+
+  /// @class RequestParser
+  /// @name extract
+  /// @brief Takes all complete requests out of the receive buffer as slices sharing it. Stops after a request which
+  ///        closes the connection, the server must not process requests behind it (RFC 9112 9.6)
+  /// @param[in,out] buffer : receive buffer of the connection
+  /// @param[out] requests : one slice per complete request gets appended
+  /// @returns INCOMPLETE if the remaining bytes start a request, ERROR if the stream is malformed, COMPLETE if the
+  ///          last request of the connection was extracted
+  /// @throws None
+  RequestParser::Status RequestParser::extract(container::buffer::ReceiveBuffer &buffer, std::vector<container::buffer::BufferSlice> &requests)
+  {
+    while (true)
+    {
+      std::string_view pending = buffer.pending();
+
+      // RFC 9112 2.2: empty lines in front of a request line are ignored
+      if (scanned_ == 0 && header_length_ == 0)
+      {
+        std::size_t empty_lines{0};
+        while (pending.substr(empty_lines, CRLF.size()) == CRLF)
+          empty_lines += CRLF.size();
+        buffer.discard(empty_lines);
+        pending.remove_prefix(empty_lines);
+      }
+
+      if (pending.empty())
+        return Status::INCOMPLETE;
+
+      const Status status = parse(pending);
+      if (status != Status::COMPLETE)
+        return status;
+
+      requests.emplace_back(buffer.consume(getRequestLength()));
+      const bool keep_alive = request_.isKeepAlive();
+      reset();
+      if (!keep_alive)
+        return Status::COMPLETE;
+    }
+  }
+
+  /// @class RequestParser
+  /// @name reset
+  /// @brief Prepares for the next request on the same connection
+  /// @throws None
+  void RequestParser::reset()
+  {
+    request_.number_headers_ = 0;
+    parsed_data_ = nullptr;
+    scanned_ = 0;
+    header_length_ = 0;
+    body_length_ = 0;
+    error_status_ = 0;
+  }
+
+  /// @class RequestParser
+  /// @name fail
+  /// @brief Records the error status of a malformed request
+  /// @throws None
+  RequestParser::Status RequestParser::fail(const unsigned status_code)
+  {
+    error_status_ = status_code;
+    return Status::ERROR;
+  }
+
+  /// @class RequestParser
+  /// @name parseHeaderSection
+  /// @brief Parses request line and header fields into request_ and determines the length of the body
+  /// @param[in] header : complete header section including the terminating empty line
+  /// @throws None
+  RequestParser::Status RequestParser::parseHeaderSection(std::string_view header)
+  {
+    // request line, header fields and the empty line each end with CRLF, which are the only control characters allowed
+    constexpr std::size_t MAX_CONTROLS{2 * (Request::MAX_HEADERS + 2) + 1};
+    uint32_t controls[MAX_CONTROLS];
+    const std::size_t number_controls = scan::findControls(header, controls, MAX_CONTROLS);
+    if (number_controls == MAX_CONTROLS)
+      return fail(431);
+
+    for (std::size_t i = 0; i < number_controls; i += 2)
+    {
+      if (i + 1 == number_controls || header[controls[i]] != '\r' || controls[i + 1] != controls[i] + 1 || header[controls[i + 1]] != '\n')
+        return fail(400);
+    }
+
+    const std::string_view request_line = header.substr(0, controls[0]);
+
+    const std::size_t method_end = request_line.find(' ');
+    if (method_end == std::string_view::npos)
+      return fail(400);
+
+    const std::size_t target_end = request_line.find(' ', method_end + 1);
+    if (target_end == std::string_view::npos)
+      return fail(400);
+
+    request_.method_ = request_line.substr(0, method_end);
+    request_.target_ = request_line.substr(method_end + 1, target_end - method_end - 1);
+    const std::string_view version = request_line.substr(target_end + 1);
+    if (scan::tokenLength(request_.method_) != method_end || !isTarget(request_.target_))
+      return fail(400);
+
+    if (version == "HTTP/1.1")
+      request_.minor_version_ = 1;
+    else if (version == "HTTP/1.0")
+      request_.minor_version_ = 0;
+    else
+      return fail(version.substr(0, 5) == "HTTP/" ? 505 : 400);
+
+    request_.number_headers_ = 0;
+    body_length_ = 0;
+    bool has_content_length{false};
+
+    // the last CRLF pair is the empty line ending the header section
+    for (std::size_t i = 2; i + 2 < number_controls; i += 2)
+    {
+      const std::size_t field_start = controls[i - 1] + 1;
+      const std::string_view field = header.substr(field_start, controls[i] - field_start);
+
+      const std::size_t colon = scan::tokenLength(field);
+      if (colon == 0 || colon == field.size() || field[colon] != ':')
+        return fail(400);
+
+      const std::string_view name = field.substr(0, colon);
+      const std::string_view value = trimWhitespace(field.substr(colon + 1));
+
+      if (request_.number_headers_ == Request::MAX_HEADERS)
+        return fail(431);
+      request_.headers_[request_.number_headers_++] = {name, value};
+
+      if (equalsIgnoreCase(name, "Content-Length"))
+      {
+        std::size_t length{0};
+        if (!parseContentLength(value, length) || (has_content_length && length != body_length_))
+          return fail(400);
+        if (length > container::buffer::ReceiveBuffer::MAX_SIZE)
+          return fail(413);
+        body_length_ = length;
+        has_content_length = true;
+      }
+      else if (equalsIgnoreCase(name, "Transfer-Encoding"))
+      {
+        // chunked bodies are not supported yet
+        return fail(501);
+      }
+    }
+
+    return Status::COMPLETE;
+  }
+
+  /// @name errorResponse
+  /// @brief Complete, static "Connection: close" response for a parser error status
+  /// @param[in] status_code : status code reported by RequestParser::getErrorStatus()
+  /// @throws None
+  container::buffer::BufferSlice errorResponse(const unsigned status_code)
+  {
+    switch (status_code)
+    {
+      case 413:
+        return container::buffer::BufferSlice::fromStatic("HTTP/1.1 413 Content Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+      case 431:
+        return container::buffer::BufferSlice::fromStatic("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+      case 501:
+        return container::buffer::BufferSlice::fromStatic("HTTP/1.1 501 Not Implemented\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+      case 505:
+        return container::buffer::BufferSlice::fromStatic("HTTP/1.1 505 HTTP Version Not Supported\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+      default:
+        return container::buffer::BufferSlice::fromStatic("HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    }
+  }
+
+  /// @name serviceUnavailableResponse
+  /// @brief Complete, static 503 response for requests refused under overload. Unlike the error responses it keeps
+  ///        the connection open, the client is expected to retry
+  /// @throws None
+  container::buffer::BufferSlice serviceUnavailableResponse()
+  {
+    return container::buffer::BufferSlice::fromStatic("HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\n\r\n");
+  }
+}
@@ -0,0 +1,122 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_HTTPREQUEST_HPP
+#define WEBSERVER_HTTPREQUEST_HPP
+
+#include "buffer.hpp"
+#include "receivebuffer.hpp"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace network::http
+{
+  struct Header
+  {
+    std::string_view name;
+    std::string_view value;
+  };
+
+  ///@brief Parsed HTTP/1.x request. All views point into the buffer the request was parsed from, nothing is copied
+  class Request
+  {
+  public:
+    static constexpr std::size_t MAX_HEADERS{32};
+
+  private:
+    std::string_view method_;
+    std::string_view target_;
+    std::string_view body_;
+    int minor_version_{1};
+    std::array<Header, MAX_HEADERS> headers_{};
+    std::size_t number_headers_{0};
+
+    friend class RequestParser;
+
+  public:
+    [[nodiscard]] std::string_view getMethod() const { return method_; }
+    [[nodiscard]] std::string_view getTarget() const { return target_; }
+    [[nodiscard]] std::string_view getBody() const { return body_; }
+
+    ///@brief 1 for HTTP/1.1, 0 for HTTP/1.0
+    [[nodiscard]] int getMinorVersion() const { return minor_version_; }
+
+    [[nodiscard]] const Header* begin() const { return headers_.data(); }
+    [[nodiscard]] const Header* end() const { return headers_.data() + number_headers_; }
+    [[nodiscard]] std::size_t getNumberHeaders() const { return number_headers_; }
+
+    ///@brief Value of the first header with the given name (case-insensitive), empty if there is none
+    [[nodiscard]] std::optional<std::string_view> getHeader(std::string_view name) const;
+
+    ///@brief Whether the connection stays open after the response: default for HTTP/1.1 unless "Connection: close"
+    ///       was sent, HTTP/1.0 only with "Connection: keep-alive"
+    [[nodiscard]] bool isKeepAlive() const;
+  };
+
+  ///@brief Case-insensitive comparison of ASCII strings, as required for header names and most header values
+  bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs);
+
+  ///@brief Incremental HTTP/1.x request parser. Keeps its position across partial reads, so every byte of the header
+  ///       section is scanned once no matter in how many pieces it arrives. One instance per connection
+  class RequestParser
+  {
+  public:
+    enum class Status
+    {
+      INCOMPLETE,
+      COMPLETE,
+      ERROR,
+    };
+
+    static constexpr std::size_t MAX_HEADER_SIZE{16 * 1024};
+
+  private:
+    Request request_;
+    const char* parsed_data_{nullptr};   // start of the data request_ refers to
+    std::size_t scanned_{0};             // bytes already searched for the end of the header section
+    std::size_t header_length_{0};       // 0 until the header section is complete
+    std::size_t body_length_{0};
+    unsigned error_status_{0};
+
+    Status fail(unsigned status_code);
+    Status parseHeaderSection(std::string_view header);
+
+  public:
+    ///@brief Continues parsing. data must start at the first byte of the current request and contain at least
+    ///       everything passed in previous calls; the buffer holding it may have moved in between
+    Status parse(std::string_view data);
+
+    ///@brief Takes all complete requests out of the receive buffer. Returns INCOMPLETE once the rest of the buffer
+    ///       is the beginning of a request, ERROR if the stream is not valid HTTP and COMPLETE after a request which
+    ///       does not keep the connection alive; anything behind that request is left in the buffer
+    Status extract(container::buffer::ReceiveBuffer& buffer, std::vector<container::buffer::BufferSlice>& requests);
+
+    ///@brief Prepares for the next request on the same connection
+    void reset();
+
+    ///@brief The request of the last parse() call which returned COMPLETE
+    [[nodiscard]] const Request& getRequest() const { return request_; }
+
+    ///@brief Number of bytes (header section plus body) of the completed request
+    [[nodiscard]] std::size_t getRequestLength() const { return header_length_ + body_length_; }
+
+    ///@brief HTTP status code describing the last error, e.g. 400 or 431
+    [[nodiscard]] unsigned getErrorStatus() const { return error_status_; }
+
+    ///@brief Marks the request as too large for the receive buffer
+    void rejectTooLarge() { fail(413); }
+  };
+
+  ///@brief Complete, static "Connection: close" response for a parser error status
+  container::buffer::BufferSlice errorResponse(unsigned status_code);
+
+  ///@brief Complete, static 503 response for requests refused under overload. Keeps the connection open
+  container::buffer::BufferSlice serviceUnavailableResponse();
+}
+
+#endif //WEBSERVER_HTTPREQUEST_HPP
@@ -0,0 +1,197 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "httpresponse.hpp"
+
+#include <fmt/core.h>
+
+namespace network::http
+{
+  namespace
+  {
+    ///@brief Complete status line of the common status codes, empty for all others
+    std::string_view getStatusLine(const unsigned status_code)
+    {
+      switch (status_code)
+      {
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 201: return "HTTP/1.1 201 Created\r\n";
+        case 204: return "HTTP/1.1 204 No Content\r\n";
+        case 206: return "HTTP/1.1 206 Partial Content\r\n";
+        case 301: return "HTTP/1.1 301 Moved Permanently\r\n";
+        case 302: return "HTTP/1.1 302 Found\r\n";
+        case 304: return "HTTP/1.1 304 Not Modified\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 403: return "HTTP/1.1 403 Forbidden\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 408: return "HTTP/1.1 408 Request Timeout\r\n";
+        case 413: return "HTTP/1.1 413 Content Too Large\r\n";
+        case 416: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+        case 431: return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+        case 500: return "HTTP/1.1 500 Internal Server Error\r\n";
+        case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+        case 503: return "HTTP/1.1 503 Service Unavailable\r\n";
+        case 505: return "HTTP/1.1 505 HTTP Version Not Supported\r\n";
+        default: return {};
+      }
+    }
+
+    ///@brief 1xx, 204 and 304 responses never have a body and must not announce one (RFC 9110 8.6)
+    bool hasContent(const unsigned status_code)
+    {
+      return status_code >= 200 && status_code != 204 && status_code != 304;
+    }
+  }
+
+  /// @name getReasonPhrase
+  /// @brief Reason phrase of a status code
+  /// @param[in] status_code : HTTP status code
+  /// @returns the phrase of the status line, "Unknown" for codes without one
+  /// @throws None
+  std::string_view getReasonPhrase(const unsigned status_code)
+  {
+    std::string_view status_line = getStatusLine(status_code);
+    if (status_line.empty())
+      return "Unknown";
+
+    // "HTTP/1.1 200 " in front, CRLF behind
+    status_line.remove_prefix(13);
+    status_line.remove_suffix(2);
+    return status_line;
+  }
+
+  /// @class Response
+  /// @name addHeader
+  /// @brief Adds a header field. Name and value are copied into the owned header block
+  /// @param[in] name : field name
+  /// @param[in] value : field value
+  /// @throws None
+  Response &Response::addHeader(std::string_view name, std::string_view value)
+  {
+    header_fields_.append(name).append(": ").append(value).append("\r\n");
+    return *this;
+  }
+
+  /// @class Response
+  /// @name addHeaderBlock
+  /// @brief Adds complete header lines without copying them
+  /// @param[in] block : one or more "Name: value\r\n" lines, e.g. a precomputed static block
+  /// @throws None
+  Response &Response::addHeaderBlock(container::buffer::BufferSlice block)
+  {
+    header_blocks_.emplace_back(std::move(block));
+    return *this;
+  }
+
+  /// @class Response
+  /// @name setBody
+  /// @brief Sets the body without copying it
+  /// @param[in] body : body bytes, kept alive by the slice until they are sent
+  /// @throws None
+  Response &Response::setBody(container::buffer::BufferSlice body)
+  {
+    body_ = std::move(body);
+    file_body_ = {};
+    return *this;
+  }
+
+  /// @class Response
+  /// @name setBody
+  /// @brief Sets a file region as body. It is sent behind the segments with sendfile()
+  /// @param[in] body : file region, its owner keeps the file open until it is sent
+  /// @throws None
+  Response &Response::setBody(container::buffer::FileRegion body)
+  {
+    file_body_ = std::move(body);
+    body_ = {};
+    return *this;
+  }
+
+  /// @class Response
+  /// @name omitBody
+  /// @brief Answers a HEAD request: the headers describe the body, but it is not sent (RFC 9110 9.3.2)
+  /// @throws None
+  Response &Response::omitBody()
+  {
+    omit_body_ = true;
+    return *this;
+  }
+
+  /// @class Response
+  /// @name setConnection
+  /// @brief Announces the persistence of the connection: "Connection: close" after the last request, "Connection:
+  ///        keep-alive" for persistent HTTP/1.0 connections, nothing for persistent HTTP/1.1 connections
+  /// @param[in] request : request this response answers
+  /// @throws None
+  Response &Response::setConnection(const Request &request)
+  {
+    close_ = !request.isKeepAlive();
+    announce_keep_alive_ = !close_ && request.getMinorVersion() == 0;
+    return *this;
+  }
+
+  /// @class Response
+  /// @name getSegments
+  /// @brief Creates the segments in sending order: status line, borrowed header blocks, owned header block including
+  ///        Content-Length, Connection and the empty line, then the body
+  /// @throws None
+  container::buffer::BufferSegments Response::getSegments() const
+  {
+    container::buffer::BufferSegments segments;
+    segments.reserve(header_blocks_.size() + 3);
+
+    const std::string_view status_line = getStatusLine(status_code_);
+    if (status_line.empty())
+      segments.emplace_back(fmt::format("HTTP/1.1 {} Unknown\r\n", status_code_));
+    else
+      segments.emplace_back(container::buffer::BufferSlice::fromStatic(status_line));
+
+    segments.insert(segments.end(), header_blocks_.begin(), header_blocks_.end());
+
+    std::string header_end;
+    header_end.reserve(header_fields_.size() + 64);
+    header_end.append(header_fields_);
+    if (hasContent(status_code_))
+      header_end.append("Content-Length: ").append(std::to_string(file_body_.empty() ? body_.size() : file_body_.length)).append("\r\n");
+    if (close_)
+      header_end.append("Connection: close\r\n");
+    else if (announce_keep_alive_)
+      header_end.append("Connection: keep-alive\r\n");
+    header_end.append("\r\n");
+    segments.emplace_back(std::move(header_end));
+
+    if (hasContent(status_code_) && !omit_body_ && !body_.empty())
+      segments.emplace_back(body_);
+
+    return segments;
+  }
+
+  /// @class Response
+  /// @name getFileBody
+  /// @brief File region sent behind the segments
+  /// @returns the file body, empty if the body is no file or must not be sent
+  /// @throws None
+  container::buffer::FileRegion Response::getFileBody() const
+  {
+    if (!hasContent(status_code_) || omit_body_)
+      return {};
+
+    return file_body_;
+  }
+
+  /// @class Response
+  /// @name serialize
+  /// @brief Joins all segments, e.g. for logging. Sending uses getSegments() instead, a file body is not included
+  /// @throws None
+  std::string Response::serialize() const
+  {
+    std::string serialized;
+    for (const auto& segment : getSegments())
+    {
+      serialized.append(segment.view());
+    }
+    return serialized;
+  }
+}
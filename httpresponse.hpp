@@ -0,0 +1,69 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_HTTPRESPONSE_HPP
+#define WEBSERVER_HTTPRESPONSE_HPP
+
+#include "buffer.hpp"
+#include "httprequest.hpp"
+#include "serializable.hpp"
+
+#include <string>
+#include <string_view>
+
+namespace network::http
+{
+  ///@brief Reason phrase of a status code, "Unknown" for codes without one
+  std::string_view getReasonPhrase(unsigned status_code);
+
+  ///@brief HTTP/1.1 response kept as separate segments: status line, header blocks and body. Status lines are static,
+  ///       precomputed header blocks and the body are borrowed as slices, only the header fields added one by one are
+  ///       copied into a small owned block. The segments are sent with one gathering send, the body is never copied
+  class Response : public Serializable
+  {
+  private:
+    unsigned status_code_;
+    container::buffer::BufferSegments header_blocks_;
+    std::string header_fields_;
+    container::buffer::BufferSlice body_;
+    container::buffer::FileRegion file_body_;
+    bool omit_body_{false};
+    bool close_{false};
+    bool announce_keep_alive_{false};
+
+  public:
+    explicit Response(unsigned status_code = 200) : status_code_(status_code) {}
+
+    [[nodiscard]] unsigned getStatusCode() const { return status_code_; }
+
+    ///@brief Adds a header field, name and value are copied
+    Response& addHeader(std::string_view name, std::string_view value);
+
+    ///@brief Adds complete header lines ("Name: value\r\n" each) without copying them, e.g. a static block
+    Response& addHeaderBlock(container::buffer::BufferSlice block);
+
+    ///@brief Sets the body without copying it. Content-Length is added when the segments are created
+    Response& setBody(container::buffer::BufferSlice body);
+
+    ///@brief Sets a file region as body, it is sent behind the segments without reading it into user space
+    Response& setBody(container::buffer::FileRegion body);
+
+    ///@brief Answers a HEAD request: Content-Length still describes the body, but the body is not sent
+    Response& omitBody();
+
+    ///@brief Announces whether the connection persists after this response, as decided by Request::isKeepAlive()
+    Response& setConnection(const Request& request);
+
+    ///@brief Segments in sending order, the slices share the borrowed buffers
+    [[nodiscard]] container::buffer::BufferSegments getSegments() const;
+
+    ///@brief File region to send behind the segments, empty unless the body is a file
+    [[nodiscard]] container::buffer::FileRegion getFileBody() const;
+
+    ///@brief Joins the segments, e.g. for logging. A file body is not included
+    [[nodiscard]] std::string serialize() const override;
+  };
+}
+
+#endif //WEBSERVER_HTTPRESPONSE_HPP
@@ -0,0 +1,514 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Load generator for a local webserver instance: webserver_loadgen [key=value ...], see printUsage()
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    std::string host{"127.0.0.1"};
+    unsigned short port{8080};
+    std::string path{"/"};
+    std::size_t connections{64};
+    std::size_t threads{std::max(1U, std::thread::hardware_concurrency())};
+    double duration{10.0};   // seconds, measured after the warmup
+    double warmup{1.0};      // seconds, responses are not recorded
+    double rate{0.0};        // requests per second over all connections, 0 runs closed-loop
+  };
+
+  ///@brief HdrHistogram-style latency histogram: every power of two is split into 2^SUB_BUCKET_BITS linear buckets,
+  ///       which keeps the relative error of every percentile below 1% over the whole range. One per thread, merged
+  ///       at the end
+  class LatencyHistogram
+  {
+  private:
+    static constexpr unsigned SUB_BUCKET_BITS{7};
+    static constexpr uint64_t SUB_BUCKETS{uint64_t{1} << SUB_BUCKET_BITS};
+
+    std::vector<uint64_t> counts_ = std::vector<uint64_t>((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS);
+    uint64_t count_{0};
+    uint64_t max_{0};
+
+    static std::size_t getBucket(uint64_t value)
+    {
+      if (value < SUB_BUCKETS)
+        return static_cast<std::size_t>(value);
+
+      const unsigned shift = 63U - static_cast<unsigned>(__builtin_clzll(value)) - SUB_BUCKET_BITS;
+      return static_cast<std::size_t>((shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t getUpperBound(std::size_t bucket)
+    {
+      if (bucket < SUB_BUCKETS)
+        return bucket;
+
+      const auto shift = static_cast<unsigned>(bucket / SUB_BUCKETS - 1);
+      return ((bucket % SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+    }
+
+  public:
+    void record(uint64_t value)
+    {
+      ++counts_[getBucket(value)];
+      ++count_;
+      max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+      for (std::size_t i = 0; i < counts_.size(); ++i)
+        counts_[i] += other.counts_[i];
+      count_ += other.count_;
+      max_ = std::max(max_, other.max_);
+    }
+
+    [[nodiscard]] uint64_t count() const { return count_; }
+    [[nodiscard]] uint64_t max() const { return max_; }
+
+    ///@brief Smallest recorded value v so that the given fraction of all values is <= v, rounded up to its bucket
+    [[nodiscard]] uint64_t percentile(double fraction) const
+    {
+      const auto rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_)));
+      uint64_t cumulative{0};
+      for (std::size_t i = 0; i < counts_.size(); ++i)
+      {
+        cumulative += counts_[i];
+        if (cumulative >= std::max<uint64_t>(rank, 1))
+          return std::min(getUpperBound(i), max_);
+      }
+      return max_;
+    }
+  };
+
+  struct ThreadResult
+  {
+    LatencyHistogram latency;        // nanoseconds, from the intended send time to the end of the response
+    uint64_t responses{0};
+    uint64_t errors{0};              // non-2xx responses
+    uint64_t connection_errors{0};   // failed connects and connections closed with a request outstanding
+    uint64_t bytes{0};
+    uint64_t unsent{0};              // open-loop: requests which were due but found no free connection before the end
+  };
+
+  struct Connection
+  {
+    int fd{-1};
+    std::string input;
+    std::size_t output_offset{0};
+    bool busy{false};
+    Clock::time_point intended_start;
+  };
+
+  ///@brief Parses a complete response at the start of input
+  ///@returns its length, 0 while it is incomplete and npos if it is not HTTP
+  std::size_t parseResponse(std::string_view input, unsigned &status, bool &close)
+  {
+    const std::size_t header_end = input.find("\r\n\r\n");
+    if (header_end == std::string_view::npos)
+      return 0;
+
+    if (input.size() < 12 || input.substr(0, 7) != "HTTP/1.")
+      return std::string_view::npos;
+    status = static_cast<unsigned>(std::strtoul(std::string{input.substr(9, 3)}.c_str(), nullptr, 10));
+
+    std::size_t content_length{0};
+    close = input[7] == '0';
+    std::size_t line = input.find("\r\n") + 2;
+    while (line < header_end)
+    {
+      const std::size_t line_end = input.find("\r\n", line);
+      const std::string_view field = input.substr(line, line_end - line);
+      const std::size_t colon = field.find(':');
+      if (colon != std::string_view::npos)
+      {
+        std::string name{field.substr(0, colon)};
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::string_view value = field.substr(colon + 1);
+        value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+        if (name == "content-length")
+          content_length = std::strtoull(std::string{value}.c_str(), nullptr, 10);
+        else if (name == "connection")
+          close = value == "close";
+      }
+      line = line_end + 2;
+    }
+
+    const std::size_t length = header_end + 4 + content_length;
+    return input.size() >= length ? length : 0;
+  }
+
+  ///@brief Runs one thread's share of the connections on its own epoll instance until end
+  class Worker
+  {
+  private:
+    const std::string request_;
+    const sockaddr_in address_;
+    const double rate_;                    // this thread's requests per second, 0 for closed-loop
+    const Clock::time_point record_from_;
+    const Clock::time_point end_;
+    ThreadResult& result_;
+
+    int epoll_fd_{-1};
+    std::vector<Connection> connections_;
+    std::vector<std::size_t> idle_;          // connections without outstanding request
+    std::deque<Clock::time_point> backlog_;  // open-loop: due requests waiting for a connection
+    Clock::time_point next_arrival_;
+
+    bool connect(std::size_t index)
+    {
+      Connection& connection = connections_[index];
+      connection = {};
+      const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address_), sizeof(address_)) < 0)
+      {
+        if (fd >= 0)
+          close(fd);
+        ++result_.connection_errors;
+        return false;
+      }
+
+      constexpr int ENABLE{1};
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ENABLE, sizeof(ENABLE));
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLRDHUP;
+      event.data.u64 = index;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+      connection.fd = fd;
+      idle_.push_back(index);
+      return true;
+    }
+
+    void disconnect(std::size_t index)
+    {
+      Connection& connection = connections_[index];
+      if (connection.busy)
+        ++result_.connection_errors;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+      close(connection.fd);
+      connection.fd = -1;
+      idle_.erase(std::remove(idle_.begin(), idle_.end(), index), idle_.end());
+    }
+
+    void send(std::size_t index, Clock::time_point intended_start)
+    {
+      Connection& connection = connections_[index];
+      connection.busy = true;
+      connection.intended_start = intended_start;
+      connection.output_offset = 0;
+      flush(index);
+    }
+
+    void flush(std::size_t index)
+    {
+      Connection& connection = connections_[index];
+      while (connection.output_offset < request_.size())
+      {
+        const ssize_t sent = ::send(connection.fd, request_.data() + connection.output_offset,
+                                    request_.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+          continue;
+        if (sent < 0)
+          break;
+        connection.output_offset += static_cast<std::size_t>(sent);
+      }
+
+      // a full socket buffer is only expected when the server stalls, EPOLLOUT resumes the request
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLRDHUP | (connection.output_offset < request_.size() ? EPOLLOUT : 0U);
+      event.data.u64 = index;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+
+    void receive(std::size_t index, Clock::time_point now)
+    {
+      Connection& connection = connections_[index];
+      char data[16 * 1024];
+      while (true)
+      {
+        const ssize_t received = recv(connection.fd, data, sizeof(data), 0);
+        if (received > 0)
+        {
+          connection.input.append(data, static_cast<std::size_t>(received));
+          if (now >= record_from_)
+            result_.bytes += static_cast<uint64_t>(received);
+          continue;
+        }
+        if (received < 0 && errno == EINTR)
+          continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          break;
+
+        // a response completed by the close may already have replaced the connection
+        const int fd = connection.fd;
+        processInput(index, now);
+        if (connections_[index].fd == fd)
+        {
+          disconnect(index);
+          connect(index);
+        }
+        return;
+      }
+      processInput(index, now);
+    }
+
+    void processInput(std::size_t index, Clock::time_point now)
+    {
+      Connection& connection = connections_[index];
+      if (!connection.busy || connection.fd < 0)
+        return;
+
+      unsigned status{0};
+      bool close_connection{false};
+      const std::size_t length = parseResponse(connection.input, status, close_connection);
+      if (length == 0)
+        return;
+
+      if (length == std::string::npos)
+      {
+        ++result_.errors;
+        connection.busy = false;
+        disconnect(index);
+        connect(index);
+        return;
+      }
+
+      connection.input.erase(0, length);
+      connection.busy = false;
+      if (now >= record_from_)
+      {
+        ++result_.responses;
+        if (status < 200 || status >= 300)
+          ++result_.errors;
+        result_.latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - connection.intended_start).count()));
+      }
+
+      if (close_connection)
+      {
+        disconnect(index);
+        connect(index);
+      }
+      else
+      {
+        idle_.push_back(index);
+      }
+    }
+
+    ///@brief Closed-loop: every idle connection sends right away. Open-loop: requests are due at fixed intervals and
+    ///       their latency counts from that time, even if they have to wait for a free connection
+    void dispatch(Clock::time_point now)
+    {
+      if (rate_ <= 0.0)
+      {
+        while (!idle_.empty())
+        {
+          const std::size_t index = idle_.back();
+          idle_.pop_back();
+          send(index, Clock::now());
+        }
+        return;
+      }
+
+      const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate_));
+      while (next_arrival_ <= now)
+      {
+        backlog_.push_back(next_arrival_);
+        next_arrival_ += interval;
+      }
+
+      while (!backlog_.empty() && !idle_.empty())
+      {
+        const std::size_t index = idle_.back();
+        idle_.pop_back();
+        send(index, backlog_.front());
+        backlog_.pop_front();
+      }
+    }
+
+  public:
+    Worker(const Options& options, std::size_t connections, double rate, Clock::time_point start, ThreadResult& result)
+        : request_(fmt::format("GET {} HTTP/1.1\r\nHost: {}:{}\r\nUser-Agent: webserver_loadgen\r\n\r\n", options.path, options.host, options.port)),
+          address_([&options] {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(options.port);
+            inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+            return address;
+          }()),
+          rate_(rate),
+          record_from_(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup))),
+          end_(record_from_ + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration))),
+          result_(result),
+          connections_(connections),
+          next_arrival_(start)
+    {}
+
+    void run()
+    {
+      epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+      for (std::size_t i = 0; i < connections_.size(); ++i)
+        connect(i);
+
+      epoll_event events[256];
+      for (Clock::time_point now = Clock::now(); now < end_; now = Clock::now())
+      {
+        dispatch(now);
+
+        // open-loop wakes up for the next arrival; sending up to 1ms late is still charged to the latency
+        int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(end_ - now).count()) + 1;
+        if (rate_ > 0.0)
+          timeout = backlog_.empty() ? static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next_arrival_ - now).count()) : 1;
+        const int ready = epoll_wait(epoll_fd_, events, static_cast<int>(std::size(events)), std::max(0, std::min(timeout, 100)));
+        now = Clock::now();
+        for (int i = 0; i < ready; ++i)
+        {
+          const auto index = static_cast<std::size_t>(events[i].data.u64);
+          if (connections_[index].fd < 0)
+            continue;
+          if (events[i].events & EPOLLOUT)
+            flush(index);
+          if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            receive(index, now);
+        }
+      }
+
+      // the next request counts as unsent if it was due and no connection was free
+      result_.unsent = backlog_.size();
+      for (Connection& connection : connections_)
+      {
+        if (connection.fd >= 0)
+          close(connection.fd);
+      }
+      close(epoll_fd_);
+    }
+  };
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [host=127.0.0.1] [port=8080] [path=/] [connections=64] [threads=<cores>]"
+                                         " [duration=10] [warmup=1] [rate=<requests/s, 0 = closed-loop>]" << std::endl;
+  }
+
+  std::string formatLatency(uint64_t nanoseconds)
+  {
+    if (nanoseconds < 1000000U)
+      return fmt::format("{:.1f}us", static_cast<double>(nanoseconds) / 1e3);
+    return fmt::format("{:.2f}ms", static_cast<double>(nanoseconds) / 1e6);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string argument{argv[i]};
+      const std::size_t equals = argument.find('=');
+      const std::string key = argument.substr(0, equals);
+      const std::string value = equals == std::string::npos ? std::string{} : argument.substr(equals + 1);
+      if (key == "host")
+        options.host = value;
+      else if (key == "port")
+        options.port = static_cast<unsigned short>(std::stoul(value));
+      else if (key == "path")
+        options.path = value;
+      else if (key == "connections")
+        options.connections = std::stoul(value);
+      else if (key == "threads")
+        options.threads = std::stoul(value);
+      else if (key == "duration")
+        options.duration = std::stod(value);
+      else if (key == "warmup")
+        options.warmup = std::stod(value);
+      else if (key == "rate")
+        options.rate = std::stod(value);
+      else
+      {
+        printUsage(argv[0]);
+        return 2;
+      }
+    }
+  }
+  catch (const std::exception&)
+  {
+    printUsage(argv[0]);
+    return 2;
+  }
+
+  in_addr address{};
+  if (options.connections == 0 || options.threads == 0 || options.duration <= 0.0 || inet_pton(AF_INET, options.host.c_str(), &address) != 1)
+  {
+    printUsage(argv[0]);
+    return 2;
+  }
+  options.threads = std::min(options.threads, options.connections);
+
+  std::vector<ThreadResult> results(options.threads);
+  std::vector<std::thread> threads;
+  const Clock::time_point start = Clock::now();
+  for (std::size_t i = 0; i < options.threads; ++i)
+  {
+    // connections and rate are split evenly, the first threads take the remainder of the connections
+    const std::size_t connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+    const double rate = options.rate / static_cast<double>(options.threads);
+    threads.emplace_back([&options, &results, connections, rate, start, i] {
+      Worker(options, connections, rate, start, results[i]).run();
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  ThreadResult total;
+  for (const ThreadResult& result : results)
+  {
+    total.latency.merge(result.latency);
+    total.responses += result.responses;
+    total.errors += result.errors;
+    total.connection_errors += result.connection_errors;
+    total.bytes += result.bytes;
+    total.unsent += result.unsent;
+  }
+
+  const LatencyHistogram& latency = total.latency;
+  std::cout << fmt::format("{} {}:{}{}, {} connections, {} threads, {:.1f}s\n", options.rate > 0.0 ? "open-loop" : "closed-loop",
+                           options.host, options.port, options.path, options.connections, options.threads, options.duration);
+  if (options.rate > 0.0)
+    std::cout << fmt::format("target rate:  {:.0f} req/s\n", options.rate);
+  std::cout << fmt::format("throughput:   {:.0f} req/s, {:.2f} MiB/s\n", static_cast<double>(total.responses) / options.duration,
+                           static_cast<double>(total.bytes) / options.duration / (1024.0 * 1024.0));
+  std::cout << fmt::format("responses:    {} ({} errors, {} connection errors, {} unsent)\n", total.responses, total.errors,
+                           total.connection_errors, total.unsent);
+  std::cout << fmt::format("latency:      p50 {}  p99 {}  p99.9 {}  max {}\n", formatLatency(latency.percentile(0.5)),
+                           formatLatency(latency.percentile(0.99)), formatLatency(latency.percentile(0.999)), formatLatency(latency.max()));
+  return total.responses == 0 ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "lockfreemessagequeue.hpp"
+
+#include "error.hpp"
+#include "logger.hpp"
+#include "trace.hpp"
+#include "servermetrics.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace network::tcp
+{
+  /// @class LockFreeMessageQueue
+  /// @name LockFreeMessageQueue
+  /// @brief constructor
+  /// @param[in] capacity : capacity of each direction, must be a power of two
+  /// @throws logging::Error
+  LockFreeMessageQueue::LockFreeMessageQueue(const std::size_t capacity) : received_(capacity, ServerMetrics::get().received_queue_depth),
+                                                                           respond_(capacity, ServerMetrics::get().respond_queue_depth),
+                                                                           capacity_(received_.ring.capacity())
+  {}
+
+  /// @class LockFreeMessageQueue
+  /// @name getFreeCapacity
+  /// @brief Number of the given messages the received ring takes, based on its approximate size
+  /// @param[in] count : number of messages to enqueue
+  /// @throws None
+  std::size_t LockFreeMessageQueue::getFreeCapacity(const std::size_t count) const
+  {
+    if (policy_ == container::message_queue::OverloadPolicy::BACKPRESSURE)
+      return count;
+
+    const std::size_t size = received_.ring.size();
+    return size < capacity_ ? std::min(count, capacity_ - size) : 0;
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name push
+  /// @brief Pushes a message. If the ring is full the producer wakes the consumers and yields until one made room
+  /// @throws None
+  void LockFreeMessageQueue::push(Channel &channel, container::message_queue::Message &&message)
+  {
+    // tryPush only moves from the message once it got a cell
+    while (!channel.ring.tryPush(std::move(message)))
+    {
+      if (shutdown_.load(std::memory_order_acquire))
+      {
+        LOG_WARNING("Queue full during shutdown, dropping message");
+        return;
+      }
+
+      // the consumers may sleep since before this batch, whose wakeup only follows its last message
+      wakeConsumer(channel, channel.ring.capacity());
+      std::this_thread::yield();
+    }
+    channel.depth.add();
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name tryPop
+  /// @brief Pops a message if there is one
+  /// @throws None
+  std::optional<container::message_queue::Message> LockFreeMessageQueue::tryPop(Channel &channel)
+  {
+    std::optional<container::message_queue::Message> message = channel.ring.tryPop();
+    if (message)
+      channel.depth.sub();
+    return message;
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name wakeConsumer
+  /// @brief Wakes sleeping consumers after count messages were pushed. Costs one fence if nobody sleeps
+  /// @throws None
+  void LockFreeMessageQueue::wakeConsumer(Channel &channel, const std::size_t count)
+  {
+    // pairs with the fence in retrieve(): either the consumer sees the message or we see the consumer
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (channel.waiters.load(std::memory_order_relaxed) == 0)
+      return;
+
+    std::lock_guard<std::mutex> guard(channel.wait_mutex);
+    if (count == 1)
+      channel.wait_cv.notify_one();
+    else
+      channel.wait_cv.notify_all();
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name enqueue
+  /// @brief Pushes a message and wakes a sleeping consumer if there is one
+  /// @throws None
+  void LockFreeMessageQueue::enqueue(Channel &channel, container::message_queue::Message &&message)
+  {
+    push(channel, std::move(message));
+    wakeConsumer(channel, 1);
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name retrieve
+  /// @brief Pops a message, spinning briefly before going to sleep on the channel's condition variable
+  /// @throws None
+  container::message_queue::Message LockFreeMessageQueue::retrieve(Channel &channel)
+  {
+    for (int i = 0; i < SPIN_ITERATIONS; ++i)
+    {
+      if (auto message = tryPop(channel))
+        return std::move(*message);
+    }
+
+    std::unique_lock<std::mutex> wait_lock(channel.wait_mutex);
+    channel.waiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (true)
+    {
+      if (auto message = tryPop(channel))
+      {
+        channel.waiters.fetch_sub(1, std::memory_order_relaxed);
+        return std::move(*message);
+      }
+
+      if (shutdown_.load(std::memory_order_acquire))
+      {
+        channel.waiters.fetch_sub(1, std::memory_order_relaxed);
+        return {"", {}};
+      }
+
+      channel.wait_cv.wait(wait_lock);
+    }
+  }
+
+  bool LockFreeMessageQueue::enqueueReceivedMessage(container::message_queue::Message &&message)
+  {
+    if (getFreeCapacity(1) == 0)
+      return false;
+
+    enqueue(received_, std::move(message));
+    return true;
+  }
+
+  container::message_queue::Message LockFreeMessageQueue::retrieveReceivedMessage()
+  {
+    return retrieve(received_);
+  }
+
+  std::size_t LockFreeMessageQueue::enqueueReceivedMessages(container::message_queue::Message *messages, const std::size_t count)
+  {
+    const std::size_t accepted = getFreeCapacity(count);
+    if (accepted == 0)
+      return 0;
+
+    for (std::size_t i = 0; i < accepted; ++i)
+    {
+      push(received_, std::move(messages[i]));
+    }
+    wakeConsumer(received_, accepted);
+    return accepted;
+  }
+
+  std::size_t LockFreeMessageQueue::retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, const std::size_t max_messages)
+  {
+    if (max_messages == 0)
+      return 0;
+
+    container::message_queue::Message first{retrieve(received_)};
+    if (!first.getConnection().isValid())
+      return 0;
+
+    messages.emplace_back(std::move(first));
+    std::size_t retrieved{1};
+    while (retrieved < max_messages)
+    {
+      auto message = tryPop(received_);
+      if (!message)
+        break;
+
+      messages.emplace_back(std::move(*message));
+      ++retrieved;
+    }
+
+    return retrieved;
+  }
+
+  std::optional<container::message_queue::Message> LockFreeMessageQueue::retrieveResponseMessageNonBlocking()
+  {
+    return tryPop(respond_);
+  }
+
+  container::message_queue::Message LockFreeMessageQueue::retrieveResponseMessage()
+  {
+    return retrieve(respond_);
+  }
+
+  void LockFreeMessageQueue::enqueueResponseMessage(container::message_queue::Message &&message)
+  {
+    if (container::message_queue::ResponseRouter* router = response_router_.load(std::memory_order_acquire))
+    {
+      router->routeResponse(std::move(message));
+      return;
+    }
+
+    enqueue(respond_, std::move(message));
+  }
+
+  void LockFreeMessageQueue::setResponseRouter(container::message_queue::ResponseRouter *router)
+  {
+    response_router_.store(router, std::memory_order_release);
+  }
+
+  /// @class LockFreeMessageQueue
+  /// @name setCapacity
+  /// @brief Limits the number of received messages
+  /// @param[in] capacity : maximum number of received messages, 0 for the capacity of the ring
+  /// @param[in] policy : what happens to messages beyond the capacity
+  /// @throws logging::Error if the capacity exceeds the ring
+  void LockFreeMessageQueue::setCapacity(const std::size_t capacity, const container::message_queue::OverloadPolicy policy)
+  {
+    if (capacity > received_.ring.capacity())
+    {
+      throw logging::Error(LOC, fmt::format("Queue capacity {} exceeds the ring capacity {}", capacity, received_.ring.capacity()));
+    }
+
+    // the ring holds no more anyway, with it as capacity a full ring pauses the reactors instead of spinning them
+    capacity_ = capacity == 0 ? received_.ring.capacity() : capacity;
+    policy_ = policy;
+  }
+
+  void LockFreeMessageQueue::shutdown()
+  {
+    const logging::Trace trace(__func__);
+    shutdown_.store(true, std::memory_order_release);
+
+    for (Channel* channel : {&received_, &respond_})
+    {
+      std::lock_guard<std::mutex> guard(channel->wait_mutex);
+      channel->wait_cv.notify_all();
+    }
+  }
+}
@@ -0,0 +1,88 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_LOCKFREEMESSAGEQUEUE_HPP
+#define WEBSERVER_LOCKFREEMESSAGEQUEUE_HPP
+
+#include "messagequeue.hpp"
+#include "ringbuffer.hpp"
+#include "metrics.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace network::tcp
+{
+  ///@brief Message queue backed by two bounded lock-free MPMC ring buffers. Enqueue and dequeue never take a lock;
+  ///       the mutex/condition variable pair is only touched when a consumer actually has to sleep
+  class LockFreeMessageQueue : public container::message_queue::Queue
+  {
+  public:
+    static constexpr std::size_t DEFAULT_CAPACITY{1 << 16};
+
+  private:
+    static constexpr int SPIN_ITERATIONS{64};
+
+    ///@brief One direction of the queue: the ring plus the parking spot for sleeping consumers
+    struct Channel
+    {
+      container::MpmcRingBuffer<container::message_queue::Message> ring;
+      alignas(container::CACHE_LINE_SIZE) std::atomic<std::size_t> waiters{0};
+      std::mutex wait_mutex;
+      std::condition_variable wait_cv;
+      metrics::Gauge& depth;
+
+      Channel(std::size_t capacity, metrics::Gauge& depth) : ring(capacity), depth(depth) {}
+    };
+
+    Channel received_;
+    Channel respond_;
+    std::atomic<container::message_queue::ResponseRouter*> response_router_{nullptr};
+    std::atomic<bool> shutdown_{false};
+    std::size_t capacity_;   // never 0, the ring bounds the queue in any case
+    container::message_queue::OverloadPolicy policy_{container::message_queue::OverloadPolicy::BACKPRESSURE};
+
+    [[nodiscard]] std::size_t getFreeCapacity(std::size_t count) const;
+    void push(Channel& channel, container::message_queue::Message&& message);
+    static std::optional<container::message_queue::Message> tryPop(Channel& channel);
+    void wakeConsumer(Channel& channel, std::size_t count);
+    void enqueue(Channel& channel, container::message_queue::Message&& message);
+    container::message_queue::Message retrieve(Channel& channel);
+
+  public:
+    ///@param capacity : capacity of each direction, must be a power of two
+    explicit LockFreeMessageQueue(std::size_t capacity = DEFAULT_CAPACITY);
+
+    bool enqueueReceivedMessage(container::message_queue::Message &&message) override;
+
+    container::message_queue::Message retrieveReceivedMessage() override;
+
+    std::size_t enqueueReceivedMessages(container::message_queue::Message *messages, std::size_t count) override;
+
+    std::size_t retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, std::size_t max_messages) override;
+
+    std::optional<container::message_queue::Message> retrieveResponseMessageNonBlocking() override;
+
+    container::message_queue::Message retrieveResponseMessage() override;
+
+    void enqueueResponseMessage(container::message_queue::Message &&message) override;
+
+    void setResponseRouter(container::message_queue::ResponseRouter *router) override;
+
+    ///@brief The capacity must not exceed the one of the ring, 0 selects the capacity of the ring. Concurrent
+    ///       producers check it without a lock and may overshoot it by one batch each
+    void setCapacity(std::size_t capacity, container::message_queue::OverloadPolicy policy) override;
+
+    [[nodiscard]] std::size_t getCapacity() const override { return capacity_; }
+
+    [[nodiscard]] container::message_queue::OverloadPolicy getOverloadPolicy() const override { return policy_; }
+
+    [[nodiscard]] std::size_t getNumberReceivedMessages() const override { return received_.ring.size(); }
+
+    void shutdown() override;
+  };
+}
+
+#endif //WEBSERVER_LOCKFREEMESSAGEQUEUE_HPP
@@ -0,0 +1,98 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_LOGBUFFER_HPP
+#define WEBSERVER_LOGBUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace logging
+{
+  ///@brief Lock-free single-producer/single-consumer byte ring for log records. The thread owning it appends whole
+  ///       records, the flusher thread takes everything written so far. A record is published only once it is
+  ///       complete, so the consumer never sees half a line. Head and tail count bytes and are only masked on access
+  class LogBuffer
+  {
+  private:
+    static constexpr std::size_t CACHE_LINE_SIZE{64};
+
+    std::unique_ptr<char[]> data_;
+    const std::size_t mask_;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head_{0};   // written by the consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail_{0};   // written by the producer
+    std::atomic<bool> abandoned_{false};
+    std::atomic<bool> writing_{false};   // set by the producer around a write, see Logger::stopAsync
+
+  public:
+    ///@param capacity : size in bytes, must be a power of two
+    explicit LogBuffer(std::size_t capacity) : data_(new char[capacity]), mask_(capacity - 1)
+    {}
+
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+
+    [[nodiscard]] std::size_t capacity() const { return mask_ + 1; }
+
+    ///@brief Approximate number of bytes waiting for the consumer
+    [[nodiscard]] std::size_t size() const
+    {
+      return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+
+    ///@brief Appends a complete record. Producer only. Returns false without writing anything if it does not fit
+    bool tryWrite(std::string_view record)
+    {
+      const std::size_t tail = tail_.load(std::memory_order_relaxed);
+      const std::size_t head = head_.load(std::memory_order_acquire);
+      if (record.size() > capacity() - (tail - head))
+        return false;
+
+      const std::size_t offset = tail & mask_;
+      const std::size_t first = std::min(record.size(), capacity() - offset);
+      std::memcpy(data_.get() + offset, record.data(), first);
+      std::memcpy(data_.get(), record.data() + first, record.size() - first);
+      tail_.store(tail + record.size(), std::memory_order_release);
+      return true;
+    }
+
+    ///@brief Moves all complete records to the end of out. Consumer only. Returns the number of bytes taken
+    std::size_t readInto(std::string& out)
+    {
+      const std::size_t head = head_.load(std::memory_order_relaxed);
+      const std::size_t tail = tail_.load(std::memory_order_acquire);
+      const std::size_t available = tail - head;
+      if (available == 0)
+        return 0;
+
+      const std::size_t offset = head & mask_;
+      const std::size_t first = std::min(available, capacity() - offset);
+      out.append(data_.get() + offset, first);
+      out.append(data_.get(), available - first);
+      head_.store(tail, std::memory_order_release);
+      return available;
+    }
+
+    ///@brief The producing thread exited, the buffer is released once it is drained
+    void abandon() { abandoned_.store(true, std::memory_order_release); }
+
+    [[nodiscard]] bool isAbandoned() const { return abandoned_.load(std::memory_order_acquire); }
+
+    ///@brief Announces a write of the producer. Sequentially consistent, so that the producer either sees a mode
+    ///       change made before or the thread changing the mode sees the announcement
+    void beginWrite() { writing_.store(true, std::memory_order_seq_cst); }
+
+    void endWrite() { writing_.store(false, std::memory_order_release); }
+
+    [[nodiscard]] bool isWriting() const { return writing_.load(std::memory_order_seq_cst); }
+  };
+}
+
+#endif //WEBSERVER_LOGBUFFER_HPP
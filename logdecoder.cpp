@@ -0,0 +1,32 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "binarylog.hpp"
+
+#include <fstream>
+#include <iostream>
+
+// Converts a binary log written by Logger::startBinary() into the text format: webserver_logdecode <file>
+int main(int argc, char* argv[])
+{
+  if (argc != 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <binary log>" << std::endl;
+    return 2;
+  }
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in)
+  {
+    std::cerr << "Cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  if (!logging::binary::decode(in, std::cout))
+  {
+    std::cerr << "Invalid or truncated binary log: " << argv[1] << std::endl;
+    return 1;
+  }
+  return 0;
+}
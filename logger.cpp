@@ -7,7 +7,9 @@
 #include <iomanip>
 #include <mutex>
 #include <thread>
+#include <ctime>
 #include<fmt/core.h>
+#include<fmt/format.h>
 
 namespace logging
 {
@@ -28,6 +30,15 @@ namespace logging
   Logger::Logger() : loglevel_(LogLevel::INFO), outputstream_(&std::cout), logThreadId_(false)
   {}
 
+  /// @class Logger
+  /// @name Logger::~Logger
+  /// @brief destructor, writes the records still buffered in asynchronous mode
+  /// @throws None
+  Logger::~Logger()
+  {
+    stopAsync();
+  }
+
   /// @class Logger
   /// @name getInstance
   /// @brief returns an instance of a Logger object
@@ -46,7 +57,7 @@ namespace logging
   /// @throws None
   void Logger::setLogLevel(LogLevel level)
   {
-    loglevel_ = level;
+    loglevel_.store(level, std::memory_order_relaxed);
   }
 
   /// @class Logger
@@ -69,6 +80,18 @@ namespace logging
     outputstream_ = &os;
   }
 
+  namespace
+  {
+    ///@brief Sites of the plain log() calls in binary mode, indexed by level. Their messages are formatted already
+    LogSite TEXT_SITES[]{
+      {LogLevel::DEBUG, "", "", 0},
+      {LogLevel::TRACE, "", "", 0},
+      {LogLevel::INFO, "", "", 0},
+      {LogLevel::WARNING, "", "", 0},
+      {LogLevel::ERROR, "", "", 0},
+    };
+  }
+
   /// @class Logger
   /// @name log
   /// @brief log a message with a specified log level
@@ -77,71 +100,530 @@ namespace logging
   /// @throws None
   void Logger::log(LogLevel level, const std::string &message)
   {
-    if (level < loglevel_)
+    if (!isEnabled(level))
     {
       return;
     }
 
-    const std::string logEntry{fmt::format("{}{} [{}]{} {}{}",
-                                           getCurrentTime(),
-                                           logLevelToColor(level).to_string(),
-                                           logLevelToString(level),
-                                           (logThreadId_ ? "[" + std::to_string(formatThreadId(std::this_thread::get_id())) + "]" : ""),
-                                           message,
-                                           color::DEFAULT_COLOR.to_string())};
-    std::lock_guard<std::mutex> guard(outputmutex_);
-    *outputstream_ << logEntry << std::endl;
+    if (binary_.load(std::memory_order_acquire))
+    {
+      log(TEXT_SITES[static_cast<int>(level)], "{}", message);
+      return;
+    }
+    write(formatEntry(level, message), false);
   }
 
   void Logger::log(LogLevel level, const std::string &fileName, const std::string &functionName, const long lineNumber, const std::string& message)
   {
-    if (level < loglevel_)
+    if (!isEnabled(level))
+    {
+      return;
+    }
+    log(level, fmt::format("{} in File: {} Function: {} Line: {}", message, fileName, functionName, lineNumber));
+  }
+
+  /// @class Logger
+  /// @name formatEntry
+  /// @brief Formats a complete log line of the current time and thread
+  /// @param[in] level : log level of the message
+  /// @param[in] message : log message
+  /// @throws None
+  std::string Logger::formatEntry(LogLevel level, const std::string &message) const
+  {
+    return formatLine(getCurrentTime(), level,
+                      logThreadId_ ? std::optional<std::size_t>{formatThreadId(std::this_thread::get_id())} : std::nullopt,
+                      message);
+  }
+
+  /// @class Logger
+  /// @name formatLine
+  /// @brief Formats a complete log line including time, level, thread-id and the terminating newline
+  /// @param[in] time : formatted time
+  /// @param[in] level : log level of the message
+  /// @param[in] thread_id : thread-id, none if it is not logged
+  /// @param[in] message : log message
+  /// @throws None
+  std::string Logger::formatLine(std::string_view time, LogLevel level, std::optional<std::size_t> thread_id, std::string_view message)
+  {
+    return fmt::format("{}{} [{}]{} {}{}\n",
+                       time,
+                       logLevelToColor(level).to_string(),
+                       logLevelToString(level),
+                       (thread_id ? "[" + std::to_string(*thread_id) + "]" : ""),
+                       message,
+                       color::DEFAULT_COLOR.to_string());
+  }
+
+  /// @class Logger
+  /// @name write
+  /// @brief Outputs a record. In asynchronous mode it is appended to the buffer of the calling thread, otherwise it
+  ///        is written and flushed right away
+  /// @param[in] record : complete log line, or binary entry in binary mode
+  /// @param[in] binary : record is a binary entry
+  /// @throws None
+  void Logger::write(std::string_view record, const bool binary)
+  {
+    if (!async_.load(std::memory_order_acquire))
+    {
+      writeSync(record, binary);
+      return;
+    }
+
+    LogBuffer* buffer = getThreadBuffer();
+    // announced before checking the mode again, stopAsync either waits for this write or it is written synchronously.
+    // A record made for the other format must not reach the buffers either, writeSync() sorts it out
+    buffer->beginWrite();
+    if (!async_.load(std::memory_order_seq_cst) || binary != binary_.load(std::memory_order_acquire) || !writeBuffered(buffer, record))
+      writeSync(record, binary);
+    buffer->endWrite();
+  }
+
+  /// @class Logger
+  /// @name writeBuffered
+  /// @brief Appends a record to the buffer of the calling thread, or drops it if the buffer is full and the overflow
+  ///        policy allows it
+  /// @param[in] buffer : buffer of the calling thread
+  /// @param[in] record : complete log line, or binary entry in binary mode
+  /// @returns false if the record has to be written synchronously: it could never fit, or asynchronous mode stopped
+  ///          while waiting for space
+  /// @throws None
+  bool Logger::writeBuffered(LogBuffer* buffer, std::string_view record)
+  {
+    // records which could never fit are written synchronously
+    if (record.size() > buffer->capacity() / 2)
+      return false;
+
+    const bool below_half = buffer->size() <= buffer->capacity() / 2;
+    while (!buffer->tryWrite(record))
+    {
+      if (overflow_policy_ != OverflowPolicy::BLOCK)
+      {
+        if (overflow_policy_ == OverflowPolicy::COUNT_DROPS)
+          dropped_records_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      if (!async_.load(std::memory_order_acquire))
+        return false;
+
+      wakeFlusher();
+      std::this_thread::yield();
+    }
+
+    // only crossing the mark wakes the flusher, not every record behind it
+    if (below_half && buffer->size() > buffer->capacity() / 2)
+      wakeFlusher();
+    return true;
+  }
+
+  /// @class Logger
+  /// @name writeSync
+  /// @brief Writes and flushes a record right away. A binary entry is preceded by the sites not written yet. Records
+  ///        made before the format changed are adapted: a binary entry is converted to a text line, a text line cannot
+  ///        go into a binary log and is counted as dropped
+  /// @throws None
+  void Logger::writeSync(std::string_view record, const bool binary)
+  {
+    std::lock_guard<std::mutex> guard(outputmutex_);
+    // binary_ only changes together with the output stream, under this lock
+    const bool binary_mode = binary_.load(std::memory_order_acquire);
+    if (!binary && binary_mode)
+    {
+      dropped_records_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (binary && !binary_mode)
+    {
+      const std::string line = convertEntry(record);
+      outputstream_->write(line.data(), static_cast<std::streamsize>(line.size()));
+      outputstream_->flush();
+      return;
+    }
+
+    if (binary)
+    {
+      std::string sites;
+      appendNewSites(sites);
+      outputstream_->write(sites.data(), static_cast<std::streamsize>(sites.size()));
+    }
+    outputstream_->write(record.data(), static_cast<std::streamsize>(record.size()));
+    outputstream_->flush();
+  }
+
+  /// @class Logger
+  /// @name convertEntry
+  /// @brief Converts a binary entry into a text line with the site it refers to
+  /// @param[in] entry : complete binary entry
+  /// @returns the line, empty if the site is unknown
+  /// @throws None
+  std::string Logger::convertEntry(std::string_view entry)
+  {
+    const uint32_t id = binary::getEntrySite(entry);
+    const LogSite* site{nullptr};
+    {
+      std::lock_guard<std::mutex> guard(sites_mutex_);
+      if (id != 0 && id <= sites_.size())
+        site = sites_[id - 1];
+    }
+    return site == nullptr ? std::string{} : binary::decodeEntry(entry, *site, logThreadId_);
+  }
+
+  /// @class Logger
+  /// @name getSiteId
+  /// @brief Id of a site in the binary log, the site is registered on its first use
+  /// @param[in,out] site : call site
+  /// @param[in] format : format string used at the site
+  /// @throws None
+  uint32_t Logger::getSiteId(LogSite &site, std::string_view format)
+  {
+    const uint32_t id = site.id.load(std::memory_order_acquire);
+    if (id != 0)
+      return id;
+
+    std::lock_guard<std::mutex> guard(sites_mutex_);
+    if (site.id.load(std::memory_order_relaxed) == 0)
+    {
+      site.format = format;
+      sites_.push_back(&site);
+      site.id.store(static_cast<uint32_t>(sites_.size()), std::memory_order_release);
+    }
+    return site.id.load(std::memory_order_relaxed);
+  }
+
+  /// @class Logger
+  /// @name appendNewSites
+  /// @brief Appends the descriptions of the sites registered since the last call, the output must be locked
+  /// @throws None
+  void Logger::appendNewSites(std::string &out)
+  {
+    std::lock_guard<std::mutex> guard(sites_mutex_);
+    for (; written_sites_ < sites_.size(); ++written_sites_)
+    {
+      binary::appendSite(out, *sites_[written_sites_]);
+    }
+  }
+
+  namespace
+  {
+    ///@brief Buffer of the current thread, handed to the flusher for good once the thread exits
+    struct ThreadBuffer
+    {
+      std::shared_ptr<LogBuffer> buffer;
+
+      ~ThreadBuffer()
+      {
+        if (buffer)
+          buffer->abandon();
+      }
+    };
+
+    thread_local ThreadBuffer thread_buffer;
+  }
+
+  /// @class Logger
+  /// @name getThreadBuffer
+  /// @brief Returns the buffer of the calling thread, it is created and registered with the flusher on first use
+  /// @throws None
+  LogBuffer* Logger::getThreadBuffer()
+  {
+    if (!thread_buffer.buffer)
+    {
+      thread_buffer.buffer = std::make_shared<LogBuffer>(buffer_size_);
+      std::lock_guard<std::mutex> guard(buffers_mutex_);
+      buffers_.push_back(thread_buffer.buffer);
+    }
+    return thread_buffer.buffer.get();
+  }
+
+  /// @class Logger
+  /// @name startAsync
+  /// @brief Starts the flusher thread and switches to asynchronous mode
+  /// @param[in] policy : behaviour when the buffer of a thread is full
+  /// @param[in] buffer_size : size of each thread's buffer in bytes, rounded up to a power of two
+  /// @throws None
+  void Logger::startAsync(OverflowPolicy policy, std::size_t buffer_size)
+  {
+    if (async_.load(std::memory_order_acquire))
     {
       return;
     }
-    const std::string logEntry{fmt::format("{}{} [{}]{} {} in File: {} Function: {} Line: {}{}",
-                                           getCurrentTime(),
-                                           logLevelToColor(level).to_string(),
-                                           logLevelToString(level),
-                                           (logThreadId_ ? "[" +
-                                                           std::to_string(formatThreadId(std::this_thread::get_id())) +
-                                                           "]" : ""), message, fileName, functionName, lineNumber, color::DEFAULT_COLOR.to_string())};
+
+    overflow_policy_ = policy;
+    buffer_size_ = 1024;
+    while (buffer_size_ < buffer_size)
+    {
+      buffer_size_ <<= 1;
+    }
+
+    stop_flusher_ = false;
+    flusher_ = std::thread(&Logger::runFlusher, this);
+    async_.store(true, std::memory_order_release);
+  }
+
+  /// @class Logger
+  /// @name stopAsync
+  /// @brief Stops the flusher thread after it wrote all buffered records. Records logged from now on are written
+  ///        synchronously
+  /// @throws None
+  void Logger::stopAsync()
+  {
+    if (!async_.exchange(false, std::memory_order_seq_cst))
+    {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(flusher_mutex_);
+      stop_flusher_ = true;
+    }
+    flusher_cv_.notify_one();
+    flusher_.join();
+
+    {
+      // a thread which saw asynchronous mode right before the switch may still be appending, or writing an entry
+      // synchronously which has to go to the binary file
+      std::lock_guard<std::mutex> guard(buffers_mutex_);
+      for (const auto& buffer : buffers_)
+      {
+        while (buffer->isWriting())
+          std::this_thread::yield();
+      }
+    }
+
+    // records of threads which were still appending while the flusher stopped
+    std::string batch;
+    drainBuffers(batch);
+
+    {
+      // a thread may have encoded an entry before binary mode ends and write it afterwards, writeSync() converts it
+      std::lock_guard<std::mutex> guard(outputmutex_);
+      if (binary_.exchange(false, std::memory_order_acq_rel))
+      {
+        outputstream_ = text_outputstream_;
+        binary_file_.reset();
+      }
+    }
+  }
+
+  /// @class Logger
+  /// @name startBinary
+  /// @brief Opens the binary log file, writes its header and starts asynchronous mode with binary records
+  /// @param[in] path : binary log file, truncated
+  /// @param[in] policy : behaviour when the buffer of a thread is full
+  /// @param[in] buffer_size : size of each thread's buffer in bytes, rounded up to a power of two
+  /// @returns false if the file cannot be opened or asynchronous mode is running already
+  /// @throws None
+  bool Logger::startBinary(const std::string &path, OverflowPolicy policy, std::size_t buffer_size)
+  {
+    if (async_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    auto file = std::make_unique<std::ofstream>(path, std::ios::binary | std::ios::trunc);
+    if (!*file)
+    {
+      return false;
+    }
+
+    std::string header;
+    binary::appendHeader(header, logThreadId_);
+    file->write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    {
+      std::lock_guard<std::mutex> guard(outputmutex_);
+      {
+        // a new file needs the descriptions of all sites again
+        std::lock_guard<std::mutex> sites_guard(sites_mutex_);
+        written_sites_ = 0;
+      }
+      binary_file_ = std::move(file);
+      text_outputstream_ = outputstream_;
+      outputstream_ = binary_file_.get();
+      binary_.store(true, std::memory_order_release);
+    }
+    startAsync(policy, buffer_size);
+    return true;
+  }
+
+  /// @class Logger
+  /// @name getDroppedRecords
+  /// @brief Number of records discarded because a buffer was full
+  /// @throws None
+  uint64_t Logger::getDroppedRecords() const
+  {
+    return dropped_records_.load(std::memory_order_relaxed);
+  }
+
+  /// @class Logger
+  /// @name wakeFlusher
+  /// @brief Lets the flusher write before its interval elapsed, e.g. because a buffer is filling up
+  /// @throws None
+  void Logger::wakeFlusher()
+  {
+    {
+      std::lock_guard<std::mutex> guard(flusher_mutex_);
+      flush_requested_ = true;
+    }
+    flusher_cv_.notify_one();
+  }
+
+  /// @class Logger
+  /// @name runFlusher
+  /// @brief Body of the flusher thread: writes the buffered records every FLUSH_INTERVAL or when woken up
+  /// @throws None
+  void Logger::runFlusher()
+  {
+    std::string batch;
+    bool stop{false};
+    while (!stop)
+    {
+      {
+        std::unique_lock<std::mutex> lock(flusher_mutex_);
+        flusher_cv_.wait_for(lock, FLUSH_INTERVAL, [this] { return flush_requested_ || stop_flusher_; });
+        flush_requested_ = false;
+        stop = stop_flusher_;
+      }
+      drainBuffers(batch);
+    }
+  }
+
+  /// @class Logger
+  /// @name drainBuffers
+  /// @brief Collects the records of all threads into one batch and writes it with a single flush. The records of one
+  ///        thread keep their order, records of different threads may be interleaved out of time order. Buffers of
+  ///        exited threads are released once drained
+  /// @param[in,out] batch : scratch string, reused between calls
+  /// @throws None
+  void Logger::drainBuffers(std::string &batch)
+  {
+    batch.clear();
+    {
+      std::lock_guard<std::mutex> guard(buffers_mutex_);
+      for (auto it = buffers_.begin(); it != buffers_.end();)
+      {
+        const bool abandoned = (*it)->isAbandoned();
+        (*it)->readInto(batch);
+        it = abandoned ? buffers_.erase(it) : std::next(it);
+      }
+    }
+
+    const uint64_t dropped = dropped_records_.load(std::memory_order_relaxed);
+    if (dropped != reported_drops_)
+    {
+      const std::string message{fmt::format("{} log records dropped, buffers were full", dropped - reported_drops_)};
+      if (binary_.load(std::memory_order_acquire))
+      {
+        LogSite& site = TEXT_SITES[static_cast<int>(LogLevel::WARNING)];
+        char data[binary::MAX_ENTRY_SIZE];
+        binary::Encoder encoder(data, sizeof(data), getSiteId(site, "{}"), getBinaryTime(), getBinaryThreadId());
+        encoder.putArgument(message);
+        batch += encoder.finish();
+      }
+      else
+      {
+        batch += formatEntry(LogLevel::WARNING, message);
+      }
+      reported_drops_ = dropped;
+    }
+
+    if (batch.empty())
+      return;
+
     std::lock_guard<std::mutex> guard(outputmutex_);
-    *outputstream_ << logEntry << std::endl;
+    if (binary_.load(std::memory_order_acquire))
+    {
+      // every site used in the batch was registered before its entries were appended
+      std::string sites;
+      appendNewSites(sites);
+      outputstream_->write(sites.data(), static_cast<std::streamsize>(sites.size()));
+    }
+    outputstream_->write(batch.data(), static_cast<std::streamsize>(batch.size()));
+    outputstream_->flush();
+  }
+
+  namespace
+  {
+    ///@brief The coarse clock is read without touching the hardware clock, but only ticks with the kernel timer.
+    ///       It is used if it still resolves milliseconds
+    clockid_t selectLogClock()
+    {
+      timespec resolution{};
+      if (clock_getres(CLOCK_REALTIME_COARSE, &resolution) == 0 && resolution.tv_sec == 0 && resolution.tv_nsec <= 1000000)
+        return CLOCK_REALTIME_COARSE;
+      return CLOCK_REALTIME;
+    }
+
+    const clockid_t LOG_CLOCK{selectLogClock()};
+
+    ///@brief "HH:MM:SS." of the second formatted last by this thread
+    struct TimeCache
+    {
+      time_t second{-1};
+      char text[12]{};
+    };
+
+    thread_local TimeCache time_cache;
+  }
+
+  /// @class Logger
+  /// @name getBinaryTime
+  /// @brief Time stamp of a binary entry
+  /// @returns nanoseconds since the epoch
+  /// @throws None
+  uint64_t Logger::getBinaryTime()
+  {
+    timespec now{};
+    clock_gettime(LOG_CLOCK, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000U + static_cast<uint64_t>(now.tv_nsec);
+  }
+
+  /// @class Logger
+  /// @name getBinaryThreadId
+  /// @brief Thread-id of a binary entry, the same number the text format shows
+  /// @throws None
+  uint64_t Logger::getBinaryThreadId()
+  {
+    thread_local const uint64_t thread_id{formatThreadId(std::this_thread::get_id())};
+    return thread_id;
   }
 
   /// @class Logger
   /// @name getCurrentTime
-  /// @brief Helper to get current time in HH:MM:SS:MS format
+  /// @brief Helper to get current time in HH:MM:SS.MS format
   /// @param[in,out] None
+  /// @returns view of a thread local buffer, valid until the next call from the same thread
   /// @throws None
-  std::string Logger::getCurrentTime()
+  std::string_view Logger::getCurrentTime()
   {
-    const auto now = std::chrono::system_clock::now();
+    timespec now{};
+    clock_gettime(LOG_CLOCK, &now);
     return formatTime(now);
   }
 
   /// @class Logger
   /// @name formatTime
-  /// @brief Helper to format time the given time to HH:MM:SS:MS format
-  /// @param[in] time_point : time point to format
+  /// @brief Helper to format the given time to HH:MM:SS.MS format. The calendar part only changes once a second, it is
+  ///        cached per thread, so localtime_r() runs once a second and only the milliseconds are formatted every time
+  /// @param[in] time : wall clock time to format
+  /// @returns view of a thread local buffer, valid until the next call from the same thread
   /// @throws None
-  std::string Logger::formatTime(const std::chrono::system_clock::time_point &time_point)
+  std::string_view Logger::formatTime(const timespec &time)
   {
-    // Convert to time_t to extract time components
-    const auto time_t_point = std::chrono::system_clock::to_time_t(time_point);
-    const auto tm = *std::localtime(&time_t_point);
-
-    // Get milliseconds
-    const auto duration = time_point.time_since_epoch();
-    const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration) % 1000;
-
-    // Format the time
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%H:%M:%S");
-    oss << '.' << std::setw(3) << std::setfill('0') << milliseconds.count();
+    if (time.tv_sec != time_cache.second)
+    {
+      tm calendar{};
+      localtime_r(&time.tv_sec, &calendar);
+      fmt::format_to(time_cache.text, "{:02}:{:02}:{:02}.", calendar.tm_hour, calendar.tm_min, calendar.tm_sec);
+      time_cache.second = time.tv_sec;
+    }
 
-    return oss.str();
+    const long milliseconds = time.tv_nsec / 1000000;
+    time_cache.text[9] = static_cast<char>('0' + milliseconds / 100);
+    time_cache.text[10] = static_cast<char>('0' + milliseconds / 10 % 10);
+    time_cache.text[11] = static_cast<char>('0' + milliseconds % 10);
+    return {time_cache.text, sizeof(time_cache.text)};
   }
 
   // Helper to convert log level to string
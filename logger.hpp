@@ -13,52 +13,173 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+#include <string_view>
+#include <ctime>
+#include <optional>
 #include<fmt/core.h>
 
 #include "color.hpp"
+#include "logbuffer.hpp"
+#include "loglevel.hpp"
+#include "binarylog.hpp"
 
 namespace logging
 {
   std::size_t formatThreadId(const std::thread::id& tid);
 
-  enum class LogLevel
+  ///@brief What a thread does in asynchronous mode when its log buffer is full
+  enum class OverflowPolicy
   {
-    DEBUG,
-    TRACE,
-    INFO,
-    WARNING,
-    ERROR,
+    BLOCK,        // wait until the flusher made room
+    DROP,         // discard the record
+    COUNT_DROPS,  // discard the record, the flusher reports the number of discarded records in the log
   };
 
   class Logger
   {
   public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE{256 * 1024};
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+
     static Logger &getInstance();
 
     Logger(const Logger &) = delete;
     Logger &operator=(const Logger &) = delete;
 
     void setLogLevel(LogLevel level);
+
+    ///@brief Whether records of this level are written. Checked by the LOG_* macros before any argument is formatted
+    [[nodiscard]] bool isEnabled(LogLevel level) const
+    { return level >= MIN_LOG_LEVEL && level >= loglevel_.load(std::memory_order_relaxed); }
+
     void setLogThreadId(bool logTID);
     void setOutputStream(std::ostream &os);
 
     void log(LogLevel level, const std::string &message);
     void log(LogLevel level, const std::string &fileName, const std::string &functionName, const long lineNumber, const std::string& message);
 
+    ///@brief Logs at a call site, used by the LOG_* macros. In binary mode only the raw arguments are written, the
+    ///       formatting is left to the decoder
+    template<typename... Args>
+    void log(LogSite &site, fmt::format_string<Args...> format, Args&&... args)
+    {
+      if (binary_.load(std::memory_order_acquire))
+      {
+        char data[binary::MAX_ENTRY_SIZE];
+        const fmt::string_view format_view{format};
+        binary::Encoder encoder(data, sizeof(data), getSiteId(site, {format_view.data(), format_view.size()}), getBinaryTime(),
+                                getBinaryThreadId());
+        (encoder.putArgument(args), ...);
+        write(encoder.finish(), true);
+        return;
+      }
+
+      if (site.line == 0)
+        log(site.level, fmt::format(format, std::forward<Args>(args)...));
+      else
+        log(site.level, site.file, site.function, site.line, fmt::format(format, std::forward<Args>(args)...));
+    }
+
+    ///@brief Switches to asynchronous mode: every thread appends its records to its own lock-free buffer and a
+    ///       background thread writes them to the output stream in batches, with one flush per batch
+    ///@param policy : behaviour when the buffer of a thread is full
+    ///@param buffer_size : size of each thread's buffer in bytes, rounded up to a power of two
+    void startAsync(OverflowPolicy policy = OverflowPolicy::COUNT_DROPS, std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    ///@brief Writes all buffered records and returns to synchronous mode
+    void stopAsync();
+
+    ///@brief Switches to asynchronous binary mode: records hold the raw arguments of the LOG_* macros and are written
+    ///       to a file, which the decoder (webserver_logdecode) converts to the text format
+    ///@param path : binary log file, truncated
+    ///@returns false if the file cannot be opened or asynchronous mode is running already
+    bool startBinary(const std::string &path, OverflowPolicy policy = OverflowPolicy::COUNT_DROPS, std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    ///@brief Number of records discarded by OverflowPolicy::COUNT_DROPS
+    [[nodiscard]] uint64_t getDroppedRecords() const;
+
+    ///@brief Formats a complete log line, as written in text mode
+    [[nodiscard]] static std::string formatLine(std::string_view time, LogLevel level, std::optional<std::size_t> thread_id, std::string_view message);
+
+    ///@brief Formats a wall clock time as HH:MM:SS.MS
+    ///@returns view of a thread local buffer, valid until the next call from the same thread
+    static std::string_view formatTime(const timespec &time);
+
   private:
     Logger();
+    ~Logger();
+
+    [[nodiscard]] std::string formatEntry(LogLevel level, const std::string &message) const;
+    void write(std::string_view record, bool binary);
+    bool writeBuffered(LogBuffer* buffer, std::string_view record);
+    void writeSync(std::string_view record, bool binary);
+    std::string convertEntry(std::string_view entry);
+    uint32_t getSiteId(LogSite &site, std::string_view format);
+    void appendNewSites(std::string &out);
+    static uint64_t getBinaryTime();
+    static uint64_t getBinaryThreadId();
+    LogBuffer* getThreadBuffer();
+    void wakeFlusher();
+    void runFlusher();
+    void drainBuffers(std::string &batch);
 
-    static std::string getCurrentTime();
-    static std::string formatTime(const std::chrono::system_clock::time_point &time_point);
+    static std::string_view getCurrentTime();
 
     static std::string logLevelToString(LogLevel level);
     static color::Modifier logLevelToColor(LogLevel level);
 
     bool logThreadId_;
-    LogLevel loglevel_;
+    std::atomic<LogLevel> loglevel_;
     std::ostream *outputstream_;
     std::mutex outputmutex_;
+
+    std::atomic<bool> async_{false};
+    OverflowPolicy overflow_policy_{OverflowPolicy::COUNT_DROPS};
+    std::size_t buffer_size_{DEFAULT_BUFFER_SIZE};
+    std::atomic<uint64_t> dropped_records_{0};
+    uint64_t reported_drops_{0};
+
+    std::mutex buffers_mutex_;
+    std::vector<std::shared_ptr<LogBuffer>> buffers_;
+
+    std::thread flusher_;
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_cv_;
+    bool flush_requested_{false};
+    bool stop_flusher_{false};
+
+    std::atomic<bool> binary_{false};
+    std::unique_ptr<std::ofstream> binary_file_;
+    std::ostream *text_outputstream_{nullptr};
+    std::mutex sites_mutex_;
+    std::vector<const LogSite*> sites_;   // index is the site id - 1
+    std::size_t written_sites_{0};
   };
 } // logging
 
+///@brief Logs with the location of the call, which is kept in a static LogSite. The arguments are only formatted if
+///       the level is enabled, levels below WEBSERVER_MIN_LOG_LEVEL are removed at compile time
+#define WEBSERVER_LOG(level, ...)                                                                             \
+  do                                                                                                          \
+  {                                                                                                           \
+    if constexpr ((level) >= logging::MIN_LOG_LEVEL)                                                          \
+    {                                                                                                         \
+      if (logging::Logger::getInstance().isEnabled(level))                                                    \
+      {                                                                                                       \
+        static logging::LogSite webserver_log_site{(level), __FILE__, __func__, __LINE__};                    \
+        logging::Logger::getInstance().log(webserver_log_site, __VA_ARGS__);                                  \
+      }                                                                                                       \
+    }                                                                                                         \
+  } while (false)
+
+#define LOG_DEBUG(...) WEBSERVER_LOG(logging::LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) WEBSERVER_LOG(logging::LogLevel::TRACE, __VA_ARGS__)
+#define LOG_INFO(...) WEBSERVER_LOG(logging::LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) WEBSERVER_LOG(logging::LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) WEBSERVER_LOG(logging::LogLevel::ERROR, __VA_ARGS__)
+
 #endif //WEBSERVER_LOGGER_HPP
@@ -0,0 +1,27 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_LOGLEVEL_HPP
+#define WEBSERVER_LOGLEVEL_HPP
+
+namespace logging
+{
+  enum class LogLevel
+  {
+    DEBUG,
+    TRACE,
+    INFO,
+    WARNING,
+    ERROR,
+  };
+
+#ifndef WEBSERVER_MIN_LOG_LEVEL
+#define WEBSERVER_MIN_LOG_LEVEL 0
+#endif
+
+  ///@brief Records below this level are compiled out, set with the CMake option WEBSERVER_MIN_LOG_LEVEL
+  constexpr LogLevel MIN_LOG_LEVEL{static_cast<LogLevel>(WEBSERVER_MIN_LOG_LEVEL)};
+}
+
+#endif //WEBSERVER_LOGLEVEL_HPP
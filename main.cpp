@@ -4,10 +4,21 @@
 #include "trace.hpp"
 #include "socket.hpp"
 #include "messagequeue.hpp"
+#include "lockfreemessagequeue.hpp"
+#include "bufferpool.hpp"
+#include "httprequest.hpp"
+#include "httpresponse.hpp"
+#include "staticfiles.hpp"
+#include "responsecache.hpp"
+#include "cachingmessagequeue.hpp"
+#include "metrics.hpp"
 
 #include <thread>
 #include <chrono>
 #include <memory>
+#include <string>
+#include <algorithm>
+#include <csignal>
 
 
 
@@ -19,39 +30,204 @@ void simulateKeyboard(network::tcp::Socket* socket)
 }
 
 
-void handle_message_queue(network::tcp::SocketMessageQueue* message_queue)
+void handle_message(container::message_queue::Queue* message_queue, network::http::StaticFileHandler* static_files, const container::message_queue::Message& message)
 {
-  std::cout << "Message responder started" << std::endl;
-  while (true)
+  // the reactor only hands complete requests over, parsing them again is a single pass without allocations
+  network::http::RequestParser parser;
+  if (parser.parse(message.getMessageString()) != network::http::RequestParser::Status::COMPLETE)
   {
-    container::message_queue::Message message = message_queue->retrieveReceivedMessage();
-    std::cout << "Received message" << std::endl;
-    message_queue->enqueueResponseMessage({"200 OK", message.getSocket()});
+    message_queue->enqueueResponseMessage(message.respond(network::http::errorResponse(parser.getErrorStatus())));
+    return;
+  }
+
+  const network::http::Request& request = parser.getRequest();
+  LOG_DEBUG("Handling {} {}", request.getMethod(), request.getTarget());
 
-    std::cout << "enqueued answer" << std::endl;
-    break;
+  if (static_files != nullptr)
+  {
+    const network::http::Response response = static_files->handle(request);
+    message_queue->enqueueResponseMessage(message.respond(response.getSegments(), response.getFileBody()));
+    return;
   }
+
+  network::http::Response response{200};
+  response.addHeaderBlock(container::buffer::BufferSlice::fromStatic("Content-Type: text/plain\r\n"))
+          .setBody(container::buffer::BufferSlice::fromStatic("OK"))
+          .setConnection(request);
+  message_queue->enqueueResponseMessage(message.respond(response.getSegments()));
 }
 
 
-int main()
+void handle_admin_message(container::message_queue::Queue* message_queue, const container::message_queue::Message& message)
+{
+  network::http::RequestParser parser;
+  if (parser.parse(message.getMessageString()) != network::http::RequestParser::Status::COMPLETE)
+  {
+    message_queue->enqueueResponseMessage(message.respond(network::http::errorResponse(parser.getErrorStatus())));
+    return;
+  }
+
+  const network::http::Request& request = parser.getRequest();
+  if (request.getTarget() != "/metrics")
+  {
+    network::http::Response response{404};
+    response.setConnection(request);
+    message_queue->enqueueResponseMessage(message.respond(response.getSegments()));
+    return;
+  }
+
+  network::http::Response response{200};
+  response.addHeaderBlock(container::buffer::BufferSlice::fromStatic("Content-Type: text/plain; version=0.0.4\r\n"))
+          .setBody(container::buffer::BufferSlice{metrics::Registry::getInstance().scrape()})
+          .setConnection(request);
+  if (request.getMethod() == "HEAD")
+    response.omitBody();
+  message_queue->enqueueResponseMessage(message.respond(response.getSegments()));
+}
+
+
+int main(int argc, char* argv[])
 {
   logging::Logger::getInstance().setLogLevel(logging::LogLevel::DEBUG);
   logging::Logger::getInstance().setLogThreadId(true);
 
   const logging::Trace trace(__func__ );
 
-  network::tcp::SocketMessageQueue socketMessageQueue;
-  network::tcp::Socket socket(network::ip::IPv4Address(127, 0, 0, 1), 8080, socketMessageQueue);
+  // the sends of the reactors pass MSG_NOSIGNAL, but sendfile() has no such flag: a peer resetting the connection
+  // during a file transfer would terminate the process. The disposition is process wide, so it is set once here
+  signal(SIGPIPE, SIG_IGN);
+
+  network::tcp::IoBackend backend{network::tcp::IoBackend::EPOLL};
+  network::tcp::ListenMode listen_mode{network::tcp::ListenMode::SINGLE_LISTENER};
+  std::size_t number_reactors{2};
+  bool lock_free_queue{false};
+  bool response_cache{false};
+  std::string document_root;
+  std::string binary_log;
+  std::string span_trace;
+  unsigned short metrics_port{0};
+  std::size_t queue_capacity{0};
+  container::message_queue::OverloadPolicy overload_policy{container::message_queue::OverloadPolicy::BACKPRESSURE};
+  std::chrono::milliseconds queue_time_budget{0};
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string argument{argv[i]};
+    if (argument == "io_uring")
+      backend = network::tcp::IoBackend::IO_URING;
+    else if (argument == "sharded")
+    {
+      listen_mode = network::tcp::ListenMode::REUSEPORT_SHARDS;
+      number_reactors = std::max(1U, std::thread::hardware_concurrency());
+    }
+    else if (argument == "lockfree")
+      lock_free_queue = true;
+    else if (argument == "hugepages")
+      container::buffer::BufferPool::getInstance().setUseHugePages(true);
+    else if (argument == "cache")
+      response_cache = true;
+    else if (argument.rfind("root=", 0) == 0)
+      document_root = argument.substr(5);
+    else if (argument.rfind("binlog=", 0) == 0)
+      binary_log = argument.substr(7);
+    else if (argument.rfind("spans=", 0) == 0)
+      span_trace = argument.substr(6);
+    else if (argument.rfind("metrics=", 0) == 0)
+      metrics_port = static_cast<unsigned short>(std::stoul(argument.substr(8)));
+    else if (argument.rfind("capacity=", 0) == 0)
+      queue_capacity = std::stoul(argument.substr(9));
+    else if (argument == "shed")
+      overload_policy = container::message_queue::OverloadPolicy::SHED;
+    else if (argument.rfind("budget=", 0) == 0)
+      queue_time_budget = std::chrono::milliseconds(std::stoul(argument.substr(7)));
+  }
+
+  if (binary_log.empty())
+    logging::Logger::getInstance().startAsync();
+  else if (!logging::Logger::getInstance().startBinary(binary_log))
+    throw logging::Error(LOC, fmt::format("Cannot open binary log {}", binary_log));
+
+  if (!span_trace.empty())
+    logging::SpanRecorder::getInstance().start();
+
+  std::unique_ptr<network::http::StaticFileHandler> static_files;
+  if (!document_root.empty())
+    static_files = std::make_unique<network::http::StaticFileHandler>(document_root);
+
+  std::unique_ptr<container::message_queue::Queue> messageQueue;
+  if (lock_free_queue)
+    messageQueue = std::make_unique<network::tcp::LockFreeMessageQueue>();
+  else
+    messageQueue = std::make_unique<network::tcp::SocketMessageQueue>();
+
+  std::unique_ptr<network::http::ResponseCache> responseCache;
+  if (response_cache)
+  {
+    responseCache = std::make_unique<network::http::ResponseCache>();
+    messageQueue = std::make_unique<network::tcp::CachingMessageQueue>(std::move(messageQueue), *responseCache);
+
+    metrics::Registry& registry = metrics::Registry::getInstance();
+    registry.addCallback("webserver_response_cache_hits_total", "Requests answered from the response cache", metrics::Registry::Type::COUNTER,
+                         [&responseCache] { return static_cast<double>(responseCache->getStatistics().hits); });
+    registry.addCallback("webserver_response_cache_misses_total", "Cacheable requests passed on to the workers", metrics::Registry::Type::COUNTER,
+                         [&responseCache] { return static_cast<double>(responseCache->getStatistics().misses); });
+    registry.addCallback("webserver_response_cache_evictions_total", "Responses evicted to make room", metrics::Registry::Type::COUNTER,
+                         [&responseCache] { return static_cast<double>(responseCache->getStatistics().evictions); });
+    registry.addCallback("webserver_response_cache_bytes", "Bytes held by the response cache", metrics::Registry::Type::GAUGE,
+                         [&responseCache] { return static_cast<double>(responseCache->getStatistics().bytes); });
+  }
+
+  messageQueue->setCapacity(queue_capacity, overload_policy);
+
+  metrics::Registry::getInstance().addCallback("webserver_log_records_dropped_total", "Log records dropped because a buffer was full",
+                                               metrics::Registry::Type::COUNTER,
+                                               [] { return static_cast<double>(logging::Logger::getInstance().getDroppedRecords()); });
+
+  network::tcp::Socket socket(network::ip::IPv4Address(127, 0, 0, 1), 8080, *messageQueue, backend, listen_mode, number_reactors);
+
+  // metrics are served by a separate socket with its own worker, so scrapes never wait behind requests
+  std::unique_ptr<network::tcp::SocketMessageQueue> adminQueue;
+  std::unique_ptr<network::tcp::Socket> adminSocket;
+  if (metrics_port != 0)
+  {
+    adminQueue = std::make_unique<network::tcp::SocketMessageQueue>();
+    adminSocket = std::make_unique<network::tcp::Socket>(network::ip::IPv4Address(127, 0, 0, 1), metrics_port, *adminQueue, backend,
+                                                         network::tcp::ListenMode::SINGLE_LISTENER, 1);
+    adminSocket->listenSocket();
+    adminSocket->startWorkerPool([&adminQueue](const container::message_queue::Message& message) {
+      handle_admin_message(adminQueue.get(), message);
+    }, 1);
+  }
 
   std::thread thread(simulateKeyboard, &socket);
 
   socket.listenSocket();
-
-  std::thread answer_thread(handle_message_queue, &socketMessageQueue);
+  socket.startWorkerPool([&messageQueue, &static_files](const container::message_queue::Message& message) {
+    handle_message(messageQueue.get(), static_files.get(), message);
+  }, std::max(1U, std::thread::hardware_concurrency()), queue_time_budget);
 
   thread.join();
-  answer_thread.join();
+
+  if (adminSocket)
+    adminSocket->shutdownSocket();
+
+  if (responseCache)
+  {
+    const network::http::ResponseCache::Statistics statistics = responseCache->getStatistics();
+    LOG_INFO("Response cache: {} hits, {} misses, {} insertions, {} evictions, {} expirations, {} entries, {} bytes",
+             statistics.hits, statistics.misses, statistics.insertions, statistics.evictions,
+             statistics.expirations, statistics.entries, statistics.bytes);
+  }
+
+  if (!span_trace.empty())
+  {
+    logging::SpanRecorder::getInstance().stop();
+    if (logging::SpanRecorder::getInstance().writeTrace(span_trace))
+      LOG_INFO("Spans written to {}, {} overwritten", span_trace, logging::SpanRecorder::getInstance().getOverwrittenSpans());
+    else
+      LOG_ERROR("Cannot write spans to {}", span_trace);
+  }
+
+  logging::Logger::getInstance().stopAsync();
 
   return 0;
 }
@@ -7,17 +7,84 @@
 #include "error.hpp"
 #include "logger.hpp"
 #include "trace.hpp"
+#include "servermetrics.hpp"
+
+#include <algorithm>
+
+namespace container::message_queue
+{
+  /// @class Message
+  /// @name Message
+  /// @brief constructor for a message consisting of several segments, the first one becomes the payload
+  /// @param[in] segments : segments in sending order
+  /// @param[in] connection : connection the message belongs to
+  /// @param[in] sequence : sequence number of the request
+  /// @param[in] file : file region sent behind the segments, may be empty
+  /// @throws None
+  Message::Message(container::buffer::BufferSegments segments, const ConnectionHandle connection, const uint64_t sequence,
+                   container::buffer::FileRegion file) : file_(std::move(file)), connection_(connection), sequence_(sequence)
+  {
+    if (segments.empty())
+      return;
+
+    payload_ = std::move(segments.front());
+    segments.erase(segments.begin());
+    trailing_segments_ = std::move(segments);
+  }
+
+  /// @class Message
+  /// @name releaseSegments
+  /// @brief Hands all segments over in sending order. Empty segments are left out
+  /// @throws None
+  container::buffer::BufferSegments Message::releaseSegments()
+  {
+    container::buffer::BufferSegments segments;
+    segments.reserve(1 + trailing_segments_.size());
+    if (!payload_.empty())
+      segments.emplace_back(std::move(payload_));
+
+    for (auto& segment : trailing_segments_)
+    {
+      if (!segment.empty())
+        segments.emplace_back(std::move(segment));
+    }
+    trailing_segments_.clear();
+    return segments;
+  }
+}
 
 namespace network::tcp
 {
-  void SocketMessageQueue::enqueueReceivedMessage(const container::message_queue::Message &message)
+  /// @class SocketMessageQueue
+  /// @name getFreeCapacity
+  /// @brief Number of the given messages the queue takes. Must be called with the received queue mutex held
+  /// @param[in] count : number of messages to enqueue
+  /// @throws None
+  std::size_t SocketMessageQueue::getFreeCapacity(const std::size_t count) const
+  {
+    if (capacity_ == 0 || policy_ == container::message_queue::OverloadPolicy::BACKPRESSURE)
+      return count;
+
+    const std::size_t size = received_queue_.size();
+    return size < capacity_ ? std::min(count, capacity_ - size) : 0;
+  }
+
+  bool SocketMessageQueue::enqueueReceivedMessage(container::message_queue::Message &&message)
   {
     const logging::Trace trace(__func__);
     received_queue_mutex_.lock();
-    received_queue_.emplace(message);
+    if (getFreeCapacity(1) == 0)
+    {
+      received_queue_mutex_.unlock();
+      return false;
+    }
+    received_queue_.emplace(std::move(message));
+    received_size_.store(received_queue_.size(), std::memory_order_relaxed);
     received_queue_mutex_.unlock();
+    ServerMetrics::get().received_queue_depth.add();
 
     received_queue_cv_.notify_one();
+    return true;
   }
 
   container::message_queue::Message SocketMessageQueue::retrieveReceivedMessage()
@@ -27,14 +94,16 @@ namespace network::tcp
 
     while (received_queue_.empty())
     {
-      received_queue_cv_.wait(unique_received_queue_lock);
-
-      std::lock_guard guard_shutdown_lock(shutdown_mutex_);
-      if (shutdown_)
       {
-        unique_received_queue_lock.unlock();
-        return {"", -1};
+        std::lock_guard guard_shutdown_lock(shutdown_mutex_);
+        if (shutdown_)
+        {
+          unique_received_queue_lock.unlock();
+          return {"", {}};
+        }
       }
+
+      received_queue_cv_.wait(unique_received_queue_lock);
     }
 
     if (!unique_received_queue_lock.owns_lock())
@@ -43,14 +112,71 @@ namespace network::tcp
     if (received_queue_.empty())
       throw logging::Error(LOC, "retrieving from an empty queue is not allowed!");
 
-    const container::message_queue::Message message{received_queue_.front()};
+    container::message_queue::Message message{std::move(received_queue_.front())};
     received_queue_.pop();
+    received_size_.store(received_queue_.size(), std::memory_order_relaxed);
+    ServerMetrics::get().received_queue_depth.sub();
 
     unique_received_queue_lock.unlock();
 
     return message;
   }
 
+  std::size_t SocketMessageQueue::enqueueReceivedMessages(container::message_queue::Message *messages, const std::size_t count)
+  {
+    const logging::Trace trace(__func__);
+    if (count == 0)
+      return 0;
+
+    received_queue_mutex_.lock();
+    const std::size_t accepted = getFreeCapacity(count);
+    for (std::size_t i = 0; i < accepted; ++i)
+    {
+      received_queue_.emplace(std::move(messages[i]));
+    }
+    received_size_.store(received_queue_.size(), std::memory_order_relaxed);
+    received_queue_mutex_.unlock();
+    if (accepted == 0)
+      return 0;
+
+    ServerMetrics::get().received_queue_depth.add(static_cast<int64_t>(accepted));
+
+    if (accepted == 1)
+      received_queue_cv_.notify_one();
+    else
+      received_queue_cv_.notify_all();
+    return accepted;
+  }
+
+  std::size_t SocketMessageQueue::retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, const std::size_t max_messages)
+  {
+    const logging::Trace trace(__func__);
+    std::unique_lock<std::mutex> unique_received_queue_lock(received_queue_mutex_);
+
+    while (received_queue_.empty())
+    {
+      {
+        std::lock_guard guard_shutdown_lock(shutdown_mutex_);
+        if (shutdown_)
+          return 0;
+      }
+
+      received_queue_cv_.wait(unique_received_queue_lock);
+    }
+
+    std::size_t retrieved{0};
+    while (retrieved < max_messages && !received_queue_.empty())
+    {
+      messages.emplace_back(std::move(received_queue_.front()));
+      received_queue_.pop();
+      ++retrieved;
+    }
+    received_size_.store(received_queue_.size(), std::memory_order_relaxed);
+    ServerMetrics::get().received_queue_depth.sub(static_cast<int64_t>(retrieved));
+
+    return retrieved;
+  }
+
   std::optional<container::message_queue::Message> SocketMessageQueue::retrieveResponseMessageNonBlocking()
   {
     const logging::Trace trace(__func__);
@@ -58,8 +184,9 @@ namespace network::tcp
     if (respond_queue_.empty())
       return {};
 
-    container::message_queue::Message response{respond_queue_.front()};
+    container::message_queue::Message response{std::move(respond_queue_.front())};
     respond_queue_.pop();
+    ServerMetrics::get().respond_queue_depth.sub();
 
     return response;
   }
@@ -71,14 +198,16 @@ namespace network::tcp
 
     while (respond_queue_.empty())
     {
-      respond_queue_cv_.wait(unique_respond_queue_lock);
-
-      std::lock_guard guard_shutdown_lock(shutdown_mutex_);
-      if (shutdown_)
       {
-        unique_respond_queue_lock.unlock();
-        return {"", -1};
+        std::lock_guard guard_shutdown_lock(shutdown_mutex_);
+        if (shutdown_)
+        {
+          unique_respond_queue_lock.unlock();
+          return {"", {}};
+        }
       }
+
+      respond_queue_cv_.wait(unique_respond_queue_lock);
     }
 
     if (!unique_respond_queue_lock.owns_lock())
@@ -87,24 +216,46 @@ namespace network::tcp
     if (respond_queue_.empty())
       throw logging::Error(LOC, "retrieving from an empty queue is not allowed!");
 
-    const container::message_queue::Message response{respond_queue_.front()};
+    container::message_queue::Message response{std::move(respond_queue_.front())};
     respond_queue_.pop();
+    ServerMetrics::get().respond_queue_depth.sub();
 
     unique_respond_queue_lock.unlock();
 
     return response;
   }
 
-  void SocketMessageQueue::enqueueResponseMessage(const container::message_queue::Message &message)
+  void SocketMessageQueue::enqueueResponseMessage(container::message_queue::Message &&message)
   {
     const logging::Trace trace(__func__);
+    if (container::message_queue::ResponseRouter* router = response_router_.load(std::memory_order_acquire))
+    {
+      router->routeResponse(std::move(message));
+      return;
+    }
+
     respond_queue_mutex_.lock();
-    respond_queue_.emplace(message);
+    respond_queue_.emplace(std::move(message));
     respond_queue_mutex_.unlock();
+    ServerMetrics::get().respond_queue_depth.add();
 
     respond_queue_cv_.notify_one();
   }
 
+  void SocketMessageQueue::setResponseRouter(container::message_queue::ResponseRouter *router)
+  {
+    const logging::Trace trace(__func__);
+    response_router_.store(router, std::memory_order_release);
+  }
+
+  void SocketMessageQueue::setCapacity(const std::size_t capacity, const container::message_queue::OverloadPolicy policy)
+  {
+    const logging::Trace trace(__func__);
+    std::lock_guard<std::mutex> guard(received_queue_mutex_);
+    capacity_ = capacity;
+    policy_ = policy;
+  }
+
   void SocketMessageQueue::shutdown()
   {
     const logging::Trace trace(__func__);
@@ -112,7 +263,13 @@ namespace network::tcp
     shutdown_ = true;
     shutdown_mutex_.unlock();
 
+    // waiters check the flag while holding their queue mutex, so taking it once guarantees that nobody misses the notification
+    respond_queue_mutex_.lock();
+    respond_queue_mutex_.unlock();
     respond_queue_cv_.notify_all();
+
+    received_queue_mutex_.lock();
+    received_queue_mutex_.unlock();
     received_queue_cv_.notify_all();
   }
 }
\ No newline at end of file
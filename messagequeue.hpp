@@ -5,49 +5,179 @@
 #ifndef WEBSERVER_MESSAGEQUEUE_HPP
 #define WEBSERVER_MESSAGEQUEUE_HPP
 
+#include "buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <queue>
 #include <optional>
 #include <utility>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 
 namespace container::message_queue
 {
+  ///@brief Identifies an accepted connection independent of its file descriptor, which the kernel reuses once the
+  ///       connection is closed. Encodes the index of the owning reactor and a per-reactor connection id
+  class ConnectionHandle
+  {
+  private:
+    static constexpr unsigned ID_BITS{48};
+    static constexpr uint64_t ID_MASK{(uint64_t{1} << ID_BITS) - 1};
+
+    uint64_t value_{0};
+
+  public:
+    ConnectionHandle() = default;
+
+    ConnectionHandle(uint16_t reactor, uint64_t id) : value_((static_cast<uint64_t>(reactor) << ID_BITS) | (id & ID_MASK))
+    {}
+
+    [[nodiscard]] uint16_t getReactor() const
+    { return static_cast<uint16_t>(value_ >> ID_BITS); }
+
+    [[nodiscard]] uint64_t getId() const
+    { return value_ & ID_MASK; }
+
+    ///@brief Connection ids start at 1, a default constructed handle refers to no connection
+    [[nodiscard]] bool isValid() const
+    { return getId() != 0; }
+
+    bool operator==(const ConnectionHandle& other) const
+    { return value_ == other.value_; }
+  };
+
+  ///@brief Move-only message. The payload is a slice of a reference counted buffer, e.g. the receive buffer of the
+  ///       connection, so handing a message from the reactor over the queue to a handler never copies its bytes.
+  ///       A response may consist of several segments (e.g. header block and body) which are written with a single
+  ///       gathering send, followed by a region of a file which is sent without reading it into user space. The sequence number counts the requests of a connection; a response carries the number of its
+  ///       request, so the reactor can send the responses to pipelined requests in request order
   class Message
   {
   private:
-    std::string msg_;
-    int socket_;
+    container::buffer::BufferSlice payload_;
+    container::buffer::BufferSegments trailing_segments_;   // sent behind the payload
+    container::buffer::FileRegion file_;                     // sent behind all segments
+    ConnectionHandle connection_;
+    uint64_t sequence_{0};
+    std::chrono::steady_clock::time_point received_time_{};   // copied into the response
   public:
-    Message(std::string msg, int socket) : msg_(std::move(msg)), socket_(socket)
+    Message(container::buffer::BufferSlice payload, ConnectionHandle connection, uint64_t sequence = 0,
+            std::chrono::steady_clock::time_point received_time = {}) : payload_(std::move(payload)), connection_(connection),
+                                                                         sequence_(sequence), received_time_(received_time)
+    {}
+
+    Message(std::string msg, ConnectionHandle connection, uint64_t sequence = 0) : payload_(std::move(msg)), connection_(connection),
+                                                                                 sequence_(sequence)
     {}
 
-    [[nodiscard]] const std::string &getMessageString() const
-    { return msg_; }
+    Message(container::buffer::BufferSegments segments, ConnectionHandle connection, uint64_t sequence = 0,
+            container::buffer::FileRegion file = {});
+
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+    Message(Message&&) noexcept = default;
+    Message& operator=(Message&&) noexcept = default;
+
+    ///@brief The first segment, which is the whole message unless it was created from several segments
+    [[nodiscard]] std::string_view getMessageString() const
+    { return payload_.view(); }
+
+    [[nodiscard]] const container::buffer::BufferSlice &getPayload() const
+    { return payload_; }
+
+    ///@brief Hands all segments over, e.g. to the send queue of the connection. Empty segments are left out
+    [[nodiscard]] container::buffer::BufferSegments releaseSegments();
+
+    ///@brief Hands the file region sent behind the segments over, empty if there is none
+    [[nodiscard]] container::buffer::FileRegion releaseFile()
+    { return std::move(file_); }
+
+    [[nodiscard]] ConnectionHandle getConnection() const
+    { return connection_; }
+
+    [[nodiscard]] uint64_t getSequence() const
+    { return sequence_; }
+
+    ///@brief Time the reactor read the request, a default constructed time point if it is unknown
+    [[nodiscard]] std::chrono::steady_clock::time_point getReceivedTime() const
+    { return received_time_; }
+
+    ///@brief Creates the response to this request, addressed to the same connection and sequence number
+    [[nodiscard]] Message respond(container::buffer::BufferSlice payload) const
+    { return {std::move(payload), connection_, sequence_, received_time_}; }
 
-    [[nodiscard]] int getSocket() const
-    { return socket_; }
+    [[nodiscard]] Message respond(container::buffer::BufferSegments segments, container::buffer::FileRegion file = {}) const
+    {
+      Message response{std::move(segments), connection_, sequence_, std::move(file)};
+      response.received_time_ = received_time_;
+      return response;
+    }
+  };
+
+///@interface ResponseRouter
+  class ResponseRouter
+  {
+  public:
+    ///@brief Shall deliver a response directly to the connection it is addressed to
+    virtual void routeResponse(Message &&message) = 0;
+  };
+
+  ///@brief What happens to received messages once a bounded queue holds its capacity
+  enum class OverloadPolicy
+  {
+    BACKPRESSURE, ///< the queue takes every message; the reactors stop reading until it drained to half its capacity
+    SHED,         ///< the queue refuses the messages beyond its capacity, the reactors answer them with 503
   };
 
 ///@interface MessageQueue
   class Queue
   {
   public:
-    ///@brief Shall add a received message to the message queue. Exclusive access to the queue must be ensured
-    virtual void enqueueReceivedMessage(const Message &message) = 0;
+    ///@brief Shall add a received message to the message queue. Exclusive access to the queue must be ensured.
+    ///       Returns false if the queue refused the message, which is then left untouched
+    virtual bool enqueueReceivedMessage(Message &&message) = 0;
 
     ///@brief Removes a previously received message from the queue. In case no message is available, the accessing thread blocks until a message is available
     virtual Message retrieveReceivedMessage() = 0;
 
+    ///@brief Shall add several received messages with a single synchronisation round trip. The messages are moved from.
+    ///       Returns the number of accepted messages; the refused ones are left untouched at the end of the array
+    virtual std::size_t enqueueReceivedMessages(Message *messages, std::size_t count) = 0;
+
+    ///@brief Moves up to max_messages received messages into the given container. Blocks until at least one message is available.
+    ///       Returns the number of retrieved messages, 0 only if the queue was shut down
+    virtual std::size_t retrieveReceivedMessages(std::vector<Message> &messages, std::size_t max_messages) = 0;
+
     ///@brief Removes a previously received message from the queue. In case no message is available, an empty object gets returned immediately
     virtual std::optional<Message> retrieveResponseMessageNonBlocking() = 0;
 
     ///@brief Removes a previously enqueued response message from the queue. In case no message is available, the accessing thread blocks until a message is available
     virtual Message retrieveResponseMessage() = 0;
 
-    ///@brief Shall add a response message to the message queue. Exclusive access to the queue must be ensured
-    virtual void enqueueResponseMessage(const Message &message) = 0;
+    ///@brief Shall add a response message to the message queue. Exclusive access to the queue must be ensured.
+    ///       If a response router is registered the message must be handed to it instead
+    virtual void enqueueResponseMessage(Message &&message) = 0;
+
+    ///@brief Registers the router which delivers responses straight to their connection. nullptr restores queueing
+    virtual void setResponseRouter(ResponseRouter *router) = 0;
+
+    ///@brief Shall limit the number of received messages waiting in the queue, 0 removes the limit. Under SHED the
+    ///       messages beyond the capacity are refused, under BACKPRESSURE they are taken and the reactors stop reading.
+    ///       Must be called before the queue is used
+    virtual void setCapacity(std::size_t capacity, OverloadPolicy policy) = 0;
+
+    ///@brief Capacity set by setCapacity(), 0 if the queue is unbounded
+    [[nodiscard]] virtual std::size_t getCapacity() const = 0;
+
+    [[nodiscard]] virtual OverloadPolicy getOverloadPolicy() const = 0;
+
+    ///@brief Number of received messages waiting for a handler. May be outdated by the time it is used
+    [[nodiscard]] virtual std::size_t getNumberReceivedMessages() const = 0;
 
     ///@brief performs the shutdown procedure. All blocking synchronisation primitives must be signaled
     virtual void shutdown() = 0;
@@ -65,18 +195,42 @@ namespace network::tcp
     std::condition_variable respond_queue_cv_;
     std::queue<container::message_queue::Message> respond_queue_;
 
+    std::atomic<container::message_queue::ResponseRouter*> response_router_{nullptr};
+
+    // written with the received queue mutex held, read without it
+    std::atomic<std::size_t> received_size_{0};
+    std::size_t capacity_{0};
+    container::message_queue::OverloadPolicy policy_{container::message_queue::OverloadPolicy::BACKPRESSURE};
+
     std::mutex shutdown_mutex_;
     bool shutdown_{false};
+
+    [[nodiscard]] std::size_t getFreeCapacity(std::size_t count) const;
   public:
-    void enqueueReceivedMessage(const container::message_queue::Message &message) override;
+    bool enqueueReceivedMessage(container::message_queue::Message &&message) override;
 
     container::message_queue::Message retrieveReceivedMessage() override;
 
+    std::size_t enqueueReceivedMessages(container::message_queue::Message *messages, std::size_t count) override;
+
+    std::size_t retrieveReceivedMessages(std::vector<container::message_queue::Message> &messages, std::size_t max_messages) override;
+
     std::optional<container::message_queue::Message> retrieveResponseMessageNonBlocking() override;
 
     container::message_queue::Message retrieveResponseMessage() override;
 
-    void enqueueResponseMessage(const container::message_queue::Message &message) override;
+    void enqueueResponseMessage(container::message_queue::Message &&message) override;
+
+    void setResponseRouter(container::message_queue::ResponseRouter *router) override;
+
+    void setCapacity(std::size_t capacity, container::message_queue::OverloadPolicy policy) override;
+
+    [[nodiscard]] std::size_t getCapacity() const override { return capacity_; }
+
+    [[nodiscard]] container::message_queue::OverloadPolicy getOverloadPolicy() const override { return policy_; }
+
+    [[nodiscard]] std::size_t getNumberReceivedMessages() const override
+    { return received_size_.load(std::memory_order_relaxed); }
 
     void shutdown() override;
   };
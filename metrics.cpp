@@ -0,0 +1,243 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "metrics.hpp"
+#include "error.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace metrics
+{
+  namespace
+  {
+    void appendHeader(std::string &out, const std::string &name, const std::string &help, const std::string_view type)
+    {
+      fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+    }
+
+    void appendHistogram(std::string &out, const std::string &name, const Histogram::Snapshot &snapshot, const double scale)
+    {
+      // counts never decrease, so the exported range of buckets only ever grows between scrapes
+      const auto first = std::find_if(snapshot.counts.begin(), snapshot.counts.end(), [](uint64_t count) { return count != 0; });
+      const auto last = std::find_if(snapshot.counts.rbegin(), snapshot.counts.rend(), [](uint64_t count) { return count != 0; });
+      if (first != snapshot.counts.end())
+      {
+        uint64_t cumulative{0};
+        const auto end = static_cast<std::size_t>(snapshot.counts.rend() - last);
+        for (auto bucket = static_cast<std::size_t>(first - snapshot.counts.begin()); bucket < end; ++bucket)
+        {
+          cumulative += snapshot.counts[bucket];
+          fmt::format_to(std::back_inserter(out), "{}_bucket{{le=\"{}\"}} {}\n", name,
+                         static_cast<double>(Histogram::getUpperBound(bucket)) * scale, cumulative);
+        }
+      }
+      fmt::format_to(std::back_inserter(out), "{}_bucket{{le=\"+Inf\"}} {}\n{}_sum {}\n{}_count {}\n", name, snapshot.count,
+                     name, static_cast<double>(snapshot.sum) * scale, name, snapshot.count);
+    }
+  }
+
+  /// @class Counter
+  /// @name value
+  /// @brief Sums all shards. Adds running concurrently may or may not be included
+  /// @throws None
+  uint64_t Counter::value() const
+  {
+    uint64_t value{0};
+    for (const Shard &shard : shards_)
+      value += shard.value.load(std::memory_order_relaxed);
+    return value;
+  }
+
+  /// @class Gauge
+  /// @name value
+  /// @brief Sums all shards. Changes running concurrently may or may not be included
+  /// @throws None
+  int64_t Gauge::value() const
+  {
+    int64_t value{0};
+    for (const Shard &shard : shards_)
+      value += shard.value.load(std::memory_order_relaxed);
+    return value;
+  }
+
+  /// @class Histogram
+  /// @name Histogram
+  /// @brief constructor. The shards are allocated separately, together they take about 32 KiB
+  /// @throws None
+  Histogram::Histogram() : shards_(std::make_unique<std::array<Shard, NUMBER_SHARDS>>())
+  {}
+
+  /// @class Histogram
+  /// @name getUpperBound
+  /// @brief Largest value falling into a bucket
+  /// @param[in] bucket : index returned by getBucket()
+  /// @throws None
+  uint64_t Histogram::getUpperBound(const std::size_t bucket)
+  {
+    if (bucket < SUB_BUCKETS)
+      return bucket;
+
+    const auto shift = static_cast<unsigned>(bucket / SUB_BUCKETS - 1);
+    const uint64_t mantissa = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    // the last bucket ends at 2^64, the unsigned wrap-around yields its maximum
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  /// @class Histogram
+  /// @name snapshot
+  /// @brief Merges all shards. Observations running concurrently may or may not be included
+  /// @throws None
+  Histogram::Snapshot Histogram::snapshot() const
+  {
+    Snapshot snapshot;
+    for (const Shard &shard : *shards_)
+    {
+      for (std::size_t bucket = 0; bucket < NUMBER_BUCKETS; ++bucket)
+        snapshot.counts[bucket] += shard.counts[bucket].load(std::memory_order_relaxed);
+      snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+
+    for (const uint64_t count : snapshot.counts)
+      snapshot.count += count;
+    return snapshot;
+  }
+
+  /// @class Registry
+  /// @name getInstance
+  /// @brief returns the process wide registry
+  /// @throws None
+  Registry& Registry::getInstance()
+  {
+    static Registry instance;
+    return instance;
+  }
+
+  /// @class Registry
+  /// @name add
+  /// @brief Adds a metric without value. Must be called with the mutex held
+  /// @throws logging::Error if the name is taken
+  Registry::Metric& Registry::add(std::string name, std::string help)
+  {
+    const auto it = std::find_if(metrics_.begin(), metrics_.end(), [&name](const auto &metric) { return metric->name == name; });
+    if (it != metrics_.end())
+    {
+      throw logging::Error(LOC, fmt::format("Metric {} registered twice", name));
+    }
+
+    auto &metric = metrics_.emplace_back(std::make_unique<Metric>());
+    metric->name = std::move(name);
+    metric->help = std::move(help);
+    return *metric;
+  }
+
+  /// @class Registry
+  /// @name addCounter
+  /// @brief Creates a counter
+  /// @param[in] name : metric name, should end in _total
+  /// @param[in] help : description
+  /// @throws logging::Error if the name is taken
+  Counter& Registry::addCounter(std::string name, std::string help)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Metric &metric = add(std::move(name), std::move(help));
+    metric.counter = std::make_unique<Counter>();
+    return *metric.counter;
+  }
+
+  /// @class Registry
+  /// @name addGauge
+  /// @brief Creates a gauge
+  /// @param[in] name : metric name
+  /// @param[in] help : description
+  /// @throws logging::Error if the name is taken
+  Gauge& Registry::addGauge(std::string name, std::string help)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Metric &metric = add(std::move(name), std::move(help));
+    metric.gauge = std::make_unique<Gauge>();
+    return *metric.gauge;
+  }
+
+  /// @class Registry
+  /// @name addHistogram
+  /// @brief Creates a histogram
+  /// @param[in] name : metric name, the suffixes _bucket, _sum and _count are added on export
+  /// @param[in] help : description
+  /// @param[in] scale : factor applied to bucket bounds and sum on export
+  /// @throws logging::Error if the name is taken
+  Histogram& Registry::addHistogram(std::string name, std::string help, const double scale)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Metric &metric = add(std::move(name), std::move(help));
+    metric.histogram = std::make_unique<Histogram>();
+    metric.histogram_scale = scale;
+    return *metric.histogram;
+  }
+
+  /// @class Registry
+  /// @name addCallback
+  /// @brief Exports a value owned elsewhere. The callback is invoked on every scrape
+  /// @param[in] name : metric name
+  /// @param[in] help : description
+  /// @param[in] type : counter or gauge
+  /// @param[in] callback : returns the current value, must stay valid until removeCallback()
+  /// @throws logging::Error if the name is taken
+  void Registry::addCallback(std::string name, std::string help, const Type type, std::function<double()> callback)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Metric &metric = add(std::move(name), std::move(help));
+    metric.callback_type = type;
+    metric.callback = std::move(callback);
+  }
+
+  /// @class Registry
+  /// @name removeCallback
+  /// @brief Removes a metric added with addCallback(), e.g. before the object it reads is destroyed
+  /// @param[in] name : metric name
+  /// @throws None
+  void Registry::removeCallback(const std::string &name)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    metrics_.erase(std::remove_if(metrics_.begin(), metrics_.end(), [&name](const auto &metric) {
+      return metric->callback && metric->name == name;
+    }), metrics_.end());
+  }
+
+  /// @class Registry
+  /// @name scrape
+  /// @brief Writes all metrics in the Prometheus text exposition format 0.0.4
+  /// @throws None
+  std::string Registry::scrape() const
+  {
+    std::string out;
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (const auto &metric : metrics_)
+    {
+      if (metric->counter)
+      {
+        appendHeader(out, metric->name, metric->help, "counter");
+        fmt::format_to(std::back_inserter(out), "{} {}\n", metric->name, metric->counter->value());
+      }
+      else if (metric->gauge)
+      {
+        appendHeader(out, metric->name, metric->help, "gauge");
+        fmt::format_to(std::back_inserter(out), "{} {}\n", metric->name, metric->gauge->value());
+      }
+      else if (metric->histogram)
+      {
+        appendHeader(out, metric->name, metric->help, "histogram");
+        appendHistogram(out, metric->name, metric->histogram->snapshot(), metric->histogram_scale);
+      }
+      else
+      {
+        appendHeader(out, metric->name, metric->help, metric->callback_type == Type::COUNTER ? "counter" : "gauge");
+        fmt::format_to(std::back_inserter(out), "{} {}\n", metric->name, metric->callback());
+      }
+    }
+    return out;
+  }
+}
@@ -0,0 +1,188 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_METRICS_HPP
+#define WEBSERVER_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace metrics
+{
+  static constexpr std::size_t CACHE_LINE_SIZE{64};
+
+  ///@brief Number of shards of every metric. Threads are spread over them round-robin on first use, so threads on
+  ///       different cores rarely write the same cache line
+  static constexpr std::size_t NUMBER_SHARDS{16};
+
+  ///@brief Shard of the calling thread
+  inline std::size_t getShardIndex()
+  {
+    static std::atomic<std::size_t> next_shard{0};
+    static thread_local const std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % NUMBER_SHARDS;
+    return shard;
+  }
+
+  ///@brief Monotonic counter. Recording is one relaxed add on the shard of the calling thread, reading sums all shards
+  class Counter
+  {
+  private:
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+      std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, NUMBER_SHARDS> shards_;
+
+  public:
+    void add(uint64_t value = 1)
+    {
+      shards_[getShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t value() const;
+  };
+
+  ///@brief Value that goes up and down, e.g. the number of open connections. Increments and decrements may happen on
+  ///       different threads, each shard holds a partial sum
+  class Gauge
+  {
+  private:
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+      std::atomic<int64_t> value{0};
+    };
+
+    std::array<Shard, NUMBER_SHARDS> shards_;
+
+  public:
+    void add(int64_t value = 1)
+    {
+      shards_[getShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void sub(int64_t value = 1)
+    {
+      add(-value);
+    }
+
+    [[nodiscard]] int64_t value() const;
+  };
+
+  ///@brief Log-linear histogram of non-negative integers, e.g. durations in nanoseconds. Every power of two is split
+  ///       into SUB_BUCKETS equal buckets, so a bucket is at most 25% wide relative to its values over the whole range
+  ///       of uint64_t. Recording is two relaxed adds on the shard of the calling thread
+  class Histogram
+  {
+  public:
+    static constexpr unsigned SUB_BUCKET_BITS{2};
+    static constexpr uint64_t SUB_BUCKETS{uint64_t{1} << SUB_BUCKET_BITS};
+    static constexpr std::size_t NUMBER_BUCKETS{(64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS};
+
+    ///@brief Bucket counts and sum merged over all shards
+    struct Snapshot
+    {
+      std::array<uint64_t, NUMBER_BUCKETS> counts{};
+      uint64_t count{0};
+      uint64_t sum{0};
+    };
+
+  private:
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+      std::array<std::atomic<uint64_t>, NUMBER_BUCKETS> counts{};
+      std::atomic<uint64_t> sum{0};
+    };
+
+    std::unique_ptr<std::array<Shard, NUMBER_SHARDS>> shards_;
+
+  public:
+    Histogram();
+
+    static std::size_t getBucket(uint64_t value)
+    {
+      if (value < SUB_BUCKETS)
+        return static_cast<std::size_t>(value);
+
+      const unsigned exponent = 63U - static_cast<unsigned>(__builtin_clzll(value));
+      const unsigned shift = exponent - SUB_BUCKET_BITS;
+      return static_cast<std::size_t>((shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS);
+    }
+
+    ///@brief Largest value falling into a bucket
+    static uint64_t getUpperBound(std::size_t bucket);
+
+    void observe(uint64_t value)
+    {
+      Shard &shard = (*shards_)[getShardIndex()];
+      shard.counts[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+      shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Snapshot snapshot() const;
+  };
+
+  ///@brief Process wide set of metrics, written in the Prometheus text format on scrape. Metrics are created once,
+  ///       usually during static initialisation of the module recording them, and live as long as the process
+  class Registry
+  {
+  public:
+    enum class Type
+    {
+      COUNTER,
+      GAUGE,
+    };
+
+  private:
+    struct Metric
+    {
+      std::string name;
+      std::string help;
+      std::unique_ptr<Counter> counter;
+      std::unique_ptr<Gauge> gauge;
+      std::unique_ptr<Histogram> histogram;
+      double histogram_scale{1.0};
+      Type callback_type{Type::GAUGE};
+      std::function<double()> callback;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Metric>> metrics_;
+
+    Registry() = default;
+
+    Metric& add(std::string name, std::string help);
+
+  public:
+    static Registry& getInstance();
+
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    Counter& addCounter(std::string name, std::string help);
+
+    Gauge& addGauge(std::string name, std::string help);
+
+    ///@param scale : factor applied to the recorded values on export, e.g. 1e-9 for nanoseconds exported as seconds
+    Histogram& addHistogram(std::string name, std::string help, double scale = 1.0);
+
+    ///@brief Exports a value owned elsewhere, e.g. statistics a component keeps anyway. The callback is invoked on
+    ///       every scrape and must stay valid until it is removed
+    void addCallback(std::string name, std::string help, Type type, std::function<double()> callback);
+
+    void removeCallback(const std::string& name);
+
+    ///@brief All metrics in the Prometheus text exposition format 0.0.4
+    [[nodiscard]] std::string scrape() const;
+  };
+}
+
+#endif //WEBSERVER_METRICS_HPP
@@ -0,0 +1,122 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "metrics.hpp"
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+  using metrics::Histogram;
+
+  std::size_t failures{0};
+
+  void expect(const bool condition, const std::string &check)
+  {
+    if (!condition && ++failures <= 20)
+      std::cerr << check << std::endl;
+  }
+
+  ///@brief Every value up to a few thousand plus the neighbourhood of every power of two and of every bucket bound
+  std::vector<uint64_t> getValues()
+  {
+    std::vector<uint64_t> values;
+    for (uint64_t value = 0; value <= 4096; ++value)
+      values.push_back(value);
+    for (unsigned bit = 0; bit < 64; ++bit)
+    {
+      const uint64_t power = uint64_t{1} << bit;
+      for (const uint64_t value : {power - 1, power, power + 1, power + power / 2, power + power / 4})
+        values.push_back(value);
+    }
+    for (std::size_t bucket = 0; bucket < Histogram::NUMBER_BUCKETS; ++bucket)
+    {
+      const uint64_t bound = Histogram::getUpperBound(bucket);
+      values.push_back(bound);
+      values.push_back(bound - 1);
+      values.push_back(bound + 1);
+    }
+    values.push_back(std::numeric_limits<uint64_t>::max());
+    return values;
+  }
+
+  void checkBuckets()
+  {
+    const std::vector<uint64_t> values = getValues();
+    for (const uint64_t value : values)
+    {
+      const std::size_t bucket = Histogram::getBucket(value);
+      if (bucket >= Histogram::NUMBER_BUCKETS)
+      {
+        expect(false, fmt::format("value {}: bucket {} out of range", value, bucket));
+        continue;
+      }
+
+      // the bucket is the one whose bounds enclose the value
+      expect(value <= Histogram::getUpperBound(bucket), fmt::format("value {} above the bound of its bucket {}", value, bucket));
+      expect(bucket == 0 || value > Histogram::getUpperBound(bucket - 1),
+             fmt::format("value {} not above the bound of the bucket before {}", value, bucket));
+    }
+
+    uint64_t previous_bound{0};
+    for (std::size_t bucket = 0; bucket < Histogram::NUMBER_BUCKETS; ++bucket)
+    {
+      const uint64_t bound = Histogram::getUpperBound(bucket);
+      expect(Histogram::getBucket(bound) == bucket, fmt::format("bound {} of bucket {} falls into {}", bound, bucket, Histogram::getBucket(bound)));
+      expect(bucket == 0 || bound > previous_bound, fmt::format("bound of bucket {} not increasing", bucket));
+
+      // a bucket is at most a quarter as wide as its smallest value
+      const uint64_t lowest = bucket == 0 ? 0 : previous_bound + 1;
+      expect(bucket < Histogram::SUB_BUCKETS || bound - lowest + 1 <= lowest / 4 + 1,
+             fmt::format("bucket {} [{}, {}] wider than 25%", bucket, lowest, bound));
+      previous_bound = bound;
+    }
+    expect(Histogram::getUpperBound(Histogram::NUMBER_BUCKETS - 1) == std::numeric_limits<uint64_t>::max(), "last bucket does not end at the maximum");
+  }
+
+  void checkScrape()
+  {
+    Histogram& histogram = metrics::Registry::getInstance().addHistogram("test_values", "Values observed by the test");
+    for (const uint64_t value : {1, 5, 5, 100})
+      histogram.observe(value);
+
+    const Histogram::Snapshot snapshot = histogram.snapshot();
+    expect(snapshot.count == 4 && snapshot.sum == 111, fmt::format("snapshot: count {} sum {}", snapshot.count, snapshot.sum));
+
+    const std::string scrape = metrics::Registry::getInstance().scrape();
+    const auto contains = [&scrape](const std::string &line) { return scrape.find(line) != std::string::npos; };
+    expect(contains("# TYPE test_values histogram\n"), "histogram type missing");
+
+    // cumulative counts from the first to the last bucket holding a value: 100 falls into [96, 111]
+    expect(!contains("test_values_bucket{le=\"0\"}"), "empty bucket before the first value exported");
+    expect(contains("test_values_bucket{le=\"1\"} 1\n"), "bucket of 1 missing");
+    expect(contains("test_values_bucket{le=\"4\"} 1\n"), "empty bucket between values missing");
+    expect(contains("test_values_bucket{le=\"5\"} 3\n"), "bucket of 5 missing");
+    expect(contains("test_values_bucket{le=\"95\"} 3\n"), "bucket below 100 missing");
+    expect(contains("test_values_bucket{le=\"111\"} 4\n"), "bucket of 100 missing");
+    expect(!contains("test_values_bucket{le=\"127\"}"), "empty bucket behind the last value exported");
+    expect(contains("test_values_bucket{le=\"+Inf\"} 4\ntest_values_sum 111\ntest_values_count 4\n"), "totals missing");
+  }
+}
+
+// Checks the bucket layout of the histogram over the whole range of uint64_t and its export
+int main()
+{
+  checkBuckets();
+  checkScrape();
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,97 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_REACTOR_HPP
+#define WEBSERVER_REACTOR_HPP
+
+#include "buffer.hpp"
+#include "socketfiledescriptor.hpp"
+#include "messagequeue.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <chrono>
+#include <functional>
+
+namespace network::tcp
+{
+  ///@brief I/O mechanism used to drive the connections of a Socket
+  enum class IoBackend
+  {
+    EPOLL,    ///< readiness based, edge-triggered epoll with non-blocking sockets
+    IO_URING, ///< completion based io_uring with multishot accept/recv and provided buffers
+  };
+
+  ///@brief How incoming connections are accepted
+  enum class ListenMode
+  {
+    SINGLE_LISTENER, ///< one listening socket; the first reactor accepts and spreads connections over all reactors
+    REUSEPORT_SHARDS, ///< one SO_REUSEPORT listening socket per reactor, pinned to a CPU; connections stay on the accepting reactor
+  };
+
+  constexpr int NO_CPU_AFFINITY{-1};
+
+  ///@brief Reactors which stopped reading because the message queue was full check this often whether it drained
+  constexpr std::chrono::milliseconds BACKPRESSURE_CHECK_INTERVAL{1};
+
+  ///@brief True if the reactors shall stop reading: the queue applies backpressure and holds its capacity
+  inline bool isQueueFull(const container::message_queue::Queue& queue)
+  {
+    return queue.getCapacity() != 0 && queue.getOverloadPolicy() == container::message_queue::OverloadPolicy::BACKPRESSURE &&
+           queue.getNumberReceivedMessages() >= queue.getCapacity();
+  }
+
+  ///@brief True once a full queue drained to half its capacity, so reading does not flap around the limit
+  inline bool hasQueueDrained(const container::message_queue::Queue& queue)
+  {
+    return queue.getNumberReceivedMessages() <= queue.getCapacity() / 2;
+  }
+
+  ///@brief Pins the calling thread to the given CPU. Returns false if the affinity could not be set
+  inline bool pinCurrentThreadToCpu(int cpu)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+  }
+
+///@interface Reactor
+  class Reactor
+  {
+  public:
+    using AcceptHandler = std::function<void(SocketFileDescriptor)>;
+
+    virtual ~Reactor() = default;
+
+    ///@brief Shall start accepting connections on the given listening socket. The handler gets called on the reactor thread for every accepted connection
+    virtual void watchListeningSocket(int listen_fd, AcceptHandler handler) = 0;
+
+    ///@brief Hands an accepted connection over to the reactor. Must be callable from any thread
+    virtual void addConnection(SocketFileDescriptor socket) = 0;
+
+    ///@brief Registers a connection the reactor accepted itself, without posting it through the task queue. Must only be
+    ///       called on the reactor thread, i.e. from its accept handler
+    virtual void adoptConnection(SocketFileDescriptor socket) = 0;
+
+    ///@brief Hands over the response to the request with the given sequence number. The segments are written with
+    ///       gathering sends without joining them, the file region behind them without copying it through user space.
+    ///       Responses are sent in request order, an empty response closes the connection after the responses before
+    ///       it. Must be callable from any thread
+    virtual void sendResponse(container::message_queue::ConnectionHandle connection, uint64_t sequence, container::buffer::BufferSegments response,
+                              container::buffer::FileRegion file) = 0;
+
+    ///@brief Shall pin the reactor thread to the given CPU once started. NO_CPU_AFFINITY disables pinning
+    virtual void setCpuAffinity(int cpu) = 0;
+
+    ///@brief Starts the reactor thread
+    virtual void start() = 0;
+
+    ///@brief Stops and joins the reactor thread. Must be idempotent
+    virtual void stop() = 0;
+  };
+}
+
+#endif //WEBSERVER_REACTOR_HPP
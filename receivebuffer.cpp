@@ -0,0 +1,86 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "receivebuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace container::buffer
+{
+  /// @class ReceiveBuffer
+  /// @name isExclusive
+  /// @brief Checks that no slice refers to the buffer anymore, so its memory may be overwritten
+  /// @throws None
+  bool ReceiveBuffer::isExclusive() const
+  {
+    if (buffer_.use_count() != 1)
+      return false;
+
+    // the last slice may have been released on another thread; its reads must be complete before we write
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+  }
+
+  /// @class ReceiveBuffer
+  /// @name prepare
+  /// @brief Makes room for at least minimum more bytes: reuses the buffer once all slices are gone, moves pending
+  ///        bytes to the front or switches to a buffer of a larger size class
+  /// @param[in] minimum : number of bytes which must fit behind the pending bytes
+  /// @returns false if the pending bytes plus minimum exceed MAX_SIZE
+  /// @throws logging::SystemError
+  bool ReceiveBuffer::prepare(const std::size_t minimum)
+  {
+    if (buffer_ && buffer_->available() >= minimum)
+      return true;
+
+    const std::string_view bytes = pending();
+    const std::size_t required = bytes.size() + minimum;
+    if (required > MAX_SIZE)
+      return false;
+
+    if (buffer_ && isExclusive() && buffer_->capacity() >= required)
+    {
+      std::memmove(buffer_->data(), bytes.data(), bytes.size());
+      buffer_->clear();
+      buffer_->commit(bytes.size());
+      consumed_ = 0;
+      return true;
+    }
+
+    // start small again once a large request was handed out
+    std::shared_ptr<Buffer> buffer = BufferPool::getInstance().acquire(std::max(required, INITIAL_SIZE));
+    std::memcpy(buffer->writePosition(), bytes.data(), bytes.size());
+    buffer->commit(bytes.size());
+
+    buffer_ = std::move(buffer);
+    consumed_ = 0;
+    return true;
+  }
+
+  /// @class ReceiveBuffer
+  /// @name pending
+  /// @brief Received bytes which were not handed out yet
+  /// @throws None
+  std::string_view ReceiveBuffer::pending() const
+  {
+    if (!buffer_)
+      return {};
+
+    return {buffer_->data() + consumed_, buffer_->size() - consumed_};
+  }
+
+  /// @class ReceiveBuffer
+  /// @name consume
+  /// @brief Hands the first bytes of pending() out as a slice sharing the buffer
+  /// @param[in] bytes : number of bytes, at most pending().size()
+  /// @throws None
+  BufferSlice ReceiveBuffer::consume(const std::size_t bytes)
+  {
+    const BufferSlice slice{buffer_, pending().substr(0, bytes)};
+    consumed_ += slice.size();
+    return slice;
+  }
+}
@@ -0,0 +1,54 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_RECEIVEBUFFER_HPP
+#define WEBSERVER_RECEIVEBUFFER_HPP
+
+#include "buffer.hpp"
+#include "bufferpool.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace container::buffer
+{
+  ///@brief Growable receive buffer of one connection, backed by the BufferPool. Bytes are appended at the end and
+  ///       handed out from the front as slices sharing the buffer. Bytes which were not handed out yet (e.g. the
+  ///       first part of a request) always stay contiguous; the buffer grows by size class to make room for the rest
+  class ReceiveBuffer
+  {
+  public:
+    static constexpr std::size_t INITIAL_SIZE{BufferPool::SIZE_CLASSES.front()};
+    static constexpr std::size_t MAX_SIZE{BufferPool::SIZE_CLASSES.back()};
+
+  private:
+    std::shared_ptr<Buffer> buffer_;
+    std::size_t consumed_{0};
+
+    [[nodiscard]] bool isExclusive() const;
+
+  public:
+    ///@brief Makes room for at least minimum more bytes. Returns false if the pending bytes plus minimum would
+    ///       exceed MAX_SIZE, in that case nothing is changed
+    bool prepare(std::size_t minimum = 1);
+
+    [[nodiscard]] char* writePosition() { return buffer_->writePosition(); }
+    [[nodiscard]] std::size_t writable() const { return buffer_ ? buffer_->available() : 0; }
+
+    ///@brief Marks bytes written to writePosition() as received
+    void commit(std::size_t bytes) { buffer_->commit(bytes); }
+
+    ///@brief Received bytes which were not handed out yet
+    [[nodiscard]] std::string_view pending() const;
+
+    ///@brief Hands the first bytes of pending() out as a slice sharing the buffer
+    BufferSlice consume(std::size_t bytes);
+
+    ///@brief Drops the first bytes of pending() without handing them out
+    void discard(std::size_t bytes) { consumed_ += bytes; }
+  };
+}
+
+#endif //WEBSERVER_RECEIVEBUFFER_HPP
@@ -0,0 +1,180 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "responsecache.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+
+#include <functional>
+
+namespace network::http
+{
+  /// @class ResponseCache
+  /// @name ResponseCache
+  /// @brief constructor
+  /// @param[in] capacity : byte budget of all shards together
+  /// @param[in] ttl : time an entry is served before it has to be computed again
+  /// @param[in] number_shards : number of independently locked shards
+  /// @throws logging::Error
+  ResponseCache::ResponseCache(const std::size_t capacity, const std::chrono::milliseconds ttl, const std::size_t number_shards) :
+    shard_capacity_(number_shards == 0 ? 0 : capacity / number_shards), ttl_(ttl), number_shards_(number_shards)
+  {
+    const logging::Trace trace(__func__);
+    if (number_shards_ == 0 || shard_capacity_ == 0)
+    {
+      throw logging::Error(LOC, fmt::format("Invalid response cache size: {} bytes in {} shards", capacity, number_shards));
+    }
+    shards_ = std::make_unique<Shard[]>(number_shards_);
+  }
+
+  /// @class ResponseCache
+  /// @name makeKey
+  /// @brief Builds the key of a request. The Connection header of the response depends on the version and the
+  ///        keep-alive decision, so both are part of the key
+  /// @param[in] request : parsed request
+  /// @returns key, nothing if the request must not be answered from the cache
+  /// @throws None
+  std::optional<std::string> ResponseCache::makeKey(const Request &request)
+  {
+    const std::string_view method = request.getMethod();
+    if (method != "GET" && method != "HEAD")
+      return std::nullopt;
+
+    if (!request.getBody().empty() || request.getHeader("Authorization") || request.getHeader("Cookie"))
+      return std::nullopt;
+
+    const std::string_view host = request.getHeader("Host").value_or(std::string_view{});
+    std::string key;
+    key.reserve(method.size() + host.size() + request.getTarget().size() + 5);
+    key.append(method).push_back(' ');
+    key.append(host).push_back(' ');
+    key.append(request.getTarget()).push_back(' ');
+    key.push_back(static_cast<char>('0' + request.getMinorVersion()));
+    key.push_back(request.isKeepAlive() ? 'k' : 'c');
+    return key;
+  }
+
+  /// @class ResponseCache
+  /// @name isCacheable
+  /// @brief Checks the status line, which is always the first segment of a response
+  /// @param[in] response : response created by a handler
+  /// @returns true for 200 responses
+  /// @throws None
+  bool ResponseCache::isCacheable(const tcp::OutboundResponse &response)
+  {
+    constexpr std::string_view STATUS_OK{"HTTP/1.1 200 "};
+    return !response.segments.empty() && response.segments.front().view().substr(0, STATUS_OK.size()) == STATUS_OK;
+  }
+
+  /// @class ResponseCache
+  /// @name getShard
+  /// @brief Shard responsible for a key
+  /// @throws None
+  ResponseCache::Shard& ResponseCache::getShard(const std::string_view key) const
+  {
+    return shards_[std::hash<std::string_view>{}(key) % number_shards_];
+  }
+
+  /// @class ResponseCache
+  /// @name erase
+  /// @brief Removes an entry, the shard must be locked
+  /// @throws None
+  void ResponseCache::erase(Shard &shard, const std::list<Entry>::iterator entry)
+  {
+    shard.bytes -= entry->size;
+    shard.index.erase(entry->key);
+    shard.entries.erase(entry);
+  }
+
+  /// @class ResponseCache
+  /// @name lookup
+  /// @brief Looks a response up and marks it as most recently used. Expired entries are dropped on the way
+  /// @param[in] key : key created by makeKey()
+  /// @returns shared segments and file region of the response, nothing on a miss
+  /// @throws None
+  std::optional<tcp::OutboundResponse> ResponseCache::lookup(const std::string &key)
+  {
+    Shard& shard = getShard(key);
+    const auto now = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      const auto it = shard.index.find(key);
+      if (it != shard.index.end())
+      {
+        if (it->second->expires > now)
+        {
+          shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+          hits_.fetch_add(1, std::memory_order_relaxed);
+          return it->second->response;
+        }
+
+        erase(shard, it->second);
+        expirations_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+
+  /// @class ResponseCache
+  /// @name store
+  /// @brief Stores a response for the time to live
+  /// @param[in] key : key created by makeKey()
+  /// @param[in] response : response to share, its slices are referenced and not copied
+  /// @throws None
+  void ResponseCache::store(std::string key, tcp::OutboundResponse response)
+  {
+    std::size_t size = ENTRY_OVERHEAD + key.size();
+    for (const auto& segment : response.segments)
+    {
+      size += segment.size();
+    }
+
+    if (size > shard_capacity_)
+      return;
+
+    Shard& shard = getShard(key);
+    const auto expires = std::chrono::steady_clock::now() + ttl_;
+
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end())
+      erase(shard, it->second);
+
+    while (shard.bytes + size > shard_capacity_)
+    {
+      erase(shard, std::prev(shard.entries.end()));
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.entries.push_front({std::move(key), std::move(response), size, expires});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.bytes += size;
+    insertions_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// @class ResponseCache
+  /// @name getStatistics
+  /// @brief Reads the counters and sums up the shards. The shards are locked one after the other, so the sums are
+  ///        not an atomic snapshot
+  /// @throws None
+  ResponseCache::Statistics ResponseCache::getStatistics() const
+  {
+    Statistics statistics;
+    statistics.hits = hits_.load(std::memory_order_relaxed);
+    statistics.misses = misses_.load(std::memory_order_relaxed);
+    statistics.insertions = insertions_.load(std::memory_order_relaxed);
+    statistics.evictions = evictions_.load(std::memory_order_relaxed);
+    statistics.expirations = expirations_.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < number_shards_; ++i)
+    {
+      std::lock_guard<std::mutex> guard(shards_[i].mutex);
+      statistics.entries += shards_[i].entries.size();
+      statistics.bytes += shards_[i].bytes;
+    }
+    return statistics;
+  }
+}
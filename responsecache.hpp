@@ -0,0 +1,112 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_RESPONSECACHE_HPP
+#define WEBSERVER_RESPONSECACHE_HPP
+
+#include "buffer.hpp"
+#include "httprequest.hpp"
+#include "responsesequencer.hpp"
+#include "ringbuffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace network::http
+{
+  ///@brief In-memory cache of complete responses to GET and HEAD requests. The keys are split over shards by their
+  ///       hash, every shard has its own lock, LRU list and share of the byte budget, so concurrent lookups rarely
+  ///       contend. Entries expire after a fixed time to live. The cached segments are shared slices: a hit hands out
+  ///       references to them, the bytes are never copied. Thread safe
+  class ResponseCache
+  {
+  public:
+    static constexpr std::size_t DEFAULT_CAPACITY{64 * 1024 * 1024};
+    static constexpr std::chrono::milliseconds DEFAULT_TTL{5000};
+    static constexpr std::size_t DEFAULT_NUMBER_SHARDS{16};
+
+    ///@brief Bookkeeping overhead charged per entry in addition to its key and segment bytes
+    static constexpr std::size_t ENTRY_OVERHEAD{128};
+
+    ///@brief Snapshot of the counters, e.g. to size the cache
+    struct Statistics
+    {
+      uint64_t hits{0};
+      uint64_t misses{0};
+      uint64_t insertions{0};
+      uint64_t evictions{0};
+      uint64_t expirations{0};
+      std::size_t entries{0};
+      std::size_t bytes{0};
+    };
+
+  private:
+    struct Entry
+    {
+      std::string key;
+      tcp::OutboundResponse response;
+      std::size_t size;
+      std::chrono::steady_clock::time_point expires;
+    };
+
+    struct alignas(container::CACHE_LINE_SIZE) Shard
+    {
+      std::mutex mutex;
+      std::list<Entry> entries;   // most recently used first
+      std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+      std::size_t bytes{0};
+    };
+
+    const std::size_t shard_capacity_;
+    const std::chrono::steady_clock::duration ttl_;
+    const std::size_t number_shards_;
+    std::unique_ptr<Shard[]> shards_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> insertions_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> expirations_{0};
+
+    [[nodiscard]] Shard& getShard(std::string_view key) const;
+    static void erase(Shard& shard, std::list<Entry>::iterator entry);
+
+  public:
+    ///@param capacity : byte budget of all shards together
+    ///@param ttl : time an entry is served before it has to be computed again
+    ///@param number_shards : number of independently locked shards
+    explicit ResponseCache(std::size_t capacity = DEFAULT_CAPACITY, std::chrono::milliseconds ttl = DEFAULT_TTL,
+                           std::size_t number_shards = DEFAULT_NUMBER_SHARDS);
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    ///@brief Key identifying all requests with the same response: method, host, target and the connection
+    ///       disposition announced in the response. Nothing for requests which must not be answered from the cache,
+    ///       i.e. other methods, requests with a body or with credentials
+    static std::optional<std::string> makeKey(const Request& request);
+
+    ///@brief Whether a response may be stored: only complete 200 responses are
+    static bool isCacheable(const tcp::OutboundResponse& response);
+
+    ///@brief Response stored for key unless it expired. Counts a hit or a miss
+    [[nodiscard]] std::optional<tcp::OutboundResponse> lookup(const std::string& key);
+
+    ///@brief Stores a response, replacing an earlier one for the same key. Evicts the least recently used entries of the
+    ///       shard until it fits; responses larger than a shard are not stored
+    void store(std::string key, tcp::OutboundResponse response);
+
+    [[nodiscard]] Statistics getStatistics() const;
+  };
+}
+
+#endif //WEBSERVER_RESPONSECACHE_HPP
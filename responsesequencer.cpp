@@ -0,0 +1,53 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "responsesequencer.hpp"
+
+namespace network::tcp
+{
+  /// @class ResponseSequencer
+  /// @name release
+  /// @brief Hands over the response to a request. Responses which complete before their predecessors are parked until
+  ///        the gap is closed, then everything in order is appended to the outbound queue
+  /// @param[in] sequence : sequence number assigned by admit()
+  /// @param[in] response : complete response, empty to close the connection instead of answering
+  /// @param[in,out] outbound : send queue of the connection
+  /// @returns false if the sequence number is unknown or was answered already
+  /// @throws None
+  bool ResponseSequencer::release(const uint64_t sequence, OutboundResponse response, SendQueue &outbound)
+  {
+    if (sequence < next_response_ || sequence >= next_request_)
+      return false;
+
+    if (sequence != next_response_)
+      return early_responses_.emplace(sequence, std::move(response)).second;
+
+    while (true)
+    {
+      if (response.empty())
+      {
+        // the request could not be answered, later responses would be attributed to the wrong request by the client
+        accepting_requests_ = false;
+        next_request_ = next_response_ + 1;
+        early_responses_.clear();
+      }
+      else
+      {
+        for (auto& segment : response.segments)
+        {
+          outbound.push(std::move(segment));
+        }
+        outbound.push(std::move(response.file));
+      }
+      ++next_response_;
+
+      const auto next = early_responses_.find(next_response_);
+      if (next == early_responses_.end())
+        return true;
+
+      response = std::move(next->second);
+      early_responses_.erase(next);
+    }
+  }
+}
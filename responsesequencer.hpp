@@ -0,0 +1,64 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_RESPONSESEQUENCER_HPP
+#define WEBSERVER_RESPONSESEQUENCER_HPP
+
+#include "buffer.hpp"
+#include "sendqueue.hpp"
+
+#include <cstdint>
+#include <map>
+
+namespace network::tcp
+{
+  ///@brief Response on its way to the socket: segments sent with gathering sends, then an optional file region.
+  ///       Neither of them set means the request could not be answered
+  struct OutboundResponse
+  {
+    container::buffer::BufferSegments segments;
+    container::buffer::FileRegion file;
+
+    [[nodiscard]] bool empty() const { return segments.empty() && file.empty(); }
+  };
+
+  ///@brief Keeps the responses of a persistent connection in request order. Pipelined requests are handled in parallel
+  ///       by the worker pool, so their responses may complete in any order; every request gets a sequence number and
+  ///       a response is only released once all responses before it were released. Owned by the reactor thread
+  class ResponseSequencer
+  {
+  private:
+    uint64_t next_request_{0};
+    uint64_t next_response_{0};
+    bool accepting_requests_{true};
+    std::map<uint64_t, OutboundResponse> early_responses_;
+
+  public:
+    ///@brief Assigns the sequence number of the next request. Must not be called once the last request is known
+    uint64_t admit() { return next_request_++; }
+
+    ///@brief The request admitted last is the last one of the connection, e.g. because of "Connection: close" or
+    ///       because the peer closed its side
+    void setLastRequest() { accepting_requests_ = false; }
+
+    ///@brief No further requests are read once the last request is known, the rest of the stream is ignored
+    [[nodiscard]] bool isAcceptingRequests() const { return accepting_requests_; }
+
+    ///@brief True once a request was admitted
+    [[nodiscard]] bool hasRequests() const { return next_request_ != 0; }
+
+    ///@brief True if every admitted request got its response released
+    [[nodiscard]] bool isIdle() const { return next_response_ == next_request_; }
+
+    ///@brief True once the response to the last request was released; the connection closes after sending it
+    [[nodiscard]] bool isFinished() const { return !accepting_requests_ && isIdle(); }
+
+    ///@brief Hands over the response to a request. Appends it and all directly following responses which completed
+    ///       earlier to the outbound queue. An empty response ends the connection: nothing after it is sent. Returns
+    ///       false if the sequence number is unknown or was answered already
+    bool release(uint64_t sequence, OutboundResponse response, SendQueue& outbound);
+  };
+}
+
+#endif //WEBSERVER_RESPONSESEQUENCER_HPP
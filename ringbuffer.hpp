@@ -0,0 +1,138 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_RINGBUFFER_HPP
+#define WEBSERVER_RINGBUFFER_HPP
+
+#include "error.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace container
+{
+  constexpr std::size_t CACHE_LINE_SIZE{64};
+
+  ///@brief Bounded lock-free multi-producer/multi-consumer ring buffer (Dmitry Vyukov's design). Every cell carries a
+  ///       sequence number telling producers and consumers whether it is free or filled for the current lap, so both
+  ///       sides only contend on one CAS of their own, cache-line separated position counter
+  template<typename T>
+  class MpmcRingBuffer
+  {
+    struct alignas(CACHE_LINE_SIZE) Cell
+    {
+      std::atomic<std::size_t> sequence;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    const std::size_t mask_;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueue_position_{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeue_position_{0};
+
+  public:
+    ///@param capacity : number of cells, must be a power of two
+    explicit MpmcRingBuffer(std::size_t capacity) : cells_(new Cell[capacity]), mask_(capacity - 1)
+    {
+      if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+      {
+        throw logging::Error(LOC, "Ring buffer capacity must be a power of two");
+      }
+
+      for (std::size_t i = 0; i < capacity; ++i)
+      {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    ~MpmcRingBuffer()
+    {
+      while (tryPop()) {}
+    }
+
+    MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+    MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+    [[nodiscard]] std::size_t capacity() const { return mask_ + 1; }
+
+    ///@brief Approximate number of stored elements
+    [[nodiscard]] std::size_t size() const
+    {
+      const std::size_t enqueued = enqueue_position_.load(std::memory_order_relaxed);
+      const std::size_t dequeued = dequeue_position_.load(std::memory_order_relaxed);
+      return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    ///@brief Stores a value. Returns false without modifying the value if the buffer is full
+    template<typename U>
+    bool tryPush(U&& value)
+    {
+      Cell* cell;
+      std::size_t position = enqueue_position_.load(std::memory_order_relaxed);
+      while (true)
+      {
+        cell = &cells_[position & mask_];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0)
+        {
+          if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            break;
+        }
+        else if (difference < 0)
+        {
+          return false;
+        }
+        else
+        {
+          position = enqueue_position_.load(std::memory_order_relaxed);
+        }
+      }
+
+      new (&cell->storage) T(std::forward<U>(value));
+      cell->sequence.store(position + 1, std::memory_order_release);
+      return true;
+    }
+
+    ///@brief Removes the oldest value. Returns an empty object if the buffer is empty
+    std::optional<T> tryPop()
+    {
+      Cell* cell;
+      std::size_t position = dequeue_position_.load(std::memory_order_relaxed);
+      while (true)
+      {
+        cell = &cells_[position & mask_];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+        if (difference == 0)
+        {
+          if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            break;
+        }
+        else if (difference < 0)
+        {
+          return {};
+        }
+        else
+        {
+          position = dequeue_position_.load(std::memory_order_relaxed);
+        }
+      }
+
+      T* stored = std::launder(reinterpret_cast<T*>(&cell->storage));
+      std::optional<T> value{std::move(*stored)};
+      stored->~T();
+      cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+      return value;
+    }
+  };
+}
+
+#endif //WEBSERVER_RINGBUFFER_HPP
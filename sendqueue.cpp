@@ -0,0 +1,146 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "sendqueue.hpp"
+#include "error.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace network::tcp
+{
+  /// @class SendQueue
+  /// @name push
+  /// @brief Appends a slice. Empty slices are skipped, they would only cost an I/O vector
+  /// @param[in] slice : bytes to send, kept alive until they are written
+  /// @throws None
+  void SendQueue::push(container::buffer::BufferSlice slice)
+  {
+    if (!slice.empty())
+      entries_.push_back({std::move(slice), {}});
+  }
+
+  /// @class SendQueue
+  /// @name push
+  /// @brief Appends a file region, or its mapping if the queue does not use sendfile()
+  /// @param[in] file : file region, the owner keeps the file open until it is sent
+  /// @throws None
+  void SendQueue::push(container::buffer::FileRegion file)
+  {
+    if (file.empty())
+      return;
+
+    if (file_transfer_ == FileTransfer::MAP)
+      push(mapFileRegion(file));
+    else
+      entries_.push_back({{}, std::move(file)});
+  }
+
+  /// @class SendQueue
+  /// @name gather
+  /// @brief Describes the unsent bytes from the front of the queue for sendmsg()/writev()
+  /// @param[out] vectors : I/O vectors to fill
+  /// @param[in] max_vectors : capacity of vectors
+  /// @returns number of vectors filled
+  /// @throws None
+  std::size_t SendQueue::gather(iovec *vectors, const std::size_t max_vectors) const
+  {
+    std::size_t number_vectors{0};
+    for (auto it = entries_.begin(); it != entries_.end() && number_vectors < max_vectors && it->file.empty(); ++it)
+    {
+      const std::size_t offset = (number_vectors == 0) ? front_offset_ : 0;
+      vectors[number_vectors].iov_base = const_cast<char*>(it->slice.data() + offset);
+      vectors[number_vectors].iov_len = it->slice.size() - offset;
+      ++number_vectors;
+    }
+    return number_vectors;
+  }
+
+  /// @class SendQueue
+  /// @name getFrontFile
+  /// @brief Describes the unsent part of the file region at the front of the queue for sendfile()
+  /// @param[out] fd : file descriptor of the file
+  /// @param[out] offset : file offset of the first unsent byte
+  /// @param[out] length : number of unsent bytes
+  /// @returns false if the queue is empty or starts with a slice
+  /// @throws None
+  bool SendQueue::getFrontFile(int &fd, off_t &offset, std::size_t &length) const
+  {
+    if (entries_.empty() || entries_.front().file.empty())
+      return false;
+
+    const container::buffer::FileRegion& file = entries_.front().file;
+    fd = file.fd;
+    offset = static_cast<off_t>(file.offset + front_offset_);
+    length = file.length - front_offset_;
+    return true;
+  }
+
+  /// @class SendQueue
+  /// @name advance
+  /// @brief Drops the bytes a send accepted. A short send may end in the middle of any entry
+  /// @param[in] bytes : number of bytes the kernel accepted
+  /// @returns true if at least one entry was written completely
+  /// @throws None
+  bool SendQueue::advance(std::size_t bytes)
+  {
+    bool completed{false};
+    while (bytes > 0 && !entries_.empty())
+    {
+      const std::size_t remaining = entries_.front().size() - front_offset_;
+      if (bytes < remaining)
+      {
+        front_offset_ += bytes;
+        break;
+      }
+
+      bytes -= remaining;
+      entries_.pop_front();
+      front_offset_ = 0;
+      completed = true;
+    }
+    return completed;
+  }
+
+  /// @name mapFileRegion
+  /// @brief Maps a file region read-only into memory. The mapping is released together with the last slice referring
+  ///        to it. If mapping fails, the region is read into a buffer instead
+  /// @param[in] file : file region
+  /// @throws None
+  container::buffer::BufferSlice mapFileRegion(const container::buffer::FileRegion &file)
+  {
+    static const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t map_offset = file.offset - file.offset % page_size;
+    const std::size_t map_length = file.length + (file.offset - map_offset);
+
+    void* mapping = mmap(nullptr, map_length, PROT_READ, MAP_SHARED, file.fd, static_cast<off_t>(map_offset));
+    if (mapping != MAP_FAILED)
+    {
+      // the mapping stays valid once the file is closed, so it does not keep the owner of the region alive
+      std::shared_ptr<const void> owner(mapping, [map_length](const void* address) {
+        munmap(const_cast<void*>(address), map_length);
+      });
+      return {std::move(owner), {static_cast<const char*>(mapping) + (file.offset - map_offset), file.length}};
+    }
+
+    LOG_WARNING("Mapping file failed, reading it instead! fd: {} ({})", file.fd, strerror(errno));
+    std::string data(file.length, '\0');
+    std::size_t bytes_read{0};
+    while (bytes_read < data.size())
+    {
+      const ssize_t result = pread(file.fd, data.data() + bytes_read, data.size() - bytes_read, static_cast<off_t>(file.offset + bytes_read));
+      if (result < 0 && errno == EINTR)
+        continue;
+      if (result <= 0)
+        break;
+      bytes_read += result;
+    }
+    data.resize(bytes_read);
+    return data;
+  }
+}
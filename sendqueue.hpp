@@ -0,0 +1,72 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_SENDQUEUE_HPP
+#define WEBSERVER_SENDQUEUE_HPP
+
+#include "buffer.hpp"
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <deque>
+
+namespace network::tcp
+{
+  ///@brief Outbound bytes of a connection as a queue of slices and file regions. The slices are never joined; the
+  ///       front of the queue is handed to the kernel as an I/O vector, so a response is written with one gathering
+  ///       send however many segments it has. File regions are sent with sendfile(). Partially written entries are
+  ///       resumed at the right offset
+  class SendQueue
+  {
+  public:
+    ///@brief Number of slices passed to a single send. Stays well below IOV_MAX
+    static constexpr std::size_t MAX_VECTORS{64};
+
+    ///@brief How file regions leave the queue
+    enum class FileTransfer
+    {
+      SENDFILE, ///< kept as file regions for sendfile()
+      MAP,      ///< mapped into memory when queued and sent like slices, for senders without sendfile (io_uring)
+    };
+
+  private:
+    ///@brief Either a slice or a file region
+    struct Entry
+    {
+      container::buffer::BufferSlice slice;
+      container::buffer::FileRegion file;
+
+      [[nodiscard]] std::size_t size() const { return file.empty() ? slice.size() : file.length; }
+    };
+
+    FileTransfer file_transfer_;
+    std::deque<Entry> entries_;
+    std::size_t front_offset_{0};
+
+  public:
+    explicit SendQueue(FileTransfer file_transfer = FileTransfer::SENDFILE) : file_transfer_(file_transfer) {}
+
+    [[nodiscard]] bool empty() const { return entries_.empty(); }
+
+    void push(container::buffer::BufferSlice slice);
+    void push(container::buffer::FileRegion file);
+
+    ///@brief Fills vectors with the unsent bytes of the slices at the front of the queue, up to the first file region.
+    ///       Returns the number of vectors used, 0 if the front is a file region
+    std::size_t gather(iovec* vectors, std::size_t max_vectors) const;
+
+    ///@brief Unsent part of the file region at the front of the queue. Returns false if the front is no file region
+    bool getFrontFile(int& fd, off_t& offset, std::size_t& length) const;
+
+    ///@brief Drops bytes the kernel accepted from the front of the queue. Returns true if an entry was completed
+    bool advance(std::size_t bytes);
+  };
+
+  ///@brief Maps a file region into memory. Falls back to reading it into a buffer if it cannot be mapped
+  container::buffer::BufferSlice mapFileRegion(const container::buffer::FileRegion& file);
+}
+
+#endif //WEBSERVER_SENDQUEUE_HPP
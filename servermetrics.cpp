@@ -0,0 +1,35 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "servermetrics.hpp"
+
+namespace network::tcp
+{
+  /// @class ServerMetrics
+  /// @name get
+  /// @brief Returns the metrics of the server, they are registered on first use
+  /// @throws None
+  ServerMetrics& ServerMetrics::get()
+  {
+    static ServerMetrics instance = [] {
+      metrics::Registry& registry = metrics::Registry::getInstance();
+      return ServerMetrics{
+          registry.addCounter("webserver_connections_accepted_total", "Connections accepted"),
+          registry.addGauge("webserver_connections_open", "Connections owned by a reactor"),
+          registry.addCounter("webserver_received_bytes_total", "Bytes read from connections"),
+          registry.addCounter("webserver_sent_bytes_total", "Bytes written to connections"),
+          registry.addCounter("webserver_send_failures_total", "Connections closed because sending failed"),
+          registry.addCounter("webserver_rejected_requests_total", "Malformed requests answered with an error by the reactor"),
+          registry.addCounter("webserver_shed_requests_total", "Requests answered with 503 because the queue was full"),
+          registry.addCounter("webserver_expired_requests_total", "Requests answered with 503 because they waited too long for a worker"),
+          registry.addCounter("webserver_read_pauses_total", "Times a reactor stopped reading because the queue was full"),
+          registry.addCounter("webserver_connection_timeouts_total", "Connections closed by the header, request or idle timeout"),
+          registry.addGauge("webserver_received_queue_messages", "Requests waiting for a worker"),
+          registry.addGauge("webserver_respond_queue_messages", "Responses waiting in the queue, stays 0 while responses are routed"),
+          registry.addHistogram("webserver_request_duration_seconds",
+                                "Time from reading a request until its response is handed to the connection", 1e-9)};
+    }();
+    return instance;
+  }
+}
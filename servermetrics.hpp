@@ -0,0 +1,33 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_SERVERMETRICS_HPP
+#define WEBSERVER_SERVERMETRICS_HPP
+
+#include "metrics.hpp"
+
+namespace network::tcp
+{
+  ///@brief Metrics recorded by the socket, the reactors of both backends and the message queues
+  struct ServerMetrics
+  {
+    metrics::Counter& accepted_connections;
+    metrics::Gauge& open_connections;
+    metrics::Counter& bytes_received;
+    metrics::Counter& bytes_sent;
+    metrics::Counter& send_failures;
+    metrics::Counter& rejected_requests;
+    metrics::Counter& shed_requests;        // refused by a full queue
+    metrics::Counter& expired_requests;     // waited longer than the queue time budget
+    metrics::Counter& read_pauses;          // times a reactor stopped reading because the queue was full
+    metrics::Counter& connection_timeouts;  // closed by the header, request or idle timeout
+    metrics::Gauge& received_queue_depth;
+    metrics::Gauge& respond_queue_depth;
+    metrics::Histogram& request_duration;   // nanoseconds from reading a request until its response is routed
+
+    static ServerMetrics& get();
+  };
+}
+
+#endif //WEBSERVER_SERVERMETRICS_HPP
@@ -0,0 +1,450 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "simdscan.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WEBSERVER_SIMDSCAN_X86 1
+#endif
+
+namespace network::http::scan
+{
+  namespace
+  {
+    using HeaderEndKernel = const char* (*)(const char* begin, const char* end);
+    using ControlsKernel = std::size_t (*)(const char* data, std::size_t size, uint32_t* positions, std::size_t max_positions);
+    using TokenKernel = std::size_t (*)(const char* data, std::size_t size);
+
+    constexpr std::string_view HEADER_END{"\r\n\r\n"};
+
+    bool isControl(const char c)
+    {
+      const auto byte = static_cast<unsigned char>(c);
+      return (byte < 0x20 && byte != '\t') || byte == 0x7f;
+    }
+
+    constexpr bool isTokenCharacter(const unsigned char c)
+    {
+      if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        return true;
+
+      for (const char special : std::string_view{"!#$%&'*+-.^_`|~"})
+      {
+        if (c == static_cast<unsigned char>(special))
+          return true;
+      }
+      return false;
+    }
+
+    constexpr std::array<bool, 256> makeTokenTable()
+    {
+      std::array<bool, 256> table{};
+      for (unsigned c = 0; c < 256; ++c)
+      {
+        table[c] = isTokenCharacter(static_cast<unsigned char>(c));
+      }
+      return table;
+    }
+
+    constexpr std::array<bool, 256> TOKEN_TABLE{makeTokenTable()};
+
+    // Nibble tables for classifying token characters with two byte shuffles: a byte is no token character if
+    // HIGH_NIBBLE_GROUPS[byte >> 4] & LOW_NIBBLE_CLASSES[byte & 0xf] != 0. High nibbles whose 16 characters behave
+    // the same share a group bit; 0x6_ contains token characters only and needs none
+    constexpr uint8_t highNibbleGroup(const unsigned high)
+    {
+      switch (high)
+      {
+        case 0x2: return 0x02;
+        case 0x3: return 0x04;
+        case 0x4: return 0x08;
+        case 0x5: return 0x10;
+        case 0x6: return 0x00;
+        case 0x7: return 0x20;
+        default: return 0x01;
+      }
+    }
+
+    constexpr std::array<uint8_t, 16> makeHighNibbleGroups()
+    {
+      std::array<uint8_t, 16> groups{};
+      for (unsigned high = 0; high < 16; ++high)
+      {
+        groups[high] = highNibbleGroup(high);
+      }
+      return groups;
+    }
+
+    constexpr std::array<uint8_t, 16> makeLowNibbleClasses()
+    {
+      std::array<uint8_t, 16> classes{};
+      for (unsigned high = 0; high < 16; ++high)
+      {
+        for (unsigned low = 0; low < 16; ++low)
+        {
+          if (!isTokenCharacter(static_cast<unsigned char>(high << 4 | low)))
+            classes[low] |= highNibbleGroup(high);
+        }
+      }
+      return classes;
+    }
+
+    alignas(16) constexpr std::array<uint8_t, 16> HIGH_NIBBLE_GROUPS{makeHighNibbleGroups()};
+    alignas(16) constexpr std::array<uint8_t, 16> LOW_NIBBLE_CLASSES{makeLowNibbleClasses()};
+
+    std::size_t tokenLengthScalar(const char* data, const std::size_t size)
+    {
+      std::size_t length{0};
+      while (length < size && TOKEN_TABLE[static_cast<unsigned char>(data[length])])
+        ++length;
+      return length;
+    }
+
+    const char* findHeaderEndScalar(const char* begin, const char* end)
+    {
+      while (end - begin >= static_cast<std::ptrdiff_t>(HEADER_END.size()))
+      {
+        const auto* candidate = static_cast<const char*>(std::memchr(begin, '\r', end - begin - (HEADER_END.size() - 1)));
+        if (!candidate)
+          return end;
+
+        if (std::memcmp(candidate, HEADER_END.data(), HEADER_END.size()) == 0)
+          return candidate;
+        begin = candidate + 1;
+      }
+      return end;
+    }
+
+    std::size_t findControlsScalar(const char* data, const std::size_t size, uint32_t* positions, const std::size_t max_positions)
+    {
+      std::size_t count{0};
+      for (std::size_t offset = 0; offset < size && count < max_positions; ++offset)
+      {
+        if (isControl(data[offset]))
+          positions[count++] = static_cast<uint32_t>(offset);
+      }
+      return count;
+    }
+
+    ///@brief Appends the positions of the bits set in a block mask
+    inline bool appendPositions(uint32_t mask, const std::size_t offset, uint32_t* positions, const std::size_t max_positions, std::size_t& count)
+    {
+      while (mask != 0)
+      {
+        if (count == max_positions)
+          return false;
+        positions[count++] = static_cast<uint32_t>(offset + __builtin_ctz(mask));
+        mask &= mask - 1;
+      }
+      return true;
+    }
+
+#ifdef WEBSERVER_SIMDSCAN_X86
+    // the kernels are compiled for their instruction set via target attributes, so the rest of the binary keeps the
+    // baseline ISA and the dispatch below decides at runtime which one may run
+
+    __attribute__((target("sse4.2")))
+    const char* findHeaderEndSse42(const char* begin, const char* end)
+    {
+      const __m128i cr = _mm_set1_epi8('\r');
+      const __m128i lf = _mm_set1_epi8('\n');
+      // every iteration looks at 16 candidate positions and the 3 bytes following the last one
+      while (end - begin >= 16 + 3)
+      {
+        const __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), cr);
+        const __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + 1)), lf);
+        const __m128i third = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + 2)), cr);
+        const __m128i fourth = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + 3)), lf);
+        const int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(first, second), _mm_and_si128(third, fourth)));
+        if (mask != 0)
+          return begin + __builtin_ctz(static_cast<unsigned>(mask));
+        begin += 16;
+      }
+      return findHeaderEndScalar(begin, end);
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t controlMaskSse42(const char* block)
+    {
+      // pairs of inclusive ranges: 0x00-0x08, 0x0a-0x1f, 0x7f-0x7f
+      alignas(16) static constexpr char RANGES[16]{0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f};
+      const __m128i ranges = _mm_load_si128(reinterpret_cast<const __m128i*>(RANGES));
+      const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+      const __m128i mask = _mm_cmpestrm(ranges, 6, bytes, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK);
+      return static_cast<uint32_t>(_mm_cvtsi128_si32(mask));
+    }
+
+    __attribute__((target("sse4.2")))
+    std::size_t findControlsSse42(const char* data, const std::size_t size, uint32_t* positions, const std::size_t max_positions)
+    {
+      std::size_t count{0};
+      std::size_t offset{0};
+      for (; offset + 16 <= size; offset += 16)
+      {
+        if (!appendPositions(controlMaskSse42(data + offset), offset, positions, max_positions, count))
+          return count;
+      }
+
+      if (offset < size)
+      {
+        char block[16];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, data + offset, size - offset);
+        appendPositions(controlMaskSse42(block), offset, positions, max_positions, count);
+      }
+      return count;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t nonTokenMaskSse42(const char* block)
+    {
+      const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+      const __m128i low = _mm_and_si128(bytes, _mm_set1_epi8(0x0f));
+      const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0f));
+      const __m128i classes = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(LOW_NIBBLE_CLASSES.data())), low);
+      const __m128i groups = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_GROUPS.data())), high);
+      const __m128i token = _mm_cmpeq_epi8(_mm_and_si128(classes, groups), _mm_setzero_si128());
+      return ~static_cast<uint32_t>(_mm_movemask_epi8(token)) & 0xffff;
+    }
+
+    __attribute__((target("sse4.2")))
+    std::size_t tokenLengthSse42(const char* data, const std::size_t size)
+    {
+      std::size_t offset{0};
+      for (; offset + 16 <= size; offset += 16)
+      {
+        const uint32_t mask = nonTokenMaskSse42(data + offset);
+        if (mask != 0)
+          return offset + __builtin_ctz(mask);
+      }
+
+      if (offset < size)
+      {
+        char block[16];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, data + offset, size - offset);
+        return offset + __builtin_ctz(nonTokenMaskSse42(block));
+      }
+      return size;
+    }
+
+    __attribute__((target("avx2")))
+    const char* findHeaderEndAvx2(const char* begin, const char* end)
+    {
+      const __m256i cr = _mm256_set1_epi8('\r');
+      const __m256i lf = _mm256_set1_epi8('\n');
+      while (end - begin >= 32 + 3)
+      {
+        const __m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)), cr);
+        const __m256i second = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + 1)), lf);
+        const __m256i third = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + 2)), cr);
+        const __m256i fourth = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + 3)), lf);
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(first, second), _mm256_and_si256(third, fourth))));
+        if (mask != 0)
+          return begin + __builtin_ctz(mask);
+        begin += 32;
+      }
+      return findHeaderEndScalar(begin, end);
+    }
+
+    __attribute__((target("avx2")))
+    uint32_t controlMaskAvx2(const char* block)
+    {
+      const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+      // unsigned bytes <= 0x1f are the ones min() leaves unchanged
+      const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8(0x1f)), bytes);
+      const __m256i invalid = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')), control),
+                                              _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(0x7f)));
+      return static_cast<uint32_t>(_mm256_movemask_epi8(invalid));
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t findControlsAvx2(const char* data, const std::size_t size, uint32_t* positions, const std::size_t max_positions)
+    {
+      std::size_t count{0};
+      std::size_t offset{0};
+      for (; offset + 32 <= size; offset += 32)
+      {
+        if (!appendPositions(controlMaskAvx2(data + offset), offset, positions, max_positions, count))
+          return count;
+      }
+
+      // the tail goes through a block padded with spaces instead of a byte loop
+      if (offset < size)
+      {
+        char block[32];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, data + offset, size - offset);
+        appendPositions(controlMaskAvx2(block), offset, positions, max_positions, count);
+      }
+      return count;
+    }
+
+    __attribute__((target("avx2")))
+    uint32_t nonTokenMaskAvx2(const char* block)
+    {
+      const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+      const __m256i low = _mm256_and_si256(bytes, _mm256_set1_epi8(0x0f));
+      const __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0f));
+      const __m256i classes = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(LOW_NIBBLE_CLASSES.data()))), low);
+      const __m256i groups = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_GROUPS.data()))), high);
+      const __m256i token = _mm256_cmpeq_epi8(_mm256_and_si256(classes, groups), _mm256_setzero_si256());
+      return ~static_cast<uint32_t>(_mm256_movemask_epi8(token));
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t tokenLengthAvx2(const char* data, const std::size_t size)
+    {
+      // tokens are short, so anything below a full block takes the 16 byte kernel
+      std::size_t offset{0};
+      for (; offset + 32 <= size; offset += 32)
+      {
+        const uint32_t mask = nonTokenMaskAvx2(data + offset);
+        if (mask != 0)
+          return offset + __builtin_ctz(mask);
+      }
+      return offset + tokenLengthSse42(data + offset, size - offset);
+    }
+#endif
+
+    struct Kernels
+    {
+      Isa isa;
+      HeaderEndKernel find_header_end;
+      ControlsKernel find_controls;
+      TokenKernel token_length;
+    };
+
+    Kernels getKernels(const Isa isa)
+    {
+      switch (isa)
+      {
+#ifdef WEBSERVER_SIMDSCAN_X86
+        case Isa::AVX2:
+          return {Isa::AVX2, findHeaderEndAvx2, findControlsAvx2, tokenLengthAvx2};
+        case Isa::SSE42:
+          return {Isa::SSE42, findHeaderEndSse42, findControlsSse42, tokenLengthSse42};
+#endif
+        default:
+          return {Isa::SCALAR, findHeaderEndScalar, findControlsScalar, tokenLengthScalar};
+      }
+    }
+
+    const Kernels& getActiveKernels()
+    {
+      static const Kernels kernels{getKernels(isSupported(Isa::AVX2) ? Isa::AVX2
+                                            : isSupported(Isa::SSE42) ? Isa::SSE42
+                                            : Isa::SCALAR)};
+      return kernels;
+    }
+
+    std::size_t run(const HeaderEndKernel kernel, std::string_view data, const std::size_t from)
+    {
+      if (from >= data.size())
+        return std::string_view::npos;
+
+      const char* end = data.data() + data.size();
+      const char* found = kernel(data.data() + from, end);
+      return found == end ? std::string_view::npos : static_cast<std::size_t>(found - data.data());
+    }
+  }
+
+  /// @name isSupported
+  /// @brief Checks if the CPU executing the program supports the instruction set of a kernel
+  /// @param[in] isa : instruction set
+  /// @throws None
+  bool isSupported(const Isa isa)
+  {
+    switch (isa)
+    {
+      case Isa::SCALAR:
+        return true;
+#ifdef WEBSERVER_SIMDSCAN_X86
+      case Isa::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+      case Isa::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+      default:
+        return false;
+    }
+  }
+
+  /// @name getActiveIsa
+  /// @brief Returns the instruction set of the kernels used by findHeaderEnd() and findControls()
+  /// @throws None
+  Isa getActiveIsa()
+  {
+    return getActiveKernels().isa;
+  }
+
+  /// @name toString
+  /// @brief Returns the name of an instruction set
+  /// @throws None
+  std::string_view toString(const Isa isa)
+  {
+    switch (isa)
+    {
+      case Isa::AVX2:
+        return "AVX2";
+      case Isa::SSE42:
+        return "SSE4.2";
+      default:
+        return "scalar";
+    }
+  }
+
+  /// @name findHeaderEnd
+  /// @brief Position of the first "\r\n\r\n" at or after from, using the kernel picked for this CPU
+  /// @throws None
+  std::size_t findHeaderEnd(std::string_view data, const std::size_t from)
+  {
+    return run(getActiveKernels().find_header_end, data, from);
+  }
+
+  /// @name findControls
+  /// @brief Stores the positions of the control characters in data, using the kernel picked for this CPU
+  /// @returns number of positions stored, at most max_positions
+  /// @throws None
+  std::size_t findControls(std::string_view data, uint32_t *positions, const std::size_t max_positions)
+  {
+    return getActiveKernels().find_controls(data.data(), data.size(), positions, max_positions);
+  }
+
+  /// @name tokenLength
+  /// @brief Length of the token at the start of data, using the kernel picked for this CPU
+  /// @throws None
+  std::size_t tokenLength(std::string_view data)
+  {
+    return getActiveKernels().token_length(data.data(), data.size());
+  }
+
+  /// @name findHeaderEnd
+  /// @brief findHeaderEnd() with a fixed kernel
+  /// @throws None
+  std::size_t findHeaderEnd(const Isa isa, std::string_view data, const std::size_t from)
+  {
+    return run(getKernels(isa).find_header_end, data, from);
+  }
+
+  /// @name findControls
+  /// @brief findControls() with a fixed kernel
+  /// @throws None
+  std::size_t findControls(const Isa isa, std::string_view data, uint32_t *positions, const std::size_t max_positions)
+  {
+    return getKernels(isa).find_controls(data.data(), data.size(), positions, max_positions);
+  }
+
+  /// @name tokenLength
+  /// @brief tokenLength() with a fixed kernel
+  /// @throws None
+  std::size_t tokenLength(const Isa isa, std::string_view data)
+  {
+    return getKernels(isa).token_length(data.data(), data.size());
+  }
+}
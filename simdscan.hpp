@@ -0,0 +1,43 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_SIMDSCAN_HPP
+#define WEBSERVER_SIMDSCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace network::http::scan
+{
+  ///@brief Instruction set of a scanning kernel. The best one supported by the CPU is picked once at startup
+  enum class Isa
+  {
+    SCALAR,
+    SSE42,
+    AVX2,
+  };
+
+  [[nodiscard]] bool isSupported(Isa isa);
+  [[nodiscard]] Isa getActiveIsa();
+  [[nodiscard]] std::string_view toString(Isa isa);
+
+  ///@brief Position of the first "\r\n\r\n" at or after from, npos if there is none
+  [[nodiscard]] std::size_t findHeaderEnd(std::string_view data, std::size_t from = 0);
+
+  ///@brief Stores the positions of the control characters (0x00-0x1f except HTAB, and DEL) in data, in ascending
+  ///       order. Inside a header section the only legal ones are the CRLFs ending the lines, so one pass both splits
+  ///       the lines and validates the characters. Stops after max_positions and returns the number stored
+  std::size_t findControls(std::string_view data, uint32_t* positions, std::size_t max_positions);
+
+  ///@brief Length of the RFC 9110 token (method, header name) at the start of data
+  [[nodiscard]] std::size_t tokenLength(std::string_view data);
+
+  ///@brief Same as above with a fixed kernel, for comparing the implementations. The ISA must be supported
+  [[nodiscard]] std::size_t findHeaderEnd(Isa isa, std::string_view data, std::size_t from = 0);
+  std::size_t findControls(Isa isa, std::string_view data, uint32_t* positions, std::size_t max_positions);
+  [[nodiscard]] std::size_t tokenLength(Isa isa, std::string_view data);
+}
+
+#endif //WEBSERVER_SIMDSCAN_HPP
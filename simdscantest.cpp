@@ -0,0 +1,154 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "simdscan.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+  namespace scan = network::http::scan;
+
+  // lengths and alignments cover several 16 and 32 byte blocks plus the tails behind them
+  constexpr std::size_t MAX_LENGTH{160};
+  constexpr std::size_t MAX_ALIGNMENT{64};
+  constexpr std::size_t ROUNDS{8};
+
+  std::size_t failures{0};
+
+  void fail(const scan::Isa isa, const std::string_view check, const std::size_t length, const std::size_t alignment,
+            const std::size_t expected, const std::size_t actual)
+  {
+    if (++failures <= 20)
+      std::cerr << scan::toString(isa) << " " << check << " length " << length << " alignment " << alignment << ": expected " << expected
+                << " got " << actual << std::endl;
+  }
+
+  ///@brief Mostly bytes the kernels look for, so matches and near matches (lone CR, CRLF CR) cross every block boundary
+  char randomByte(std::mt19937 &random)
+  {
+    static constexpr char INTERESTING[]{'\r', '\n', '\t', ' ', ':', 'a', 'Z', '0', '-', '\x7f', '\0', '"', '\x80', '\xff'};
+    const uint32_t choice = random() % 32;
+    if (choice < std::size(INTERESTING))
+      return INTERESTING[choice];
+    return static_cast<char>(random() & 0xFFU);
+  }
+
+  void checkHeaderEnd(const scan::Isa isa, const std::string_view data, const std::size_t alignment)
+  {
+    for (std::size_t from = 0; from <= data.size(); ++from)
+    {
+      const std::size_t expected = scan::findHeaderEnd(scan::Isa::SCALAR, data, from);
+      const std::size_t actual = scan::findHeaderEnd(isa, data, from);
+      if (expected != actual)
+        fail(isa, "findHeaderEnd", data.size(), alignment, expected, actual);
+    }
+  }
+
+  void checkControls(const scan::Isa isa, const std::string_view data, const std::size_t alignment)
+  {
+    uint32_t expected[MAX_LENGTH];
+    uint32_t actual[MAX_LENGTH];
+    for (const std::size_t max_positions : {std::size_t{0}, std::size_t{1}, std::size_t{3}, MAX_LENGTH})
+    {
+      const std::size_t expected_count = scan::findControls(scan::Isa::SCALAR, data, expected, max_positions);
+      const std::size_t actual_count = scan::findControls(isa, data, actual, max_positions);
+      if (expected_count != actual_count)
+      {
+        fail(isa, "findControls count", data.size(), alignment, expected_count, actual_count);
+        continue;
+      }
+
+      for (std::size_t i = 0; i < expected_count; ++i)
+      {
+        if (expected[i] != actual[i])
+        {
+          fail(isa, "findControls position", data.size(), alignment, expected[i], actual[i]);
+          break;
+        }
+      }
+    }
+  }
+
+  void checkTokenLength(const scan::Isa isa, const std::string_view data, const std::size_t alignment)
+  {
+    const std::size_t expected = scan::tokenLength(scan::Isa::SCALAR, data);
+    const std::size_t actual = scan::tokenLength(isa, data);
+    if (expected != actual)
+      fail(isa, "tokenLength", data.size(), alignment, expected, actual);
+  }
+
+  void checkRandomBuffers(const scan::Isa isa, std::mt19937 &random)
+  {
+    alignas(64) char storage[MAX_ALIGNMENT + MAX_LENGTH];
+    for (std::size_t round = 0; round < ROUNDS; ++round)
+    {
+      for (std::size_t length = 0; length <= MAX_LENGTH; ++length)
+      {
+        for (std::size_t alignment = 0; alignment < MAX_ALIGNMENT; ++alignment)
+        {
+          for (std::size_t i = 0; i < length; ++i)
+            storage[alignment + i] = randomByte(random);
+
+          const std::string_view data{storage + alignment, length};
+          checkHeaderEnd(isa, data, alignment);
+          checkControls(isa, data, alignment);
+          checkTokenLength(isa, data, alignment);
+        }
+      }
+    }
+  }
+
+  ///@brief Every byte value at every position of a token, so each lane of each block sees every value once
+  void checkTokenBytes(const scan::Isa isa)
+  {
+    alignas(64) char storage[MAX_ALIGNMENT + MAX_LENGTH];
+    for (const std::size_t alignment : {std::size_t{0}, std::size_t{1}, std::size_t{15}, std::size_t{17}, std::size_t{31}})
+    {
+      for (std::size_t length = 1; length <= MAX_LENGTH / 2; ++length)
+      {
+        for (std::size_t position = 0; position < length; ++position)
+        {
+          for (unsigned value = 0; value < 256; ++value)
+          {
+            for (std::size_t i = 0; i < length; ++i)
+              storage[alignment + i] = 'a';
+            storage[alignment + position] = static_cast<char>(value);
+            checkTokenLength(isa, {storage + alignment, length}, alignment);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Compares the SIMD scanning kernels with the scalar ones, ISAs the CPU lacks are skipped
+int main()
+{
+  std::mt19937 random{20261017};
+  for (const scan::Isa isa : {scan::Isa::SSE42, scan::Isa::AVX2})
+  {
+    if (!scan::isSupported(isa))
+    {
+      std::cout << scan::toString(isa) << ": not supported, skipped" << std::endl;
+      continue;
+    }
+
+    const std::size_t failures_before = failures;
+    checkRandomBuffers(isa, random);
+    checkTokenBytes(isa);
+    std::cout << scan::toString(isa) << ": " << (failures == failures_before ? "passed" : "FAILED") << std::endl;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " mismatches" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -4,6 +4,12 @@
 
 #include "socket.hpp"
 #include "trace.hpp"
+#include "epollreactor.hpp"
+#include "uringreactor.hpp"
+#include "servermetrics.hpp"
+#include "httprequest.hpp"
+
+#include <limits>
 
 
 namespace network::tcp
@@ -13,15 +19,40 @@ namespace network::tcp
   /// @brief constructor
   /// @param[in] addr : IPv4 Address on which the socket should communicate
   /// @param[in] port : Port on which the socket should communicate
+  /// @param[in] message_queue : queue used to exchange messages with the application
+  /// @param[in] backend : I/O mechanism driving the connections
+  /// @param[in] listen_mode : single listening socket or one SO_REUSEPORT listening socket per reactor
+  /// @param[in] number_reactors : number of event loop threads serving all connections
   /// @throws logging::SystemError
-  Socket::Socket(const network::ip::IPv4Address &addr, const unsigned short port, container::message_queue::Queue& message_queue) : address_(addr), port_(port),
-                                                                                                                  socketAddressLen_(sizeof(socketAddress_)),
-                                                                                                                  shutdown_(false),
-                                                                                                                  message_queue_(message_queue)
+  Socket::Socket(const network::ip::IPv4Address &addr, const unsigned short port, container::message_queue::Queue& message_queue,
+                 const IoBackend backend, const ListenMode listen_mode, const std::size_t number_reactors) : address_(addr), port_(port),
+                                                      listen_mode_(listen_mode),
+                                                      socketAddressLen_(sizeof(socketAddress_)),
+                                                      shutdown_(false),
+                                                      message_queue_(message_queue)
   {
     const logging::Trace trace(__func__);
-    openSocket();
-    bindSocket();
+    if (number_reactors == 0 || number_reactors > std::numeric_limits<uint16_t>::max())
+    {
+      throw logging::Error(LOC, fmt::format("Invalid number of reactors: {}", number_reactors));
+    }
+
+    for (std::size_t i = 0; i < number_reactors; ++i)
+    {
+      if (backend == IoBackend::IO_URING)
+        reactors_.emplace_back(std::make_unique<UringReactor>(message_queue_, static_cast<uint16_t>(i)));
+      else
+        reactors_.emplace_back(std::make_unique<EpollReactor>(message_queue_, static_cast<uint16_t>(i)));
+    }
+
+    const std::size_t number_listen_sockets = (listen_mode_ == ListenMode::REUSEPORT_SHARDS) ? number_reactors : 1;
+    for (std::size_t i = 0; i < number_listen_sockets; ++i)
+    {
+      SocketFileDescriptor& listen_socket = listen_sockets_.emplace_back(openSocket());
+      bindSocket(listen_socket);
+    }
+
+    message_queue_.setResponseRouter(this);
   }
 
   /// @class Socket
@@ -32,81 +63,80 @@ namespace network::tcp
   {
     const logging::Trace trace(__func__);
     shutdownSocket();
-
-    if (!listen_socket_thread_.joinable())
-    {
-      logging::Logger::getInstance().log(logging::LogLevel::WARNING, "Socket listening thread not joinable!");
-    }
-    else
-    {
-      listen_socket_thread_.join();
-    }
-
-    if (!answer_thread_.joinable())
-    {
-      logging::Logger::getInstance().log(logging::LogLevel::WARNING, "Socket answer thread not joinable!");
-    }
-    else
-    {
-      answer_thread_.join();
-    }
+    message_queue_.setResponseRouter(nullptr);
   }
 
   /// @class Socket
   /// @name openSocket
-  /// @brief Opens a new socket
+  /// @brief Opens a new non-blocking socket. In sharded mode SO_REUSEPORT is set so several sockets can bind the same port
   /// @throws logging::SystemError
-  void Socket::openSocket()
+  SocketFileDescriptor Socket::openSocket() const
   {
     const logging::Trace trace(__func__);
 
-    socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_ < 0)
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
     {
       throw logging::SystemError(LOC, "Creating a socket failed");
     }
+    SocketFileDescriptor listen_socket{fd};
+
+    constexpr int ENABLE{1};
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &ENABLE, sizeof(ENABLE)) < 0)
+    {
+      throw logging::SystemError(LOC, "Setting SO_REUSEADDR failed");
+    }
+
+    if (listen_mode_ == ListenMode::REUSEPORT_SHARDS &&
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &ENABLE, sizeof(ENABLE)) < 0)
+    {
+      throw logging::SystemError(LOC, "Setting SO_REUSEPORT failed");
+    }
+
+    return listen_socket;
   }
 
   /// @class Socket
   /// @name closeSocket
-  /// @brief Closes the socket
+  /// @brief Closes all listening sockets
   /// @throws None
   void Socket::closeSocket()
   {
     const logging::Trace trace(__func__);
-    socket_ = -1;
+    listen_sockets_.clear();
   }
 
   /// @class Socket
-  /// @name acceptConnection
-  /// @brief Accepts incoming connections
-  /// @param[out] accepted_socket : file descriptor of the accepted connection
-  /// @throws logging::SystemError
-  void Socket::acceptConnection(SocketFileDescriptor &accepted_socket)
+  /// @name dispatchConnection
+  /// @brief Hands a connection accepted by a listening reactor to the reactor which will own it. Runs on the thread of
+  ///        the accepting reactor; a connection it keeps is registered right away, without taking any lock, so the
+  ///        REUSEPORT_SHARDS accept path shares nothing between the shards
+  /// @param[in] accepted_socket : file descriptor of the accepted connection
+  /// @param[in] reactor_index : index of the owning reactor
+  /// @param[in] accepting_reactor : index of the reactor which accepted the connection
+  /// @throws None
+  void Socket::dispatchConnection(SocketFileDescriptor accepted_socket, const std::size_t reactor_index, const std::size_t accepting_reactor)
   {
     const logging::Trace trace(__func__);
-    accepted_socket = accept(socket_, reinterpret_cast<sockaddr *>(&socketAddress_), &socketAddressLen_);
+    ServerMetrics::get().accepted_connections.add();
+    if (isShutdownOngoing())
     {
-      std::lock_guard<std::mutex> g_shutdown_lock(shutdown_mutex_);
-      if (isShutdownOngoing(g_shutdown_lock))
-      {
-        logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, "Shutdown signal received");
-        return;
-      }
-    }
-    if (accepted_socket < 0)
-    {
-      throw logging::SystemError(LOC,
-                                 fmt::format("Failed to accept incoming connection from {}:{}", address_.to_string(),
-                                             port_));
+      LOG_DEBUG("Shutdown signal received");
+      return;
     }
+
+    if (reactor_index == accepting_reactor)
+      reactors_[reactor_index]->adoptConnection(std::move(accepted_socket));
+    else
+      reactors_[reactor_index]->addConnection(std::move(accepted_socket));
   }
 
   /// @class Socket
   /// @name bindSocket
   /// @brief uses the syscall 'bind' to bind a socket
+  /// @param[in] socket : socket to bind
   /// @throws logging::SystemError
-  void Socket::bindSocket()
+  void Socket::bindSocket(const int socket)
   {
     const logging::Trace trace(__func__);
 
@@ -115,7 +145,7 @@ namespace network::tcp
     socketAddress_.sin_port = htons(port_);
     socketAddress_.sin_addr.s_addr = static_cast<in_addr_t>(address_);
 
-    if (bind(socket_, reinterpret_cast<sockaddr *>(&socketAddress_), socketAddressLen_))
+    if (bind(socket, reinterpret_cast<sockaddr *>(&socketAddress_), socketAddressLen_))
     {
       throw logging::SystemError(LOC, "Cannot connect socket to address");
     }
@@ -123,151 +153,127 @@ namespace network::tcp
 
   /// @class Socket
   /// @name listenSocket
-  /// @brief Accepts incoming connections, starts a new thread for each accepted socket and
-  ///        handles the subsequent communications
+  /// @brief Starts listening and the reactor threads. With a single listener accepted connections are spread over
+  ///        the reactors round-robin; with REUSEPORT_SHARDS every reactor accepts on its own socket, is pinned to a
+  ///        CPU and keeps the connections it accepted
   /// @throws logging::SystemError
   void Socket::listenSocket()
   {
     const logging::Trace trace(__func__);
 
-    listen_socket_thread_ = std::thread([this](){listenSocketThreaded();});
-    answer_thread_ = std::thread([this](){sendResponseThreaded();});
-  }
-
-  /// @class Socket
-  /// @name listenSocketThreaded
-  /// @brief Tasks executed by thread to listen for incoming connections and starting a listener thread
-  void Socket::listenSocketThreaded()
-  {
-    constexpr short MAX_NUMBER_LISTENING_THREADS{5};
-    while (true)
+    constexpr int BACKLOG{SOMAXCONN};
+    for (std::size_t i = 0; i < listen_sockets_.size(); ++i)
     {
-      const int result = listen(socket_, MAX_NUMBER_LISTENING_THREADS);
-      {
-        std::lock_guard<std::mutex> g_shutdown_lock(shutdown_mutex_);
-        if (isShutdownOngoing(g_shutdown_lock))
-        {
-          logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, "Shutdown signal received");
-          return;
-        }
-      }
-      if (result < 0)
+      if (listen(listen_sockets_[i], BACKLOG) < 0)
       {
         throw logging::SystemError(LOC, "Socket listen failed!");
       }
 
-      SocketFileDescriptor accepted_socket;
-      acceptConnection(accepted_socket);
+      if (listen_mode_ == ListenMode::REUSEPORT_SHARDS)
       {
-        std::lock_guard<std::mutex> g_shutdown_lock(shutdown_mutex_);
-        if (isShutdownOngoing(g_shutdown_lock))
-          return;
+        reactors_[i]->setCpuAffinity(static_cast<int>(i % std::max(1U, std::thread::hardware_concurrency())));
+        reactors_[i]->watchListeningSocket(listen_sockets_[i], [this, i](SocketFileDescriptor accepted_socket) {
+          dispatchConnection(std::move(accepted_socket), i, i);
+        });
       }
+      else
+      {
+        reactors_[i]->watchListeningSocket(listen_sockets_[i], [this, i](SocketFileDescriptor accepted_socket) {
+          dispatchConnection(std::move(accepted_socket), next_reactor_.fetch_add(1, std::memory_order_relaxed) % reactors_.size(), i);
+        });
+      }
+    }
 
-      auto& it = connections_.emplace_back(accepted_socket);
-      it.start([this, &accepted_socket]() { handleConnection(std::move(accepted_socket)); });
+    for (auto& reactor : reactors_)
+    {
+      reactor->start();
     }
   }
 
   /// @class Socket
-  /// @name handleConnection
-  /// @brief Gets executed by multiple threads to handle multiple accepted sockets at the same time
-  /// @param[in] accepted_socket : accepted socket for the communication
-  /// @throws logging::SystemError
-  void Socket::handleConnection(SocketFileDescriptor accepted_socket)
+  /// @name startWorkerPool
+  /// @brief Starts a pool of worker threads which handle the received messages in parallel. The pool is stopped
+  ///        and joined by shutdownSocket()
+  /// @param[in] handler : gets called by a worker thread for every received message
+  /// @param[in] number_workers : number of worker threads
+  /// @param[in] queue_time_budget : requests which waited longer for a worker are answered with 503 instead of being
+  ///            handled, the client has most likely given up on them. 0 handles every request
+  /// @throws logging::Error
+  void Socket::startWorkerPool(concurrency::WorkerPool::Handler handler, const std::size_t number_workers,
+                               const std::chrono::milliseconds queue_time_budget)
   {
     const logging::Trace trace(__func__);
-    while (true)
+    if (worker_pool_)
     {
-      constexpr int SIZE_BUFFER{2048};
-      char buffer[SIZE_BUFFER]{};
-      const int bytes_received = read(accepted_socket, buffer, SIZE_BUFFER);
-      {
-        std::lock_guard<std::mutex> g_shutdown_lock(shutdown_mutex_);
-        if (isShutdownOngoing(g_shutdown_lock))
-        {
-          logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, "Shutdown signal received");
-          return;
-        }
-      }
-
-      if (bytes_received < 0)
-      {
-        throw logging::SystemError(LOC, fmt::format("Read failed! fd: {}", accepted_socket.operator int()));
-      }
-
-      logging::Logger::getInstance().log(logging::LogLevel::INFO, LOC, fmt::format("Message received: {}", buffer));
-
-      message_queue_.enqueueReceivedMessage({buffer, accepted_socket});
+      throw logging::Error(LOC, "Worker pool already started");
+    }
 
-      std::optional<container::message_queue::Message> response{message_queue_.retrieveResponseMessageNonBlocking()};
-      if (response.has_value())
-      {
-        const int bytes_sent = send(response.value().getSocket(), response.value().getMessageString().c_str(), response.value().getMessageString().length(), MSG_NOSIGNAL);
-        if (bytes_sent != response.value().getMessageString().length())
+    if (queue_time_budget.count() > 0)
+    {
+      handler = [this, handler = std::move(handler), queue_time_budget](const container::message_queue::Message& message) {
+        const std::chrono::steady_clock::time_point received_time = message.getReceivedTime();
+        if (received_time != std::chrono::steady_clock::time_point{} && std::chrono::steady_clock::now() - received_time > queue_time_budget)
         {
-          logging::Logger::getInstance().log(logging::LogLevel::INFO, LOC, "Send failed! Stopping listening thread");
+          LOG_DEBUG("Dropping expired request! sequence: {}", message.getSequence());
+          ServerMetrics::get().expired_requests.add();
+          message_queue_.enqueueResponseMessage(message.respond(http::serviceUnavailableResponse()));
           return;
         }
-        else
-          logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, fmt::format("Send successful! Msg: {}", response.value().getMessageString()));
-      }
+        handler(message);
+      };
     }
+
+    worker_pool_ = std::make_unique<concurrency::WorkerPool>(message_queue_, std::move(handler), number_workers);
+    worker_pool_->start();
   }
 
   /// @class Socket
-  /// @name sendResponseThreaded
-  /// @brief task executed by a thread to retrieve messages from the respond queue and sending the via the provided socket
+  /// @name routeResponse
+  /// @brief Delivers a response straight to the outbound buffer of the connection it belongs to. The write is
+  ///        performed by the reactor owning the connection
+  /// @param[in] message : response addressed by its connection handle
   /// @throws None
-  void Socket::sendResponseThreaded()
+  void Socket::routeResponse(container::message_queue::Message &&message)
   {
-    while (true)
+    const container::message_queue::ConnectionHandle connection = message.getConnection();
+    if (!connection.isValid() || connection.getReactor() >= reactors_.size())
     {
-      container::message_queue::Message response{message_queue_.retrieveResponseMessage()};
-      {
-        std::lock_guard<std::mutex> g_shutdown_lock(shutdown_mutex_);
-        if (isShutdownOngoing(g_shutdown_lock))
-        {
-          logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, "Shutdown signal received");
-          return;
-        }
-      }
-      const int bytes_sent = send(response.getSocket(), response.getMessageString().c_str(), response.getMessageString().length(), MSG_NOSIGNAL);
-      if (bytes_sent != response.getMessageString().length())
-      {
-        logging::Logger::getInstance().log(logging::LogLevel::INFO, LOC, "Send failed! Stopping listening thread");
-        return;
-      }
-      else
-        logging::Logger::getInstance().log(logging::LogLevel::DEBUG, LOC, fmt::format("Send successful! Msg: {}", response.getMessageString()));
+      LOG_WARNING("Dropping response with invalid connection handle");
+      return;
     }
+
+    if (message.getReceivedTime() != std::chrono::steady_clock::time_point{})
+    {
+      const auto duration = std::chrono::steady_clock::now() - message.getReceivedTime();
+      ServerMetrics::get().request_duration.observe(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+
+    reactors_[connection.getReactor()]->sendResponse(connection, message.getSequence(), message.releaseSegments(), message.releaseFile());
   }
 
   /// @class Socket
   /// @name shutdownSocket
-  /// @brief End the communication on a socket by closing all file descriptors and joining all threads
+  /// @brief End the communication on a socket by stopping all reactors and closing all file descriptors
   void Socket::shutdownSocket()
   {
     const logging::Trace trace(__func__);
-    logging::Logger::getInstance().log(logging::LogLevel::DEBUG,
-                                       LOC,
-                                       fmt::format("Number of thread contexts: {}", connections_.size()));
-    shutdown_mutex_.lock();
-    shutdown_ = true;
-    shutdown_mutex_.unlock();
-
-    socket_ = -1;
+    shutdown_.store(true, std::memory_order_release);
 
     message_queue_.shutdown();
 
-    std::for_each(connections_.begin(), connections_.end(),
-                  [](const ConnectionManager &connection_manager) {
-                    shutdown(connection_manager.getAcceptedSocket(), SHUT_RDWR);
-                  });
+    if (worker_pool_)
+      worker_pool_->shutdown();
+
+    for (auto& reactor : reactors_)
+    {
+      reactor->stop();
+    }
+
+    closeSocket();
   }
 
-  bool Socket::isShutdownOngoing(const std::lock_guard<std::mutex>&) const
+  bool Socket::isShutdownOngoing() const
   {
-    return shutdown_;
+    return shutdown_.load(std::memory_order_acquire);
   }
 };
\ No newline at end of file
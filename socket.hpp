@@ -10,76 +10,54 @@
 #include "trace.hpp"
 #include "socketfiledescriptor.hpp"
 #include "messagequeue.hpp"
+#include "reactor.hpp"
+#include "workerpool.hpp"
 
-#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
+#include <vector>
 
 namespace network::tcp
 {
-  class Socket
+  class Socket : public container::message_queue::ResponseRouter
   {
   private:
-    class ConnectionManager
-    {
-    private:
-      int accepted_socket_;
-      std::thread worker_;
+    static constexpr std::size_t DEFAULT_NUMBER_REACTORS{2};
 
-    public:
-      explicit ConnectionManager(int accepted_socket) : accepted_socket_(accepted_socket) {}
-
-      ~ConnectionManager()
-      {
-        const logging::Trace trace(__func__, fmt::format("worker thread TID: {}", logging::formatThreadId(worker_.get_id())));
-        if (!worker_.joinable())
-        {
-          logging::Logger::getInstance().log(logging::LogLevel::WARNING, fmt::format("worker thread not joinable! TID: {}", logging::formatThreadId(worker_.get_id())));
-          return;
-        }
-
-        worker_.join();
-      }
-
-      ConnectionManager(ConnectionManager&& other)  noexcept : accepted_socket_(other.accepted_socket_), worker_(std::move(other.worker_)) {}
-
-      [[nodiscard]] int getAcceptedSocket() const { return accepted_socket_; }
-
-      void start(std::function<void(void)> task)
-      {
-        worker_ = std::thread(std::move(task));
-        logging::Logger::getInstance().log(logging::LogLevel::DEBUG, fmt::format("Started worker thread (TID: {})", logging::formatThreadId(worker_.get_id())));
-      }
-    };
-
-    std::vector<ConnectionManager> connections_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    std::atomic<std::size_t> next_reactor_{0};
 
     network::ip::IPv4Address address_;
     unsigned short port_;
-    SocketFileDescriptor socket_;
-    std::mutex shutdown_mutex_;
-    bool shutdown_;
+    ListenMode listen_mode_;
+    std::vector<SocketFileDescriptor> listen_sockets_;
+    std::atomic<bool> shutdown_;
     sockaddr_in socketAddress_{};
     socklen_t socketAddressLen_;
-    std::thread listen_socket_thread_;
-    std::thread answer_thread_;
 
     container::message_queue::Queue& message_queue_;
+    std::unique_ptr<concurrency::WorkerPool> worker_pool_;
 
-    void openSocket();
-    void bindSocket();
+    [[nodiscard]] SocketFileDescriptor openSocket() const;
+    void bindSocket(int socket);
     void closeSocket();
 
-    [[nodiscard]] bool isShutdownOngoing(const std::lock_guard<std::mutex>& lock) const;
+    [[nodiscard]] bool isShutdownOngoing() const;
 
-    void acceptConnection(SocketFileDescriptor& accepted_socket);
-    void handleConnection(SocketFileDescriptor accepted_socket);
-    void sendResponseThreaded();
-    void listenSocketThreaded();
+    void dispatchConnection(SocketFileDescriptor accepted_socket, std::size_t reactor_index, std::size_t accepting_reactor);
   public:
-    Socket(const network::ip::IPv4Address &addr, unsigned short port,  container::message_queue::Queue& message_queue);
+    Socket(const network::ip::IPv4Address &addr, unsigned short port,  container::message_queue::Queue& message_queue,
+           IoBackend backend = IoBackend::EPOLL, ListenMode listen_mode = ListenMode::SINGLE_LISTENER,
+           std::size_t number_reactors = DEFAULT_NUMBER_REACTORS);
     ~Socket();
 
+    void routeResponse(container::message_queue::Message &&message) override;
+
     void listenSocket();
+    void startWorkerPool(concurrency::WorkerPool::Handler handler, std::size_t number_workers,
+                         std::chrono::milliseconds queue_time_budget = std::chrono::milliseconds{0});
     void shutdownSocket();
   };
 
@@ -0,0 +1,248 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "spanrecorder.hpp"
+#include "logger.hpp"
+
+#include <fmt/format.h>
+
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <unistd.h>
+
+namespace logging
+{
+  namespace
+  {
+    thread_local uint32_t span_depth{0};
+
+    int64_t steadyNanoseconds(const std::chrono::steady_clock::time_point time)
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    ///@brief Trace-event timestamps are microseconds, the fraction keeps the nanoseconds
+    void appendMicroseconds(std::string &out, const uint64_t nanoseconds)
+    {
+      fmt::format_to(std::back_inserter(out), "{}.{:03}", nanoseconds / 1000U, nanoseconds % 1000U);
+    }
+
+    void appendJsonString(std::string &out, const char* string)
+    {
+      out += '"';
+      for (; *string != '\0'; ++string)
+      {
+        const char c = *string;
+        if (c == '"' || c == '\\')
+          out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+          fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+        else
+          out += c;
+      }
+      out += '"';
+    }
+  }
+
+  /// @class SpanRecorder::ThreadSpans
+  /// @name ThreadSpans
+  /// @brief constructor
+  /// @param[in] capacity : number of spans kept
+  /// @param[in] id : thread-id shown in the viewer
+  /// @param[in] log_thread_id : thread-id printed by the Logger
+  /// @throws None
+  SpanRecorder::ThreadSpans::ThreadSpans(const std::size_t capacity, const uint32_t id, const std::size_t log_thread_id)
+      : spans(std::max<std::size_t>(capacity, 1)), id(id), log_thread_id(log_thread_id)
+  {}
+
+  thread_local std::shared_ptr<SpanRecorder::ThreadSpans> SpanRecorder::thread_spans_;
+
+  /// @class SpanRecorder
+  /// @name getInstance
+  /// @brief returns the process wide recorder
+  /// @throws None
+  SpanRecorder& SpanRecorder::getInstance()
+  {
+    static SpanRecorder instance;
+    return instance;
+  }
+
+  /// @class SpanRecorder
+  /// @name getThreadSpans
+  /// @brief Returns the ring of the calling thread, it is created and registered on first use. Rings of exited threads
+  ///        stay registered so their spans still show up in the trace
+  /// @throws None
+  SpanRecorder::ThreadSpans* SpanRecorder::getThreadSpans()
+  {
+    if (!thread_spans_)
+    {
+      std::lock_guard<std::mutex> guard(threads_mutex_);
+      auto spans = std::make_shared<ThreadSpans>(spans_per_thread_.load(std::memory_order_relaxed),
+                                                 static_cast<uint32_t>(threads_.size() + 1),
+                                                 formatThreadId(std::this_thread::get_id()));
+      threads_.push_back(spans);
+      thread_spans_ = std::move(spans);
+    }
+    return thread_spans_.get();
+  }
+
+  /// @class SpanRecorder
+  /// @name start
+  /// @brief Discards the spans recorded so far and starts recording
+  /// @param[in] spans_per_thread : ring size of threads recording their first span from now on
+  /// @throws None
+  void SpanRecorder::start(const std::size_t spans_per_thread)
+  {
+    spans_per_thread_.store(spans_per_thread, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> guard(threads_mutex_);
+      for (const auto& thread : threads_)
+      {
+        std::lock_guard<std::mutex> spans_guard(thread->mutex);
+        thread->next = 0;
+        thread->overwritten = 0;
+      }
+    }
+    origin_.store(steadyNanoseconds(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    recording_.store(true, std::memory_order_release);
+  }
+
+  /// @class SpanRecorder
+  /// @name stop
+  /// @brief Stops recording, spans still open are not recorded
+  /// @throws None
+  void SpanRecorder::stop()
+  {
+    recording_.store(false, std::memory_order_release);
+  }
+
+  /// @class SpanRecorder
+  /// @name enter
+  /// @brief Opens a span on the calling thread
+  /// @returns nesting depth of the new span
+  /// @throws None
+  uint32_t SpanRecorder::enter()
+  {
+    return span_depth++;
+  }
+
+  /// @class SpanRecorder
+  /// @name leave
+  /// @brief Closes the innermost span of the calling thread and stores it unless recording stopped in the meantime
+  /// @param[in] name : name of the span
+  /// @param[in] start : time the span was entered
+  /// @param[in] end : time the span was left
+  /// @param[in] depth : value returned by enter()
+  /// @throws None
+  void SpanRecorder::leave(const char* name, const std::chrono::steady_clock::time_point start,
+                           const std::chrono::steady_clock::time_point end, const uint32_t depth)
+  {
+    span_depth = depth;
+    if (!isRecording())
+      return;
+
+    const int64_t origin = origin_.load(std::memory_order_relaxed);
+    const int64_t start_nanoseconds = steadyNanoseconds(start);
+    // spans opened before start() are clipped to it
+    const uint64_t relative_start = start_nanoseconds > origin ? static_cast<uint64_t>(start_nanoseconds - origin) : 0;
+    const int64_t end_nanoseconds = std::max(steadyNanoseconds(end), origin);
+
+    ThreadSpans* thread = getThreadSpans();
+    std::lock_guard<std::mutex> guard(thread->mutex);
+    Span &span = thread->spans[thread->next % thread->spans.size()];
+    span = {name, relative_start, static_cast<uint64_t>(end_nanoseconds - origin) - relative_start, depth};
+    if (thread->next >= thread->spans.size())
+      ++thread->overwritten;
+    ++thread->next;
+  }
+
+  /// @class SpanRecorder
+  /// @name writeTrace
+  /// @brief Writes the spans recorded so far as trace-event JSON: one complete event per span plus the name of each
+  ///        thread, which is the thread-id the Logger prints
+  /// @param[out] out : output
+  /// @throws None
+  void SpanRecorder::writeTrace(std::ostream &out)
+  {
+    std::vector<std::shared_ptr<ThreadSpans>> threads;
+    {
+      std::lock_guard<std::mutex> guard(threads_mutex_);
+      threads = threads_;
+    }
+
+    const pid_t pid = getpid();
+    // written up front, a trace without any recording thread is still a valid document
+    out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    std::string json;
+    bool first{true};
+    std::vector<Span> spans;
+    for (const auto& thread : threads)
+    {
+      {
+        // copied so the thread is blocked only for the copy, not for the formatting
+        std::lock_guard<std::mutex> guard(thread->mutex);
+        const std::size_t count = std::min(thread->next, thread->spans.size());
+        const std::size_t oldest = thread->next - count;
+        spans.clear();
+        for (std::size_t i = 0; i < count; ++i)
+          spans.push_back(thread->spans[(oldest + i) % thread->spans.size()]);
+      }
+
+      if (!first)
+        json += ',';
+      first = false;
+      fmt::format_to(std::back_inserter(json), R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":"{}"}}}})",
+                     pid, thread->id, thread->log_thread_id);
+
+      for (const Span &span : spans)
+      {
+        json += R"(,{"name":)";
+        appendJsonString(json, span.name);
+        fmt::format_to(std::back_inserter(json), R"(,"ph":"X","pid":{},"tid":{},"ts":)", pid, thread->id);
+        appendMicroseconds(json, span.start);
+        json += R"(,"dur":)";
+        appendMicroseconds(json, span.duration);
+        fmt::format_to(std::back_inserter(json), R"(,"args":{{"depth":{}}}}})", span.depth);
+      }
+
+      out << json;
+      json.clear();
+    }
+    out << "]}\n";
+  }
+
+  /// @class SpanRecorder
+  /// @name writeTrace
+  /// @brief Writes the spans recorded so far as trace-event JSON to a file
+  /// @param[in] path : output file, replaced if it exists
+  /// @returns false if the file cannot be written
+  /// @throws None
+  bool SpanRecorder::writeTrace(const std::string &path)
+  {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+      return false;
+    writeTrace(out);
+    out.flush();
+    return static_cast<bool>(out);
+  }
+
+  /// @class SpanRecorder
+  /// @name getOverwrittenSpans
+  /// @brief Number of spans lost because the ring of their thread was full
+  /// @throws None
+  uint64_t SpanRecorder::getOverwrittenSpans()
+  {
+    uint64_t overwritten{0};
+    std::lock_guard<std::mutex> guard(threads_mutex_);
+    for (const auto& thread : threads_)
+    {
+      std::lock_guard<std::mutex> spans_guard(thread->mutex);
+      overwritten += thread->overwritten;
+    }
+    return overwritten;
+  }
+}
@@ -0,0 +1,94 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_SPANRECORDER_HPP
+#define WEBSERVER_SPANRECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace logging
+{
+  ///@brief Collects the scopes measured by Trace as spans in per-thread rings and writes them in the Chrome trace-event
+  ///       format (chrome://tracing, ui.perfetto.dev). Each thread only locks its own ring, which is contended only
+  ///       while a trace is written. Full rings overwrite their oldest spans, so a long run keeps its most recent part
+  class SpanRecorder
+  {
+  public:
+    static constexpr std::size_t DEFAULT_SPANS_PER_THREAD{1U << 16U};
+
+    struct Span
+    {
+      const char* name;       // must outlive the recorder, Trace passes __func__
+      uint64_t start;         // nanoseconds since the recording started
+      uint64_t duration;      // nanoseconds
+      uint32_t depth;         // number of enclosing spans on the same thread
+    };
+
+  private:
+    struct ThreadSpans
+    {
+      std::mutex mutex;
+      std::vector<Span> spans;
+      std::size_t next{0};
+      uint64_t overwritten{0};
+      const uint32_t id;                // small id for the viewer
+      const std::size_t log_thread_id;  // thread-id printed by the Logger
+
+      ThreadSpans(std::size_t capacity, uint32_t id, std::size_t log_thread_id);
+    };
+
+    std::atomic<bool> recording_{false};
+    std::atomic<std::size_t> spans_per_thread_{DEFAULT_SPANS_PER_THREAD};
+    std::atomic<int64_t> origin_{0};   // steady_clock nanoseconds at start()
+
+    std::mutex threads_mutex_;
+    std::vector<std::shared_ptr<ThreadSpans>> threads_;
+    static thread_local std::shared_ptr<ThreadSpans> thread_spans_;
+
+    SpanRecorder() = default;
+
+    ThreadSpans* getThreadSpans();
+
+  public:
+    static SpanRecorder& getInstance();
+
+    SpanRecorder(const SpanRecorder&) = delete;
+    SpanRecorder& operator=(const SpanRecorder&) = delete;
+
+    ///@brief Discards the spans recorded so far and starts recording
+    ///@param spans_per_thread : ring size of threads recording their first span from now on
+    void start(std::size_t spans_per_thread = DEFAULT_SPANS_PER_THREAD);
+
+    ///@brief Stops recording, the spans are kept until the next start()
+    void stop();
+
+    [[nodiscard]] bool isRecording() const { return recording_.load(std::memory_order_relaxed); }
+
+    ///@brief Opens a span on the calling thread, returns its nesting depth
+    static uint32_t enter();
+
+    ///@brief Closes the innermost span of the calling thread and stores it
+    void leave(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+               uint32_t depth);
+
+    ///@brief Writes the spans recorded so far as trace-event JSON. Can be called while recording
+    void writeTrace(std::ostream& out);
+
+    ///@returns false if the file cannot be written
+    bool writeTrace(const std::string& path);
+
+    ///@brief Number of spans overwritten because a ring was full
+    [[nodiscard]] uint64_t getOverwrittenSpans();
+  };
+}
+
+#endif //WEBSERVER_SPANRECORDER_HPP
@@ -0,0 +1,254 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "spanrecorder.hpp"
+#include "logger.hpp"
+
+#include <fmt/format.h>
+
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <unistd.h>
+
+namespace
+{
+  std::size_t failures{0};
+
+  void expect(const bool condition, const std::string &check)
+  {
+    if (!condition)
+    {
+      ++failures;
+      std::cerr << check << std::endl;
+    }
+  }
+
+  ///@brief Syntax check of a JSON document, enough to tell whether a viewer can load the trace
+  class JsonChecker
+  {
+  private:
+    std::string_view text_;
+    std::size_t position_{0};
+
+    void skipSpace()
+    {
+      while (position_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[position_])))
+        ++position_;
+    }
+
+    bool consume(char c)
+    {
+      skipSpace();
+      if (position_ >= text_.size() || text_[position_] != c)
+        return false;
+      ++position_;
+      return true;
+    }
+
+    bool literal(std::string_view word)
+    {
+      if (text_.substr(position_, word.size()) != word)
+        return false;
+      position_ += word.size();
+      return true;
+    }
+
+    bool string()
+    {
+      if (!consume('"'))
+        return false;
+      while (position_ < text_.size())
+      {
+        const char c = text_[position_++];
+        if (c == '"')
+          return true;
+        if (static_cast<unsigned char>(c) < 0x20)
+          return false;
+        if (c != '\\')
+          continue;
+        if (position_ >= text_.size())
+          return false;
+        const char escaped = text_[position_++];
+        if (escaped == 'u')
+        {
+          for (int i = 0; i < 4; ++i)
+          {
+            if (position_ >= text_.size() || !std::isxdigit(static_cast<unsigned char>(text_[position_++])))
+              return false;
+          }
+        }
+        else if (std::strchr("\"\\/bfnrt", escaped) == nullptr)
+          return false;
+      }
+      return false;
+    }
+
+    bool number()
+    {
+      const std::size_t start = position_;
+      if (position_ < text_.size() && text_[position_] == '-')
+        ++position_;
+      while (position_ < text_.size() && (std::isdigit(static_cast<unsigned char>(text_[position_])) || std::strchr(".eE+-", text_[position_])))
+        ++position_;
+      return position_ > start;
+    }
+
+    bool value()
+    {
+      skipSpace();
+      if (position_ >= text_.size())
+        return false;
+      switch (text_[position_])
+      {
+        case '{':
+          ++position_;
+          if (consume('}'))
+            return true;
+          do
+          {
+            if (!string() || !consume(':') || !value())
+              return false;
+          } while (consume(','));
+          return consume('}');
+        case '[':
+          ++position_;
+          if (consume(']'))
+            return true;
+          do
+          {
+            if (!value())
+              return false;
+          } while (consume(','));
+          return consume(']');
+        case '"':
+          return string();
+        case 't':
+          return literal("true");
+        case 'f':
+          return literal("false");
+        case 'n':
+          return literal("null");
+        default:
+          return number();
+      }
+    }
+
+  public:
+    explicit JsonChecker(std::string_view text) : text_(text) {}
+
+    bool isValid()
+    {
+      if (!value())
+        return false;
+      skipSpace();
+      return position_ == text_.size();
+    }
+  };
+
+  std::string writeTrace()
+  {
+    std::ostringstream out;
+    logging::SpanRecorder::getInstance().writeTrace(out);
+    return out.str();
+  }
+
+  ///@brief Records a span of the given duration on the calling thread, starting after the recording started
+  void recordSpan(const char* name, uint32_t depth, std::chrono::nanoseconds duration)
+  {
+    const auto start = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    logging::SpanRecorder::getInstance().leave(name, start, start + duration, depth);
+  }
+
+  std::string threadName(const int pid, const uint32_t tid, const std::size_t log_thread_id)
+  {
+    return fmt::format(R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":"{}"}}}})", pid, tid, log_thread_id);
+  }
+
+  std::string spanPrefix(std::string_view json_name, const int pid, const uint32_t tid)
+  {
+    return fmt::format(R"({{"name":{},"ph":"X","pid":{},"tid":{},"ts":)", json_name, pid, tid);
+  }
+}
+
+// Records spans with known names, depths and durations and checks the trace-event JSON written for them
+int main()
+{
+  logging::SpanRecorder& recorder = logging::SpanRecorder::getInstance();
+  const int pid = getpid();
+
+  // no thread recorded anything yet
+  expect(writeTrace() == "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}\n", "empty trace: " + writeTrace());
+
+  static constexpr const char* NAMES[]{"s0", "s1", "s2", "s3", "s4", "s5"};
+  recorder.start(4);
+  std::size_t first_thread{0};
+  std::thread([&first_thread] {
+    first_thread = logging::formatThreadId(std::this_thread::get_id());
+    for (uint32_t i = 0; i < std::size(NAMES); ++i)
+      recordSpan(NAMES[i], i % 3, std::chrono::nanoseconds((i + 1) * 1000 + 1));
+  }).join();
+
+  std::size_t second_thread{0};
+  std::thread([&second_thread] {
+    second_thread = logging::formatThreadId(std::this_thread::get_id());
+    recordSpan("quote\" backslash\\ newline\n", 0, std::chrono::microseconds(1234567));
+  }).join();
+  recorder.stop();
+
+  // stopped, nothing is recorded anymore
+  std::thread([] { recordSpan("late", 0, std::chrono::nanoseconds(1)); }).join();
+
+  const std::string trace = writeTrace();
+  expect(JsonChecker(trace).isValid(), "trace is no valid JSON: " + trace);
+  expect(trace.find(threadName(pid, 1, first_thread)) != std::string::npos, "thread name of the first thread missing");
+  expect(trace.find(threadName(pid, 2, second_thread)) != std::string::npos, "thread name of the second thread missing");
+
+  // the ring of four keeps the newest spans in order, the two oldest are overwritten
+  std::size_t previous{0};
+  for (uint32_t i = 0; i < std::size(NAMES); ++i)
+  {
+    const std::string event = spanPrefix(fmt::format("\"{}\"", NAMES[i]), pid, 1);
+    const std::size_t found = trace.find(event);
+    if (i < 2)
+    {
+      expect(found == std::string::npos, fmt::format("overwritten span {} in the trace", NAMES[i]));
+      continue;
+    }
+
+    expect(found != std::string::npos && found > previous, fmt::format("span {} missing or out of order", NAMES[i]));
+    const std::string tail = fmt::format(R"(,"dur":{}.001,"args":{{"depth":{}}}}})", i + 1, i % 3);
+    expect(found != std::string::npos && trace.find(tail, found) == trace.find(",\"dur\"", found), fmt::format("duration or depth of span {} wrong", NAMES[i]));
+    previous = found;
+  }
+  expect(recorder.getOverwrittenSpans() == 2, fmt::format("overwritten spans: expected 2 got {}", recorder.getOverwrittenSpans()));
+
+  const std::size_t escaped = trace.find(spanPrefix(R"("quote\" backslash\\ newline\u000a")", pid, 2));
+  expect(escaped != std::string::npos, "escaped span name missing");
+  expect(escaped != std::string::npos && trace.find(R"(,"dur":1234567.000,"args":{"depth":0}})", escaped) != std::string::npos,
+         "duration of the escaped span wrong");
+  expect(trace.find("late") == std::string::npos, "span recorded after stop()");
+
+  // starting again discards the spans, the threads stay known
+  recorder.start();
+  recorder.stop();
+  const std::string restarted = writeTrace();
+  expect(JsonChecker(restarted).isValid(), "restarted trace is no valid JSON: " + restarted);
+  expect(restarted.find("\"ph\":\"X\"") == std::string::npos, "spans kept after start()");
+  expect(restarted.find(threadName(pid, 1, first_thread)) != std::string::npos, "threads forgotten after start()");
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,399 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "staticfiles.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+
+#include <linux/openat2.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace network::http
+{
+  namespace
+  {
+    constexpr std::string_view INDEX_FILE{"index.html"};
+
+    int decodeHexDigit(const char c)
+    {
+      if (c >= '0' && c <= '9')
+        return c - '0';
+      if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+      return -1;
+    }
+
+    ///@brief Opens a path below a directory. Unlike openat(), symlinks and ".." may not lead out of the directory
+    ///       and magic links (/proc/self/fd/...) are refused, so a link inside the document root cannot serve files
+    ///       outside of it
+    int openBeneath(const int dir_fd, const char* path)
+    {
+      open_how how{};
+      how.flags = O_RDONLY | O_CLOEXEC;
+      how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+      while (true)
+      {
+        const auto fd = static_cast<int>(syscall(SYS_openat2, dir_fd, path, &how, sizeof(how)));
+        // EAGAIN: a concurrent rename raced the lookup
+        if (fd >= 0 || (errno != EAGAIN && errno != EINTR))
+          return fd;
+      }
+    }
+
+    ///@brief Maps a file read-only. The mapping is released together with the last slice referring to it
+    container::buffer::BufferSlice mapFile(const int fd, const std::size_t size)
+    {
+      void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED)
+        return {};
+
+      std::shared_ptr<const void> owner(mapping, [size](const void* address) {
+        munmap(const_cast<void*>(address), size);
+      });
+      return {std::move(owner), {static_cast<const char*>(mapping), size}};
+    }
+  }
+
+  /// @class OpenFile
+  /// @name OpenFile
+  /// @brief constructor, takes ownership of the file descriptor and maps small files
+  /// @param[in] fd : open regular file
+  /// @param[in] file_stat : metadata of the file
+  /// @param[in] index : file is the index.html of the requested directory
+  /// @throws None
+  OpenFile::OpenFile(const int fd, const struct stat &file_stat, const bool index) : fd_(fd), stat_(file_stat), index_(index)
+  {
+    // a failed mapping is no error, the file is sent with sendfile() instead
+    if (getSize() > 0 && getSize() <= FileCache::MAP_LIMIT)
+      mapping_ = mapFile(fd_, getSize());
+  }
+
+  /// @class OpenFile
+  /// @name ~OpenFile
+  /// @brief destructor which closes the file. The mapping may outlive it
+  /// @throws None
+  OpenFile::~OpenFile()
+  {
+    close(fd_);
+  }
+
+  /// @class OpenFile
+  /// @name matches
+  /// @brief Compares the metadata taken at opening with the current one
+  /// @param[in] file_stat : current metadata of the path
+  /// @returns true if the path still refers to this file, unchanged
+  /// @throws None
+  bool OpenFile::matches(const struct stat &file_stat) const
+  {
+    return file_stat.st_dev == stat_.st_dev && file_stat.st_ino == stat_.st_ino && file_stat.st_size == stat_.st_size &&
+           file_stat.st_mtim.tv_sec == stat_.st_mtim.tv_sec && file_stat.st_mtim.tv_nsec == stat_.st_mtim.tv_nsec;
+  }
+
+  /// @class OpenFile
+  /// @name getRegion
+  /// @brief The whole file as a region for sendfile()
+  /// @throws None
+  container::buffer::FileRegion OpenFile::getRegion() const
+  {
+    return {shared_from_this(), fd_, 0, getSize()};
+  }
+
+  /// @class FileCache
+  /// @name FileCache
+  /// @brief constructor, opens the document root
+  /// @param[in] document_root : directory the paths are resolved in
+  /// @param[in] capacity : maximum number of open files kept in the cache
+  /// @throws logging::SystemError, logging::Error
+  FileCache::FileCache(const std::string &document_root, const std::size_t capacity) : capacity_(capacity)
+  {
+    const logging::Trace trace(__func__);
+    root_fd_ = ::open(document_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd_ < 0)
+    {
+      throw logging::SystemError(LOC, fmt::format("Opening document root {} failed", document_root));
+    }
+
+    const int probe_fd = openBeneath(root_fd_, ".");
+    if (probe_fd < 0)
+    {
+      const int probe_error = errno;
+      close(root_fd_);
+      errno = probe_error;
+      if (probe_error == ENOSYS)
+        throw logging::Error(LOC, "Serving static files requires openat2 (Linux 5.6+)");
+      throw logging::SystemError(LOC, fmt::format("Opening document root {} failed", document_root));
+    }
+    close(probe_fd);
+  }
+
+  /// @class FileCache
+  /// @name ~FileCache
+  /// @brief destructor which closes the document root. Cached files close once no response uses them anymore
+  /// @throws None
+  FileCache::~FileCache()
+  {
+    close(root_fd_);
+  }
+
+  /// @class FileCache
+  /// @name open
+  /// @brief Looks a file up in the cache and opens it on a miss or if it changed since it was opened
+  /// @param[in] path : path relative to the document root, as returned by resolveTargetPath()
+  /// @returns the open file, nullptr if there is no regular file or index.html at path
+  /// @throws None
+  std::shared_ptr<const OpenFile> FileCache::open(const std::string &path)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<const OpenFile> cached;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      const auto it = index_.find(path);
+      if (it != index_.end())
+      {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        if (now - it->second->validated < REVALIDATE_INTERVAL)
+          return it->second->file;
+        cached = it->second->file;
+      }
+    }
+
+    // the file system calls run without holding the lock
+    if (cached)
+    {
+      const std::string file_path = cached->isIndex() ? (path.empty() ? std::string{INDEX_FILE} : fmt::format("{}/{}", path, INDEX_FILE)) : path;
+      struct stat file_stat{};
+      if (fstatat(root_fd_, file_path.c_str(), &file_stat, 0) == 0 && S_ISREG(file_stat.st_mode) && cached->matches(file_stat))
+      {
+        insert(path, cached, now);
+        return cached;
+      }
+    }
+
+    std::shared_ptr<const OpenFile> file = openFile(path);
+    if (file)
+    {
+      insert(path, file, now);
+    }
+    else if (cached)
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      const auto it = index_.find(path);
+      if (it != index_.end())
+      {
+        const auto entry = it->second;
+        index_.erase(it);
+        entries_.erase(entry);
+      }
+    }
+    return file;
+  }
+
+  /// @class FileCache
+  /// @name openFile
+  /// @brief Opens a regular file below the document root, or the index.html of a directory. Paths resolving outside
+  ///        of the root, e.g. through a symlink, are treated as missing
+  /// @returns the open file, nullptr if there is none
+  /// @throws None
+  std::shared_ptr<const OpenFile> FileCache::openFile(const std::string &path) const
+  {
+    int fd = openBeneath(root_fd_, path.empty() ? "." : path.c_str());
+    if (fd < 0)
+      return nullptr;
+
+    struct stat file_stat{};
+    const bool index = fstat(fd, &file_stat) == 0 && S_ISDIR(file_stat.st_mode);
+    if (index)
+    {
+      const int index_fd = openBeneath(fd, INDEX_FILE.data());
+      close(fd);
+      fd = index_fd;
+      if (fd < 0 || fstat(fd, &file_stat) != 0)
+        file_stat.st_mode = 0;
+    }
+
+    if (fd >= 0 && !S_ISREG(file_stat.st_mode))
+    {
+      close(fd);
+      fd = -1;
+    }
+
+    if (fd < 0)
+      return nullptr;
+
+    return std::make_shared<const OpenFile>(fd, file_stat, index);
+  }
+
+  /// @class FileCache
+  /// @name insert
+  /// @brief Adds or refreshes an entry as the most recently used one and evicts the least recently used entries
+  /// @throws None
+  void FileCache::insert(const std::string &path, const std::shared_ptr<const OpenFile> &file, const std::chrono::steady_clock::time_point now)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const auto it = index_.find(path);
+    if (it != index_.end())
+    {
+      it->second->file = file;
+      it->second->validated = now;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+
+    entries_.push_front({path, file, now});
+    index_.emplace(entries_.front().path, entries_.begin());
+
+    while (entries_.size() > capacity_)
+    {
+      index_.erase(entries_.back().path);
+      entries_.pop_back();
+    }
+  }
+
+  /// @class StaticFileHandler
+  /// @name StaticFileHandler
+  /// @brief constructor
+  /// @param[in] document_root : directory the request targets are resolved in
+  /// @param[in] cache_capacity : maximum number of open files kept in the cache
+  /// @throws logging::SystemError
+  StaticFileHandler::StaticFileHandler(const std::string &document_root, const std::size_t cache_capacity) : cache_(document_root, cache_capacity)
+  {}
+
+  /// @class StaticFileHandler
+  /// @name handle
+  /// @brief Answers a request with the file its target refers to. Small files are sent from their mapping together
+  ///        with the headers, larger ones with sendfile()
+  /// @param[in] request : parsed request
+  /// @returns 200 with the file, 404 if there is none, 405 for methods other than GET and HEAD
+  /// @throws None
+  Response StaticFileHandler::handle(const Request &request)
+  {
+    const bool head = request.getMethod() == "HEAD";
+    if (!head && request.getMethod() != "GET")
+    {
+      Response response{405};
+      response.addHeaderBlock(container::buffer::BufferSlice::fromStatic("Allow: GET, HEAD\r\n")).setConnection(request);
+      return response;
+    }
+
+    const std::optional<std::string> path = resolveTargetPath(request.getTarget());
+    const std::shared_ptr<const OpenFile> file = path ? cache_.open(*path) : nullptr;
+    if (!file)
+    {
+      Response response{path ? 404U : 400U};
+      response.setConnection(request);
+      return response;
+    }
+
+    Response response{200};
+    response.addHeaderBlock(container::buffer::BufferSlice::fromStatic(getContentTypeHeader(file->isIndex() ? INDEX_FILE : std::string_view{*path}))).setConnection(request);
+    if (file->getMapping().empty())
+      response.setBody(file->getRegion());
+    else
+      response.setBody(file->getMapping());
+
+    if (head)
+      response.omitBody();
+    return response;
+  }
+
+  /// @name resolveTargetPath
+  /// @brief Normalizes the path of an origin-form request target (RFC 9112 3.2.1)
+  /// @param[in] target : request target
+  /// @returns path relative to the document root without leading slash, empty for the root itself. Nothing if the
+  ///          target is not an absolute path, contains invalid escapes or NUL, or has ".." segments
+  /// @throws None
+  std::optional<std::string> resolveTargetPath(std::string_view target)
+  {
+    target = target.substr(0, target.find_first_of("?#"));
+    if (target.empty() || target.front() != '/')
+      return std::nullopt;
+
+    std::string path;
+    path.reserve(target.size());
+    std::string segment;
+    for (std::size_t i = 1; i <= target.size(); ++i)
+    {
+      if (i == target.size() || target[i] == '/')
+      {
+        if (segment == "..")
+          return std::nullopt;
+
+        if (!segment.empty() && segment != ".")
+        {
+          if (!path.empty())
+            path.push_back('/');
+          path.append(segment);
+        }
+        segment.clear();
+        continue;
+      }
+
+      char c = target[i];
+      if (c == '%')
+      {
+        const int high = i + 2 < target.size() ? decodeHexDigit(target[i + 1]) : -1;
+        const int low = high >= 0 ? decodeHexDigit(target[i + 2]) : -1;
+        if (low < 0)
+          return std::nullopt;
+
+        c = static_cast<char>(high * 16 + low);
+        i += 2;
+        // an encoded slash would join two segments behind the ".." check
+        if (c == '\0' || c == '/')
+          return std::nullopt;
+      }
+      segment.push_back(c);
+    }
+    return path;
+  }
+
+  /// @name getContentTypeHeader
+  /// @brief Media type by file extension
+  /// @param[in] path : file path
+  /// @returns static "Content-Type" header line, application/octet-stream for unknown extensions
+  /// @throws None
+  std::string_view getContentTypeHeader(std::string_view path)
+  {
+    const std::size_t slash = path.rfind('/');
+    const std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    const std::size_t dot = name.rfind('.');
+    const std::string_view extension = dot == std::string_view::npos ? std::string_view{} : name.substr(dot + 1);
+
+    struct MediaType
+    {
+      std::string_view extension;
+      std::string_view header;
+    };
+    static constexpr MediaType MEDIA_TYPES[]{
+      {"html", "Content-Type: text/html; charset=utf-8\r\n"},
+      {"htm",  "Content-Type: text/html; charset=utf-8\r\n"},
+      {"css",  "Content-Type: text/css; charset=utf-8\r\n"},
+      {"js",   "Content-Type: text/javascript; charset=utf-8\r\n"},
+      {"json", "Content-Type: application/json\r\n"},
+      {"txt",  "Content-Type: text/plain; charset=utf-8\r\n"},
+      {"svg",  "Content-Type: image/svg+xml\r\n"},
+      {"png",  "Content-Type: image/png\r\n"},
+      {"jpg",  "Content-Type: image/jpeg\r\n"},
+      {"jpeg", "Content-Type: image/jpeg\r\n"},
+      {"gif",  "Content-Type: image/gif\r\n"},
+      {"webp", "Content-Type: image/webp\r\n"},
+      {"ico",  "Content-Type: image/x-icon\r\n"},
+      {"wasm", "Content-Type: application/wasm\r\n"},
+      {"pdf",  "Content-Type: application/pdf\r\n"},
+      {"woff2", "Content-Type: font/woff2\r\n"},
+    };
+
+    for (const MediaType& media_type : MEDIA_TYPES)
+    {
+      if (equalsIgnoreCase(extension, media_type.extension))
+        return media_type.header;
+    }
+    return "Content-Type: application/octet-stream\r\n";
+  }
+}
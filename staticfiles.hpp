@@ -0,0 +1,118 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_STATICFILES_HPP
+#define WEBSERVER_STATICFILES_HPP
+
+#include "buffer.hpp"
+#include "httprequest.hpp"
+#include "httpresponse.hpp"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace network::http
+{
+  ///@brief Open regular file with the metadata taken when it was opened. Small files are mapped once, so their content
+  ///       goes out together with the headers in one gathering send; larger files are sent with sendfile()
+  class OpenFile : public std::enable_shared_from_this<OpenFile>
+  {
+  private:
+    int fd_;
+    struct stat stat_;
+    bool index_;
+    container::buffer::BufferSlice mapping_;
+
+  public:
+    OpenFile(int fd, const struct stat& file_stat, bool index = false);
+    ~OpenFile();
+
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    [[nodiscard]] std::size_t getSize() const { return static_cast<std::size_t>(stat_.st_size); }
+    [[nodiscard]] const struct stat& getStat() const { return stat_; }
+
+    ///@brief True if this is the index.html of the requested directory
+    [[nodiscard]] bool isIndex() const { return index_; }
+
+    ///@brief Whether the file at path still is this file with the same size and modification time
+    [[nodiscard]] bool matches(const struct stat& file_stat) const;
+
+    ///@brief Mapped content of a small file, empty for large files
+    [[nodiscard]] const container::buffer::BufferSlice& getMapping() const { return mapping_; }
+
+    ///@brief The whole file as a region which keeps this file open until it is sent
+    [[nodiscard]] container::buffer::FileRegion getRegion() const;
+  };
+
+  ///@brief Bounded LRU cache of open files below a document root. Saves open() and fstat() for every request; entries
+  ///       are revalidated with a stat() at most every REVALIDATE_INTERVAL, so changed files are picked up. Evicted files
+  ///       stay open until the last response sending them is done. Thread safe
+  class FileCache
+  {
+  public:
+    static constexpr std::size_t DEFAULT_CAPACITY{1024};
+    static constexpr std::size_t MAP_LIMIT{64 * 1024};
+    static constexpr std::chrono::seconds REVALIDATE_INTERVAL{1};
+
+  private:
+    struct Entry
+    {
+      std::string path;
+      std::shared_ptr<const OpenFile> file;
+      std::chrono::steady_clock::time_point validated;
+    };
+
+    int root_fd_;
+    const std::size_t capacity_;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+
+    [[nodiscard]] std::shared_ptr<const OpenFile> openFile(const std::string& path) const;
+    void insert(const std::string& path, const std::shared_ptr<const OpenFile>& file, std::chrono::steady_clock::time_point now);
+
+  public:
+    explicit FileCache(const std::string& document_root, std::size_t capacity = DEFAULT_CAPACITY);
+    ~FileCache();
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    ///@brief Opens a regular file by its path relative to the document root. A directory is served by its index.html.
+    ///       Returns nullptr if there is no such file
+    [[nodiscard]] std::shared_ptr<const OpenFile> open(const std::string& path);
+  };
+
+  ///@brief Serves GET and HEAD requests from a document root. File contents are never copied into a response
+  class StaticFileHandler
+  {
+  private:
+    FileCache cache_;
+
+  public:
+    explicit StaticFileHandler(const std::string& document_root, std::size_t cache_capacity = FileCache::DEFAULT_CAPACITY);
+
+    [[nodiscard]] Response handle(const Request& request);
+  };
+
+  ///@brief Turns a request target into a path relative to the document root: drops the query, decodes percent escapes
+  ///       and removes empty and "." segments. Returns nothing for targets leaving the root or containing NUL
+  std::optional<std::string> resolveTargetPath(std::string_view target);
+
+  ///@brief Complete "Content-Type" header line for the extension of a path
+  std::string_view getContentTypeHeader(std::string_view path);
+}
+
+#endif //WEBSERVER_STATICFILES_HPP
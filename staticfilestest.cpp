@@ -0,0 +1,84 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "staticfiles.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+  std::size_t failures{0};
+
+  void expect(network::http::FileCache &cache, const std::string &path, const bool served)
+  {
+    const bool opened = cache.open(path) != nullptr;
+    if (opened != served)
+    {
+      ++failures;
+      std::cerr << "\"" << path << "\": expected " << (served ? "served" : "refused") << std::endl;
+    }
+  }
+
+  void writeFile(const std::filesystem::path &path, const std::string &content)
+  {
+    std::ofstream(path) << content;
+  }
+}
+
+// Paths resolving outside the document root must not be served, however they get there
+int main()
+{
+  namespace fs = std::filesystem;
+  std::string directory_template = (fs::temp_directory_path() / "webserver_staticfilestest.XXXXXX").string();
+  if (mkdtemp(directory_template.data()) == nullptr)
+  {
+    std::cerr << "Creating a temporary directory failed" << std::endl;
+    return 1;
+  }
+
+  const fs::path directory{directory_template};
+  const fs::path root = directory / "root";
+  fs::create_directories(root / "sub");
+  fs::create_directories(root / "evil");
+  writeFile(directory / "outside.txt", "outside");
+  writeFile(root / "a.txt", "inside");
+  writeFile(root / "index.html", "<h1>root</h1>");
+  writeFile(root / "sub" / "index.html", "<p>sub</p>");
+  fs::create_symlink(root / "a.txt", root / "absolute_inner");
+  fs::create_symlink("a.txt", root / "inner");
+  fs::create_symlink("sub", root / "inner_dir");
+  fs::create_symlink(directory / "outside.txt", root / "leak");
+  fs::create_symlink("../outside.txt", root / "relative_leak");
+  fs::create_symlink("..", root / "parent");
+  fs::create_symlink(directory / "outside.txt", root / "evil" / "index.html");
+  fs::create_symlink("/proc/self/fd/0", root / "magic");
+
+  {
+    network::http::FileCache cache(root.string());
+    expect(cache, "a.txt", true);
+    expect(cache, "", true);
+    expect(cache, "sub", true);
+    expect(cache, "inner", true);
+    expect(cache, "inner_dir", true);
+    expect(cache, "absolute_inner", false);   // absolute links are resolved from the host root
+    expect(cache, "leak", false);
+    expect(cache, "relative_leak", false);
+    expect(cache, "parent/outside.txt", false);
+    expect(cache, "evil", false);
+    expect(cache, "magic", false);
+  }
+
+  fs::remove_all(directory);
+  if (failures != 0)
+  {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,250 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "timerwheel.hpp"
+
+#include <algorithm>
+
+namespace container
+{
+  namespace
+  {
+    ///@brief Rotates the slot bitmap right so that bit 0 corresponds to slot first
+    uint64_t rotateToSlot(const uint64_t bitmap, const uint64_t first)
+    {
+      return first == 0 ? bitmap : (bitmap >> first) | (bitmap << (64 - first));
+    }
+  }
+
+  /// @class TimerWheel
+  /// @name TimerWheel
+  /// @brief constructor
+  /// @param[in] resolution : length of a tick
+  /// @param[in] start : time of tick 0, e.g. the start of the event loop
+  /// @throws None
+  TimerWheel::TimerWheel(const Clock::duration resolution, const Clock::time_point start) : resolution_(resolution), start_(start)
+  {
+    for (auto& level : slots_)
+      level.fill(NO_NODE);
+  }
+
+  /// @class TimerWheel
+  /// @name toTick
+  /// @brief First tick at or after the given time
+  /// @throws None
+  uint64_t TimerWheel::toTick(const Clock::time_point time) const
+  {
+    if (time <= start_)
+      return 0;
+
+    return static_cast<uint64_t>(((time - start_).count() + resolution_.count() - 1) / resolution_.count());
+  }
+
+  /// @class TimerWheel
+  /// @name link
+  /// @brief Inserts a node into the slot covering its expiry relative to the current tick. Expiries in the past go
+  ///        into the slot of the current tick
+  /// @throws None
+  void TimerWheel::link(const uint32_t index)
+  {
+    Node& node = nodes_[index];
+    const uint64_t delta = std::min(std::max(node.expiry, current_tick_) - current_tick_, MAX_DELTA);
+    const uint64_t placement = current_tick_ + delta;
+
+    unsigned level{0};
+    while (level + 1 < NUMBER_LEVELS && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1))))
+      ++level;
+
+    const auto slot = static_cast<uint8_t>((placement >> (SLOT_BITS * level)) & SLOT_MASK);
+    node.level = static_cast<uint8_t>(level);
+    node.slot = slot;
+    node.previous = NO_NODE;
+    node.next = slots_[level][slot];
+    if (node.next != NO_NODE)
+      nodes_[node.next].previous = index;
+    slots_[level][slot] = index;
+    occupied_[level] |= uint64_t{1} << slot;
+  }
+
+  /// @class TimerWheel
+  /// @name unlink
+  /// @brief Removes a node from its slot
+  /// @throws None
+  void TimerWheel::unlink(const uint32_t index)
+  {
+    const Node& node = nodes_[index];
+    if (node.previous != NO_NODE)
+      nodes_[node.previous].next = node.next;
+    else
+      slots_[node.level][node.slot] = node.next;
+
+    if (node.next != NO_NODE)
+      nodes_[node.next].previous = node.previous;
+
+    if (slots_[node.level][node.slot] == NO_NODE)
+      occupied_[node.level] &= ~(uint64_t{1} << node.slot);
+  }
+
+  /// @class TimerWheel
+  /// @name release
+  /// @brief Returns an unlinked node to the free list
+  /// @throws None
+  void TimerWheel::release(const uint32_t index)
+  {
+    Node& node = nodes_[index];
+    node.active = false;
+    ++node.generation;
+    free_nodes_.push_back(index);
+    --size_;
+  }
+
+  /// @class TimerWheel
+  /// @name cascade
+  /// @brief Moves the timers of the slot of a level which comes up at the given tick to the levels below. A level
+  ///        starting a new rotation first takes the next slot of the level above
+  /// @param[in] level : level 1 or above
+  /// @param[in] tick : tick being processed, a multiple of the range of the level below
+  /// @throws None
+  void TimerWheel::cascade(const unsigned level, const uint64_t tick)
+  {
+    const auto slot = static_cast<std::size_t>((tick >> (SLOT_BITS * level)) & SLOT_MASK);
+    if (slot == 0 && level + 1 < NUMBER_LEVELS)
+      cascade(level + 1, tick);
+
+    uint32_t index = slots_[level][slot];
+    slots_[level][slot] = NO_NODE;
+    occupied_[level] &= ~(uint64_t{1} << slot);
+    while (index != NO_NODE)
+    {
+      const uint32_t next = nodes_[index].next;
+      link(index);
+      index = next;
+    }
+  }
+
+  /// @class TimerWheel
+  /// @name schedule
+  /// @brief Schedules a timer
+  /// @param[in] expiry : the timer expires once this time passed, rounded up to the resolution
+  /// @param[in] payload : handed back by advance(), e.g. the id of a connection
+  /// @returns handle for cancel()
+  /// @throws None
+  TimerWheel::Handle TimerWheel::schedule(const Clock::time_point expiry, const uint64_t payload)
+  {
+    uint32_t index;
+    if (!free_nodes_.empty())
+    {
+      index = free_nodes_.back();
+      free_nodes_.pop_back();
+    }
+    else
+    {
+      index = static_cast<uint32_t>(nodes_.size());
+      nodes_.emplace_back();
+    }
+
+    Node& node = nodes_[index];
+    node.expiry = toTick(expiry);
+    node.payload = payload;
+    node.active = true;
+    link(index);
+    ++size_;
+    return (static_cast<uint64_t>(node.generation) << 32U) | (index + 1U);
+  }
+
+  /// @class TimerWheel
+  /// @name cancel
+  /// @brief Removes a timer
+  /// @param[in] handle : handle returned by schedule(), NO_TIMER is ignored
+  /// @returns false if the timer already expired or was cancelled
+  /// @throws None
+  bool TimerWheel::cancel(const Handle handle)
+  {
+    if (handle == NO_TIMER)
+      return false;
+
+    const auto index = static_cast<uint32_t>((handle & 0xFFFFFFFFU) - 1U);
+    if (index >= nodes_.size() || !nodes_[index].active || nodes_[index].generation != static_cast<uint32_t>(handle >> 32U))
+      return false;
+
+    unlink(index);
+    release(index);
+    return true;
+  }
+
+  /// @class TimerWheel
+  /// @name advance
+  /// @brief Processes all ticks up to now. Runs of ticks with an empty lowest level are skipped up to the next
+  ///        cascade, so a long wait costs at most one step per rotation of the lowest level
+  /// @param[in] now : current time
+  /// @param[out] expired : the payloads of the expired timers are appended
+  /// @throws None
+  void TimerWheel::advance(const Clock::time_point now, std::vector<uint64_t> &expired)
+  {
+    if (now < start_)
+      return;
+
+    const auto target = static_cast<uint64_t>((now - start_) / resolution_);
+    while (current_tick_ <= target)
+    {
+      if (size_ == 0)
+      {
+        current_tick_ = target + 1;
+        break;
+      }
+
+      const uint64_t tick = current_tick_;
+      if ((tick & SLOT_MASK) == 0)
+        cascade(1, tick);
+
+      if (occupied_[0] == 0)
+      {
+        current_tick_ = std::min(target, tick | SLOT_MASK) + 1;
+        continue;
+      }
+
+      const auto slot = static_cast<std::size_t>(tick & SLOT_MASK);
+      uint32_t index = slots_[0][slot];
+      slots_[0][slot] = NO_NODE;
+      occupied_[0] &= ~(uint64_t{1} << slot);
+      while (index != NO_NODE)
+      {
+        const uint32_t next = nodes_[index].next;
+        expired.push_back(nodes_[index].payload);
+        release(index);
+        index = next;
+      }
+      ++current_tick_;
+    }
+  }
+
+  /// @class TimerWheel
+  /// @name getNextExpiry
+  /// @brief Finds the first occupied slot of every level with the bitmaps. For the lowest level that is the expiry
+  ///        itself, for the levels above the tick their slot is cascaded, which is a lower bound of their expiries
+  /// @throws None
+  std::optional<TimerWheel::Clock::time_point> TimerWheel::getNextExpiry() const
+  {
+    if (size_ == 0)
+      return std::nullopt;
+
+    uint64_t next_tick{UINT64_MAX};
+    if (occupied_[0] != 0)
+      next_tick = current_tick_ + static_cast<uint64_t>(__builtin_ctzll(rotateToSlot(occupied_[0], current_tick_ & SLOT_MASK)));
+
+    for (unsigned level = 1; level < NUMBER_LEVELS; ++level)
+    {
+      if (occupied_[level] == 0)
+        continue;
+
+      // slots are visited from the first one cascaded at or after the current tick
+      const unsigned shift = SLOT_BITS * level;
+      const uint64_t rotation = (current_tick_ + (uint64_t{1} << shift) - 1) >> shift;
+      const auto offset = static_cast<uint64_t>(__builtin_ctzll(rotateToSlot(occupied_[level], rotation & SLOT_MASK)));
+      next_tick = std::min(next_tick, (rotation + offset) << shift);
+    }
+
+    return start_ + resolution_ * static_cast<Clock::rep>(next_tick);
+  }
+}
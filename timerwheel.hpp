@@ -0,0 +1,87 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_TIMERWHEEL_HPP
+#define WEBSERVER_TIMERWHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace container
+{
+  ///@brief Hierarchical timing wheel: NUMBER_LEVELS wheels of NUMBER_SLOTS slots, every level counting in steps of
+  ///       the full rotation of the level below. A timer goes into the lowest level whose range covers it and moves
+  ///       down a level whenever its slot comes up, so scheduling and cancelling are O(1) and expiring costs O(1) per
+  ///       timer. Timers never fire early, but up to one resolution late. Not thread-safe, owned by one reactor
+  class TimerWheel
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    ///@brief Identifies a scheduled timer. Cancelling it after it expired or was cancelled is a no-op
+    using Handle = uint64_t;
+    static constexpr Handle NO_TIMER{0};
+
+  private:
+    static constexpr unsigned SLOT_BITS{6};
+    static constexpr std::size_t NUMBER_SLOTS{std::size_t{1} << SLOT_BITS};
+    static constexpr uint64_t SLOT_MASK{NUMBER_SLOTS - 1};
+    static constexpr unsigned NUMBER_LEVELS{4};
+    // timers further out are parked in the top level and cascaded again
+    static constexpr uint64_t MAX_DELTA{(uint64_t{1} << (SLOT_BITS * NUMBER_LEVELS)) - 1};
+    static constexpr uint32_t NO_NODE{UINT32_MAX};
+
+    struct Node
+    {
+      uint64_t expiry{0};       // tick
+      uint64_t payload{0};
+      uint32_t generation{0};   // incremented on release, invalidates old handles
+      uint32_t previous{NO_NODE};
+      uint32_t next{NO_NODE};
+      uint8_t level{0};
+      uint8_t slot{0};
+      bool active{false};
+    };
+
+    Clock::duration resolution_;
+    Clock::time_point start_;
+    uint64_t current_tick_{0};   // next tick to process
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+    std::array<std::array<uint32_t, NUMBER_SLOTS>, NUMBER_LEVELS> slots_{};
+    std::array<uint64_t, NUMBER_LEVELS> occupied_{};   // one bit per non-empty slot
+    std::size_t size_{0};
+
+    [[nodiscard]] uint64_t toTick(Clock::time_point time) const;
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(unsigned level, uint64_t tick);
+
+  public:
+    ///@param resolution : length of a tick
+    ///@param start : time of tick 0
+    TimerWheel(Clock::duration resolution, Clock::time_point start);
+
+    ///@brief Schedules a timer. The payload is handed back by advance() once the expiry time passed
+    Handle schedule(Clock::time_point expiry, uint64_t payload);
+
+    ///@brief Removes a timer. Returns false if it already expired or was cancelled
+    bool cancel(Handle handle);
+
+    ///@brief Processes all ticks up to now and appends the payloads of the expired timers
+    void advance(Clock::time_point now, std::vector<uint64_t>& expired);
+
+    ///@brief Time the next call to advance() may expire a timer or move one down a level, empty if no timer is
+    ///       scheduled. Never later than the next expiry, so it can be used as wait timeout
+    [[nodiscard]] std::optional<Clock::time_point> getNextExpiry() const;
+
+    [[nodiscard]] std::size_t size() const { return size_; }
+  };
+}
+
+#endif //WEBSERVER_TIMERWHEEL_HPP
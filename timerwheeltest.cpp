@@ -0,0 +1,237 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "timerwheel.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  using container::TimerWheel;
+  using Clock = TimerWheel::Clock;
+
+  constexpr Clock::duration RESOLUTION{std::chrono::milliseconds(10)};
+  // one more than the range of the top level, see TimerWheel::MAX_DELTA
+  constexpr uint64_t WHEEL_RANGE{uint64_t{1} << 24U};
+
+  std::size_t failures{0};
+
+  void expect(const bool condition, const std::string &check)
+  {
+    if (!condition && ++failures <= 20)
+      std::cerr << check << std::endl;
+  }
+
+  ///@brief Drives a wheel with a fake clock and checks every expiry against a list of the scheduled timers
+  class Simulation
+  {
+  private:
+    struct Timer
+    {
+      Clock::time_point expiry;
+      Clock::time_point due;   // expiry, the time of scheduling for an expiry in the past
+      TimerWheel::Handle handle;
+    };
+
+    const Clock::time_point start_{Clock::time_point{} + std::chrono::hours(1)};
+    TimerWheel wheel_{RESOLUTION, start_};
+    Clock::time_point now_{start_};
+    uint64_t next_tick_{0};   // first tick the next advance() processes
+    std::map<uint64_t, Timer> timers_;   // by payload
+    std::vector<uint64_t> expired_;
+    uint64_t next_payload_{1};
+    std::mt19937_64 random_;
+
+    [[nodiscard]] Clock::time_point tickTime(uint64_t tick) const { return start_ + RESOLUTION * static_cast<Clock::rep>(tick); }
+
+    ///@brief Earliest time advance() may expire the timer: its expiry rounded up to a tick, the next tick for expiries
+    ///       in the past
+    [[nodiscard]] Clock::time_point getFiringTime(const Timer &timer) const
+    {
+      const auto ticks = static_cast<uint64_t>((timer.expiry - start_ + RESOLUTION - Clock::duration{1}) / RESOLUTION);
+      return tickTime(std::max(ticks, next_tick_));
+    }
+
+  public:
+    explicit Simulation(const uint64_t seed) : random_(seed) {}
+
+    [[nodiscard]] Clock::time_point now() const { return now_; }
+
+    [[nodiscard]] bool empty() const { return timers_.empty(); }
+
+    std::mt19937_64& random() { return random_; }
+
+    ///@brief Schedules a timer ticks resolutions from now, shifted by offset
+    void schedule(const uint64_t ticks, const Clock::duration offset)
+    {
+      const Clock::time_point expiry = now_ + RESOLUTION * static_cast<Clock::rep>(ticks) + offset;
+      const uint64_t payload = next_payload_++;
+      timers_[payload] = {expiry, std::max(expiry, now_), wheel_.schedule(expiry, payload)};
+    }
+
+    void cancelRandom()
+    {
+      if (timers_.empty())
+        return;
+
+      auto it = timers_.begin();
+      std::advance(it, static_cast<long>(random_() % timers_.size()));
+      expect(wheel_.cancel(it->second.handle), fmt::format("cancelling the live timer {} failed", it->first));
+      expect(!wheel_.cancel(it->second.handle), fmt::format("cancelling the timer {} twice succeeded", it->first));
+      timers_.erase(it);
+    }
+
+    ///@brief Moves the clock forward and checks which timers expired
+    void advanceTo(const Clock::time_point now)
+    {
+      now_ = std::max(now, now_);
+      expired_.clear();
+      wheel_.advance(now_, expired_);
+      next_tick_ = static_cast<uint64_t>((now_ - start_) / RESOLUTION) + 1;
+
+      for (const uint64_t payload : expired_)
+      {
+        const auto it = timers_.find(payload);
+        if (it == timers_.end())
+        {
+          expect(false, fmt::format("timer {} expired twice or after being cancelled", payload));
+          continue;
+        }
+
+        expect(it->second.expiry <= now_, fmt::format("timer {} expired {} ns early", payload, (it->second.expiry - now_).count()));
+        // the handle of an expired timer is stale
+        expect(!wheel_.cancel(it->second.handle), fmt::format("cancelling the expired timer {} succeeded", payload));
+        timers_.erase(it);
+      }
+
+      Clock::time_point first_firing{Clock::time_point::max()};
+      for (const auto& [payload, timer] : timers_)
+      {
+        expect(now_ - timer.due < RESOLUTION,
+               fmt::format("timer {} not expired {} ns after it was due", payload, (now_ - timer.due).count()));
+        first_firing = std::min(first_firing, getFiringTime(timer));
+      }
+
+      expect(wheel_.size() == timers_.size(), fmt::format("wheel holds {} timers, expected {}", wheel_.size(), timers_.size()));
+      const std::optional<Clock::time_point> next = wheel_.getNextExpiry();
+      expect(next.has_value() == !timers_.empty(), "getNextExpiry() does not match whether timers are scheduled");
+      if (next && !timers_.empty())
+      {
+        expect(*next <= first_firing, fmt::format("getNextExpiry() {} ns later than the next expiry", (*next - first_firing).count()));
+      }
+    }
+
+    ///@brief Sleeps like a reactor: until getNextExpiry(), at most the given time
+    void waitAtMost(const Clock::duration limit)
+    {
+      const std::optional<Clock::time_point> next = wheel_.getNextExpiry();
+      advanceTo(next ? std::min(*next, now_ + limit) : now_ + limit);
+    }
+  };
+
+  ///@brief Deltas at and around the ranges of the levels, where a timer changes level or cascades
+  const std::vector<uint64_t> BOUNDARY_TICKS{0, 1, 2, 62, 63, 64, 65, 127, 128, 4094, 4095, 4096, 4097, 8191, 8192, 262143, 262144,
+                                             262145, WHEEL_RANGE - 2, WHEEL_RANGE - 1, WHEEL_RANGE, WHEEL_RANGE + 1, 2 * WHEEL_RANGE + 5};
+
+  ///@brief Timers at every boundary, scheduled at several points of a rotation, expired by jumps of the clock
+  void checkBoundaries()
+  {
+    for (const uint64_t phase : {0U, 1U, 31U, 63U, 64U, 4095U, 4097U})
+    {
+      Simulation simulation(phase);
+      simulation.advanceTo(simulation.now() + RESOLUTION * static_cast<Clock::rep>(phase));
+      for (const uint64_t ticks : BOUNDARY_TICKS)
+      {
+        for (const Clock::duration offset : {-RESOLUTION / 2, Clock::duration{0}, Clock::duration{1}, RESOLUTION / 2})
+          simulation.schedule(ticks, offset);
+      }
+
+      // exact ticks, partial ticks and jumps over several levels
+      for (const Clock::duration step : {RESOLUTION, RESOLUTION / 3, RESOLUTION * 63, RESOLUTION * 4096, RESOLUTION * 100000,
+                                         RESOLUTION * static_cast<Clock::rep>(WHEEL_RANGE)})
+      {
+        for (int i = 0; i < 3 && !simulation.empty(); ++i)
+          simulation.advanceTo(simulation.now() + step);
+      }
+      for (int i = 0; i < 10 && !simulation.empty(); ++i)
+        simulation.advanceTo(simulation.now() + RESOLUTION * static_cast<Clock::rep>(WHEEL_RANGE));
+      expect(simulation.empty(), fmt::format("phase {}: timers never expired", phase));
+    }
+  }
+
+  ///@brief Random timers, cancellations and clock steps, with the clock following getNextExpiry() like a reactor
+  void checkRandom()
+  {
+    Simulation simulation(20261017);
+    std::mt19937_64& random = simulation.random();
+    for (int round = 0; round < 20000; ++round)
+    {
+      const uint64_t choice = random() % 16;
+      if (choice < 6)
+      {
+        uint64_t ticks = BOUNDARY_TICKS[random() % BOUNDARY_TICKS.size()];
+        if (choice < 3)
+          ticks = random() % (uint64_t{1} << (random() % 20));
+        simulation.schedule(ticks, std::chrono::nanoseconds(static_cast<Clock::rep>(random() % 20000000)) - RESOLUTION);
+      }
+      else if (choice < 8)
+        simulation.cancelRandom();
+      else if (choice < 12)
+        simulation.waitAtMost(RESOLUTION * static_cast<Clock::rep>(random() % 5000));
+      else
+        simulation.advanceTo(simulation.now() + std::chrono::nanoseconds(static_cast<Clock::rep>(random() % 100000000)));
+    }
+
+    for (int i = 0; i < 100000 && !simulation.empty(); ++i)
+      simulation.waitAtMost(RESOLUTION * static_cast<Clock::rep>(WHEEL_RANGE));
+    expect(simulation.empty(), "timers never expired");
+  }
+
+  void checkHandles()
+  {
+    const Clock::time_point start{Clock::time_point{} + std::chrono::hours(1)};
+    TimerWheel wheel(RESOLUTION, start);
+    expect(!wheel.cancel(TimerWheel::NO_TIMER), "cancelling NO_TIMER succeeded");
+    expect(!wheel.cancel(12345), "cancelling an unknown handle succeeded");
+
+    // a node reused by a new timer does not accept the handle of the old one
+    const TimerWheel::Handle first = wheel.schedule(start + RESOLUTION, 1);
+    expect(wheel.cancel(first), "cancelling a live timer failed");
+    const TimerWheel::Handle second = wheel.schedule(start + RESOLUTION, 2);
+    expect(first != second, "handles of a reused node are equal");
+    expect(!wheel.cancel(first), "cancelling with the stale handle of a reused node succeeded");
+    expect(wheel.size() == 1, "stale handle cancelled the new timer");
+
+    std::vector<uint64_t> expired;
+    wheel.advance(start + RESOLUTION, expired);
+    expect(expired == std::vector<uint64_t>{2}, "only the second timer expires");
+    expect(!wheel.cancel(second), "cancelling an expired timer succeeded");
+    expect(!wheel.getNextExpiry().has_value(), "getNextExpiry() of an empty wheel");
+  }
+}
+
+// Checks the timer wheel against a plain list of timers: no timer expires early, every timer expires within one
+// resolution, handles go stale and getNextExpiry() is never later than the next expiry
+int main()
+{
+  checkHandles();
+  checkBoundaries();
+  checkRandom();
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "passed" << std::endl;
+  return 0;
+}
@@ -6,43 +6,67 @@
 #define WEBSERVER_TRACE_HPP
 
 #include "logger.hpp"
+#include "spanrecorder.hpp"
 
 #include <fmt/core.h>
 
-#include <utility>
+#include <chrono>
+#include <string_view>
 
 namespace logging
 {
 
+  ///@brief Logs entering and leaving a scope together with the time spent in it and records it as a span while the
+  ///       SpanRecorder is running. Costs two flag checks if both are off at runtime and nothing if TRACE is compiled out
   class Trace
   {
-    static constexpr unsigned char INDENT_FACTOR{2};
+    static constexpr bool COMPILED_IN{LogLevel::TRACE >= MIN_LOG_LEVEL};
 
-    const std::chrono::high_resolution_clock::time_point enter_time;
-    const std::string functionName_;
+    static inline LogSite ENTER_SITE{LogLevel::TRACE, "", "", 0};
+    static inline LogSite LEAVE_SITE{LogLevel::TRACE, "", "", 0};
+
+    const char* functionName_;
+    const bool enabled_;
+    const bool recording_;
+    uint32_t depth_{0};
+    std::chrono::steady_clock::time_point enter_time_;
 
   public:
-    explicit Trace(std::string functionName) : Trace(std::move(functionName), "")
+    explicit Trace(const char* functionName) : Trace(functionName, {})
     {
     }
 
-    Trace(std::string functionName, std::string msg) : enter_time(std::chrono::high_resolution_clock::now()),
-                                                       functionName_(std::move(functionName))
+    Trace(const char* functionName, std::string_view msg) : functionName_(functionName),
+                                                            enabled_(COMPILED_IN && Logger::getInstance().isEnabled(LogLevel::TRACE)),
+                                                            recording_(COMPILED_IN && SpanRecorder::getInstance().isRecording())
     {
-      logging::Logger::getInstance().log(logging::LogLevel::TRACE,
-                                         fmt::format("ENTERING {}({})",
-                                                     functionName_,
-                                                     msg));
+      if (!enabled_ && !recording_)
+        return;
+
+      if (recording_)
+        depth_ = SpanRecorder::enter();
+      if (enabled_)
+        logging::Logger::getInstance().log(ENTER_SITE, "ENTERING {}({})", functionName_, msg);
+      enter_time_ = std::chrono::steady_clock::now();
     }
 
     ~Trace()
     {
-      const auto leave_time = std::chrono::high_resolution_clock::now();
-      const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(leave_time - enter_time).count();
-      logging::Logger::getInstance().log(logging::LogLevel::TRACE,
-                                         fmt::format("LEAVING {} ({}µs)",
-                                                     functionName_, duration));
+      if (!enabled_ && !recording_)
+        return;
+
+      const auto leave_time = std::chrono::steady_clock::now();
+      if (recording_)
+        SpanRecorder::getInstance().leave(functionName_, enter_time_, leave_time, depth_);
+      if (enabled_)
+      {
+        const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(leave_time - enter_time_).count();
+        logging::Logger::getInstance().log(LEAVE_SITE, "LEAVING {} ({}µs)", functionName_, duration);
+      }
     }
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
   };
 
 }
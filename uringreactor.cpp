@@ -0,0 +1,946 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "uringreactor.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+#include "servermetrics.hpp"
+#include "httprequest.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+
+namespace network::tcp
+{
+  namespace
+  {
+    template<typename T>
+    T* ringPointer(void* ring, unsigned offset)
+    {
+      return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+    int clearNonBlocking(int fd)
+    {
+      const int flags = fcntl(fd, F_GETFL);
+      if (flags < 0)
+        return flags;
+
+      return fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    }
+  }
+
+  /// @class UringReactor
+  /// @name UringReactor
+  /// @brief constructor, sets up the submission/completion rings and registers the provided buffer ring
+  /// @param[in] message_queue : queue which receives all messages read by this reactor
+  /// @param[in] index : index of the reactor, part of the handles of its connections
+  /// @throws logging::SystemError, logging::Error
+  UringReactor::UringReactor(container::message_queue::Queue &message_queue, const uint16_t index) : message_queue_(message_queue),
+                                                                                                    index_(index)
+  {
+    const logging::Trace trace(__func__);
+
+    // blocking on purpose: io_uring returns -EAGAIN for reads on O_NONBLOCK files instead of waiting
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd_ < 0)
+    {
+      throw logging::SystemError(LOC, "Creating eventfd failed");
+    }
+
+    try
+    {
+      setupRing();
+      setupBufferRing();
+    }
+    catch (...)
+    {
+      releaseRing();
+      close(wakeup_fd_);
+      throw;
+    }
+
+    armWakeup();
+  }
+
+  /// @class UringReactor
+  /// @name ~UringReactor
+  /// @brief destructor which stops the reactor thread, tears down the ring and closes all connections
+  /// @throws None
+  UringReactor::~UringReactor()
+  {
+    const logging::Trace trace(__func__);
+    stop();
+    releaseRing();
+    connections_.clear();
+    close(wakeup_fd_);
+  }
+
+  /// @class UringReactor
+  /// @name setupRing
+  /// @brief Creates the io_uring instance and maps its rings into user space
+  /// @throws logging::SystemError, logging::Error
+  void UringReactor::setupRing()
+  {
+    io_uring_params params{};
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (ring_fd_ < 0)
+    {
+      throw logging::SystemError(LOC, "io_uring_setup failed");
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+      throw logging::Error(LOC, "io_uring backend requires IORING_FEAT_SINGLE_MMAP (Linux 5.4+)");
+    }
+
+    // the timer wheel hands its next expiry to io_uring_enter() as wait timeout
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+      throw logging::Error(LOC, "io_uring backend requires IORING_FEAT_EXT_ARG (Linux 5.11+)");
+    }
+
+    // with IORING_FEAT_SINGLE_MMAP both rings live in one mapping
+    sq_ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                             params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+    {
+      sq_ring_ = nullptr;
+      throw logging::SystemError(LOC, "Mapping the io_uring rings failed");
+    }
+    cq_ring_ = sq_ring_;
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+      throw logging::SystemError(LOC, "Mapping the io_uring submission entries failed");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_head_ = ringPointer<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = ringPointer<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *ringPointer<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = ringPointer<unsigned>(sq_ring_, params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+
+    cq_head_ = ringPointer<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = ringPointer<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *ringPointer<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = ringPointer<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+  }
+
+  /// @class UringReactor
+  /// @name setupBufferRing
+  /// @brief Registers a ring of receive buffers the kernel picks from when a multishot recv completes
+  /// @throws logging::SystemError
+  void UringReactor::setupBufferRing()
+  {
+    buffer_ring_size_ = NUMBER_BUFFERS * sizeof(io_uring_buf);
+    buffer_ring_ = mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_ring_ == MAP_FAILED)
+    {
+      buffer_ring_ = nullptr;
+      throw logging::SystemError(LOC, "Allocating the buffer ring failed");
+    }
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+    registration.ring_entries = NUMBER_BUFFERS;
+    registration.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+      munmap(buffer_ring_, buffer_ring_size_);
+      buffer_ring_ = nullptr;
+      throw logging::SystemError(LOC, "Registering the provided buffer ring failed (Linux 5.19+ required)");
+    }
+
+    buffers_.resize(static_cast<std::size_t>(NUMBER_BUFFERS) * SIZE_BUFFER);
+    for (uint16_t buffer_id = 0; buffer_id < NUMBER_BUFFERS; ++buffer_id)
+    {
+      recycleBuffer(buffer_id);
+    }
+  }
+
+  /// @class UringReactor
+  /// @name releaseRing
+  /// @brief Unregisters the buffer ring, closes the io_uring instance and unmaps all rings
+  /// @throws None
+  void UringReactor::releaseRing()
+  {
+    if (buffer_ring_ != nullptr)
+    {
+      io_uring_buf_reg registration{};
+      registration.bgid = BUFFER_GROUP;
+      syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+      munmap(buffer_ring_, buffer_ring_size_);
+      buffer_ring_ = nullptr;
+    }
+
+    if (ring_fd_ >= 0)
+    {
+      close(ring_fd_);
+      ring_fd_ = -1;
+    }
+
+    if (sqes_ != nullptr)
+    {
+      munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+
+    if (sq_ring_ != nullptr)
+    {
+      munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = nullptr;
+      cq_ring_ = nullptr;
+    }
+  }
+
+  /// @class UringReactor
+  /// @name encodeUserData
+  /// @brief Packs the operation type and the connection id into the user_data field of an SQE
+  /// @throws None
+  uint64_t UringReactor::encodeUserData(Operation operation, uint64_t id)
+  {
+    return (static_cast<uint64_t>(operation) << 56) | (id & 0x00FFFFFFFFFFFFFF);
+  }
+
+  /// @class UringReactor
+  /// @name acquireSqe
+  /// @brief Returns the next free, zeroed submission entry. Submits pending entries first if the queue is full, until
+  ///        the kernel consumed at least one. A kernel refusing submissions because the completion queue is full
+  ///        (EBUSY) gets its completions taken off the ring first; they are handled later by the event loop, so no
+  ///        handler runs while the caller is in the middle of an operation
+  /// @throws logging::SystemError
+  io_uring_sqe *UringReactor::acquireSqe()
+  {
+    const unsigned tail = *sq_tail_;
+    while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+    {
+      const long result = syscall(__NR_io_uring_enter, ring_fd_, pending_submissions_, 0, 0, nullptr, 0);
+      if (result >= 0)
+      {
+        pending_submissions_ -= std::min<unsigned>(pending_submissions_, static_cast<unsigned>(result));
+        continue;
+      }
+
+      if (errno == EBUSY)
+        reapCompletions();
+      else if (errno != EINTR && errno != EAGAIN)
+        throw logging::SystemError(LOC, "Submitting to the io_uring failed");
+    }
+
+    const unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_submissions_;
+    return sqe;
+  }
+
+  /// @class UringReactor
+  /// @name submitAndWait
+  /// @brief Submits all prepared entries and waits for at least one completion with a single syscall
+  /// @param[in] timeout : returns without completion after this time, empty to wait for one
+  /// @throws None
+  void UringReactor::submitAndWait(const std::optional<std::chrono::nanoseconds> timeout)
+  {
+    __kernel_timespec wait_time{};
+    io_uring_getevents_arg argument{};
+    argument.sigmask_sz = _NSIG / 8;
+    if (timeout)
+    {
+      wait_time.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(*timeout).count();
+      wait_time.tv_nsec = (*timeout % std::chrono::seconds(1)).count();
+      argument.ts = reinterpret_cast<uint64_t>(&wait_time);
+    }
+
+    const long result = syscall(__NR_io_uring_enter, ring_fd_, pending_submissions_, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                &argument, sizeof(argument));
+    if (result < 0)
+    {
+      if (errno != EINTR && errno != EBUSY && errno != ETIME)
+        LOG_ERROR("io_uring_enter failed! ({})", strerror(errno));
+      return;
+    }
+
+    pending_submissions_ -= std::min<unsigned>(pending_submissions_, static_cast<unsigned>(result));
+  }
+
+  /// @class UringReactor
+  /// @name reapCompletions
+  /// @brief Moves all completions from the ring to completions_, which frees the ring for the kernel
+  /// @throws None
+  void UringReactor::reapCompletions()
+  {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+      completions_.push_back(cqes_[head & cq_mask_]);
+      ++head;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  /// @class UringReactor
+  /// @name recycleBuffer
+  /// @brief Returns a receive buffer to the provided buffer ring
+  /// @param[in] buffer_id : id of the buffer
+  /// @throws None
+  void UringReactor::recycleBuffer(uint16_t buffer_id)
+  {
+    auto* ring = static_cast<io_uring_buf*>(buffer_ring_);
+    io_uring_buf& buffer = ring[buffer_ring_tail_ & (NUMBER_BUFFERS - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(buffers_.data() + static_cast<std::size_t>(buffer_id) * SIZE_BUFFER);
+    buffer.len = SIZE_BUFFER;
+    buffer.bid = buffer_id;
+
+    // the ring tail overlays the reserved field of the first entry
+    ++buffer_ring_tail_;
+    __atomic_store_n(ringPointer<uint16_t>(buffer_ring_, offsetof(io_uring_buf, resv)), buffer_ring_tail_, __ATOMIC_RELEASE);
+  }
+
+  /// @class UringReactor
+  /// @name armWakeup
+  /// @brief Queues a read on the eventfd used by other threads to interrupt the reactor
+  /// @throws None
+  void UringReactor::armWakeup()
+  {
+    io_uring_sqe* sqe = acquireSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeup_counter_);
+    sqe->len = sizeof(wakeup_counter_);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->user_data = encodeUserData(Operation::WAKEUP, 0);
+  }
+
+  /// @class UringReactor
+  /// @name armAccept
+  /// @brief Queues a multishot accept on the listening socket
+  /// @throws None
+  void UringReactor::armAccept()
+  {
+    io_uring_sqe* sqe = acquireSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = encodeUserData(Operation::ACCEPT, 0);
+  }
+
+  /// @class UringReactor
+  /// @name armRecv
+  /// @brief Queues a multishot recv which selects its buffers from the provided buffer ring
+  /// @throws None
+  void UringReactor::armRecv(uint64_t id, UringConnection &connection)
+  {
+    io_uring_sqe* sqe = acquireSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection.socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = encodeUserData(Operation::RECV, id);
+    connection.recv_armed = true;
+  }
+
+  /// @class UringReactor
+  /// @name cancelRecv
+  /// @brief Cancels the multishot recv of a connection. It completes with -ECANCELED, buffers filled before are
+  ///        still delivered
+  /// @throws None
+  void UringReactor::cancelRecv(uint64_t id)
+  {
+    io_uring_sqe* sqe = acquireSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = encodeUserData(Operation::RECV, id);
+    sqe->user_data = encodeUserData(Operation::CANCEL, id);
+  }
+
+  /// @class UringReactor
+  /// @name submitSend
+  /// @brief Queues one gathering sendmsg for the front of the outbound queue. Only one send per connection is in
+  ///        flight, which keeps the responses in order; the rest follows once it completed
+  /// @throws None
+  void UringReactor::submitSend(uint64_t id, UringConnection &connection)
+  {
+    connection.send_header = {};
+    connection.send_header.msg_iov = connection.send_vectors;
+    connection.send_header.msg_iovlen = connection.protocol.getSendQueue().gather(connection.send_vectors, MAX_SEND_VECTORS);
+
+    io_uring_sqe* sqe = acquireSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection.socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&connection.send_header);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = encodeUserData(Operation::SEND, id);
+    connection.send_in_flight = true;
+  }
+
+  /// @class UringReactor
+  /// @name watchListeningSocket
+  /// @brief Starts a multishot accept on the listening socket. Accepted connections are passed to the handler
+  /// @param[in] listen_fd : listening socket
+  /// @param[in] handler : accept handler
+  /// @throws logging::SystemError
+  void UringReactor::watchListeningSocket(int listen_fd, AcceptHandler handler)
+  {
+    const logging::Trace trace(__func__);
+    if (clearNonBlocking(listen_fd) < 0)
+    {
+      throw logging::SystemError(LOC, "Switching listening socket to blocking mode failed");
+    }
+
+    post([this, listen_fd, handler = std::move(handler)]() {
+      listen_fd_ = listen_fd;
+      accept_handler_ = handler;
+      armAccept();
+    });
+  }
+
+  /// @class UringReactor
+  /// @name addConnection
+  /// @brief Hands an accepted connection over to this reactor. May be called from any thread
+  /// @param[in] socket : accepted socket
+  /// @throws None
+  void UringReactor::addConnection(SocketFileDescriptor socket)
+  {
+    auto shared_socket = std::make_shared<SocketFileDescriptor>(std::move(socket));
+    post([this, shared_socket]() { registerConnection(std::move(*shared_socket)); });
+  }
+
+  /// @class UringReactor
+  /// @name adoptConnection
+  /// @brief Registers a connection accepted by this reactor. Called by the accept handler on the reactor thread
+  /// @param[in] socket : accepted socket
+  /// @throws None
+  void UringReactor::adoptConnection(SocketFileDescriptor socket)
+  {
+    registerConnection(std::move(socket));
+  }
+
+  /// @class UringReactor
+  /// @name sendResponse
+  /// @brief Hands a response over to a connection owned by this reactor and sends everything which is in order.
+  ///        May be called from any thread
+  /// @param[in] connection : handle of the connection
+  /// @param[in] sequence : sequence number of the request
+  /// @param[in] response : segments to send, none to close the connection
+  /// @param[in] file : file region sent behind the segments, may be empty. io_uring has no sendfile, the region is
+  ///            mapped and sent from the page cache with sendmsg
+  /// @throws None
+  void UringReactor::sendResponse(const container::message_queue::ConnectionHandle connection, const uint64_t sequence, container::buffer::BufferSegments response,
+                                  container::buffer::FileRegion file)
+  {
+    post([this, id = connection.getId(), sequence, response = OutboundResponse{std::move(response), std::move(file)}]() mutable {
+      const auto it = connections_.find(id);
+      if (it == connections_.end() || it->second.closing)
+      {
+        LOG_DEBUG("Dropping response for closed connection! id: {}", id);
+        return;
+      }
+
+      UringConnection& connection = it->second;
+      if (!connection.protocol.respond(sequence, std::move(response)))
+        return;
+
+      if (!connection.send_in_flight && connection.protocol.isFinished())
+      {
+        closeConnection(id);
+        return;
+      }
+
+      if (!connection.send_in_flight && connection.protocol.hasPendingOutput())
+        submitSend(id, connection);
+      updateDeadline(id, connection, false);
+    });
+  }
+
+  /// @class UringReactor
+  /// @name setCpuAffinity
+  /// @brief Sets the CPU the reactor thread gets pinned to when it starts
+  /// @param[in] cpu : CPU index or NO_CPU_AFFINITY
+  /// @throws None
+  void UringReactor::setCpuAffinity(int cpu)
+  {
+    cpu_ = cpu;
+  }
+
+  /// @class UringReactor
+  /// @name start
+  /// @brief Starts the reactor thread
+  /// @throws None
+  void UringReactor::start()
+  {
+    running_ = true;
+    worker_ = std::thread([this]() { run(); });
+    LOG_DEBUG("Started io_uring reactor thread (TID: {})", logging::formatThreadId(worker_.get_id()));
+  }
+
+  /// @class UringReactor
+  /// @name stop
+  /// @brief Signals the reactor thread to leave its event loop and joins it
+  /// @throws None
+  void UringReactor::stop()
+  {
+    running_ = false;
+    const uint64_t one{1};
+    [[maybe_unused]] const ssize_t result = write(wakeup_fd_, &one, sizeof(one));
+
+    if (worker_.joinable() && worker_.get_id() != std::this_thread::get_id())
+      worker_.join();
+  }
+
+  /// @class UringReactor
+  /// @name run
+  /// @brief Event loop executed by the reactor thread
+  /// @throws None
+  void UringReactor::run()
+  {
+    const logging::Trace trace(__func__);
+    if (cpu_ != NO_CPU_AFFINITY && !pinCurrentThreadToCpu(cpu_))
+    {
+      LOG_WARNING("Pinning reactor thread to CPU {} failed", cpu_);
+    }
+
+    while (running_)
+    {
+      submitAndWait(getWaitTimeout());
+      now_ = std::chrono::steady_clock::now();
+
+      // handlers may reap further completions while submitting, they are appended behind the ones reaped here
+      reapCompletions();
+      for (std::size_t i = 0; i < completions_.size(); ++i)
+      {
+        const io_uring_cqe cqe = completions_[i];
+        handleCompletion(cqe);
+      }
+      completions_.clear();
+
+      flushReceivedMessages();
+
+      if (reading_paused_ && hasQueueDrained(message_queue_))
+        resumeReading();
+
+      expireTimers();
+    }
+  }
+
+  /// @class UringReactor
+  /// @name getWaitTimeout
+  /// @brief Time io_uring_enter() may wait for a completion: until the next timer of the wheel, at most
+  ///        BACKPRESSURE_CHECK_INTERVAL while reading is paused, not at all if completions were reaped already
+  /// @returns wait timeout, empty to wait for the next completion
+  /// @throws None
+  std::optional<std::chrono::nanoseconds> UringReactor::getWaitTimeout() const
+  {
+    if (!completions_.empty())
+      return std::chrono::nanoseconds::zero();
+
+    std::optional<std::chrono::nanoseconds> timeout;
+    if (const auto next_expiry = timers_.getNextExpiry())
+      timeout = std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(*next_expiry - now_), std::chrono::nanoseconds::zero());
+
+    if (reading_paused_)
+      timeout = timeout ? std::min<std::chrono::nanoseconds>(*timeout, BACKPRESSURE_CHECK_INTERVAL) : BACKPRESSURE_CHECK_INTERVAL;
+    return timeout;
+  }
+
+  /// @class UringReactor
+  /// @name expireTimers
+  /// @brief Closes the connections whose deadline passed. A timer expiring before the deadline of its connection,
+  ///        because the connection moved on to a later one, is re-armed
+  /// @throws None
+  void UringReactor::expireTimers()
+  {
+    timers_.advance(now_, expired_timers_);
+    for (const uint64_t id : expired_timers_)
+    {
+      const auto it = connections_.find(id);
+      if (it == connections_.end() || it->second.closing || !it->second.protocol.getDeadline().expire(timers_, id, now_))
+        continue;
+
+      LOG_DEBUG("Closing connection after {} timeout! id: {}", it->second.protocol.getDeadline().getName(), id);
+      ServerMetrics::get().connection_timeouts.add();
+      closeConnection(id);
+    }
+    expired_timers_.clear();
+  }
+
+  /// @class UringReactor
+  /// @name flushReceivedMessages
+  /// @brief Hands all messages received during one loop iteration to the message queue in a single batch. The
+  ///        messages the queue refuses are shed, once it is full under backpressure reading stops
+  /// @throws None
+  void UringReactor::flushReceivedMessages()
+  {
+    if (received_messages_.empty())
+      return;
+
+    const std::size_t accepted = message_queue_.enqueueReceivedMessages(received_messages_.data(), received_messages_.size());
+    for (std::size_t i = accepted; i < received_messages_.size(); ++i)
+    {
+      shedRequest(received_messages_[i]);
+    }
+    received_messages_.clear();
+
+    if (!reading_paused_ && isQueueFull(message_queue_))
+      pauseReading();
+  }
+
+  /// @class UringReactor
+  /// @name shedRequest
+  /// @brief Answers a request the message queue refused with 503 right away, in order with the other responses
+  /// @param[in] message : refused request
+  /// @throws None
+  void UringReactor::shedRequest(const container::message_queue::Message &message)
+  {
+    ServerMetrics::get().shed_requests.add();
+    const uint64_t id = message.getConnection().getId();
+    const auto it = connections_.find(id);
+    if (it == connections_.end() || it->second.closing)
+      return;
+
+    UringConnection& connection = it->second;
+    connection.protocol.respond(message.getSequence(), {{http::serviceUnavailableResponse()}, {}});
+    if (!connection.send_in_flight && connection.protocol.hasPendingOutput())
+      submitSend(id, connection);
+    updateDeadline(id, connection, false);
+  }
+
+  /// @class UringReactor
+  /// @name pauseReading
+  /// @brief Stops receiving on all connections until the message queue drained. The recvs are cancelled instead of
+  ///        leaving them armed, a multishot recv would keep consuming provided buffers
+  /// @throws None
+  void UringReactor::pauseReading()
+  {
+    LOG_DEBUG("Message queue full, pausing reads! reactor: {}", index_);
+    ServerMetrics::get().read_pauses.add();
+    reading_paused_ = true;
+    for (const auto& [id, connection] : connections_)
+    {
+      if (connection.recv_armed && !connection.closing)
+        cancelRecv(id);
+    }
+  }
+
+  /// @class UringReactor
+  /// @name resumeReading
+  /// @brief Re-arms the recvs which ended while reading was paused
+  /// @throws None
+  void UringReactor::resumeReading()
+  {
+    LOG_DEBUG("Message queue drained, resuming reads! reactor: {}", index_);
+    reading_paused_ = false;
+    for (const uint64_t id : deferred_recvs_)
+    {
+      const auto it = connections_.find(id);
+      if (it != connections_.end() && !it->second.closing && !it->second.recv_armed && it->second.protocol.isAcceptingRequests())
+        armRecv(id, it->second);
+    }
+    deferred_recvs_.clear();
+  }
+
+  /// @class UringReactor
+  /// @name handleCompletion
+  /// @brief Dispatches a single completion entry
+  /// @throws None
+  void UringReactor::handleCompletion(const io_uring_cqe &cqe)
+  {
+    const auto operation = static_cast<Operation>(cqe.user_data >> 56);
+    const uint64_t id = cqe.user_data & 0x00FFFFFFFFFFFFFF;
+
+    switch (operation)
+    {
+      case Operation::WAKEUP:
+        runPendingTasks();
+        if (running_)
+          armWakeup();
+        break;
+      case Operation::ACCEPT:
+        handleAccept(cqe);
+        break;
+      case Operation::RECV:
+        handleRecv(id, cqe);
+        break;
+      case Operation::SEND:
+        handleSend(id, cqe);
+        break;
+      case Operation::CANCEL:
+        break;
+    }
+  }
+
+  /// @class UringReactor
+  /// @name handleAccept
+  /// @brief Handles a completion of the multishot accept and re-arms it once the kernel terminated it
+  /// @throws None
+  void UringReactor::handleAccept(const io_uring_cqe &cqe)
+  {
+    if (cqe.res >= 0)
+    {
+      accept_handler_(cqe.res);
+    }
+    else if (cqe.res != -ECANCELED)
+    {
+      LOG_WARNING("Failed to accept incoming connection ({})", strerror(-cqe.res));
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE) && running_)
+      armAccept();
+  }
+
+  /// @class UringReactor
+  /// @name handleRecv
+  /// @brief Handles a completion of a multishot recv: passes the data on to the request parser and recycles the
+  ///        provided buffer right away
+  /// @throws None
+  void UringReactor::handleRecv(uint64_t id, const io_uring_cqe &cqe)
+  {
+    const auto it = connections_.find(id);
+    const char* provided_buffer{nullptr};
+    uint16_t buffer_id{0};
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+    {
+      buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      provided_buffer = buffers_.data() + static_cast<std::size_t>(buffer_id) * SIZE_BUFFER;
+    }
+
+    if (it == connections_.end())
+    {
+      if (provided_buffer)
+        recycleBuffer(buffer_id);
+      return;
+    }
+
+    UringConnection& connection = it->second;
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+      connection.recv_armed = false;
+
+    // data behind the last request of the connection is ignored
+    if (provided_buffer)
+    {
+      if (cqe.res > 0 && !connection.closing && connection.protocol.isAcceptingRequests())
+        receiveRequests(id, connection, provided_buffer, cqe.res);
+      recycleBuffer(buffer_id);
+    }
+
+    if (connection.closing)
+    {
+      releaseIfDone(id);
+      return;
+    }
+
+    // a recv cancelled by pauseReading() ends like one which ran out of buffers
+    if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+    {
+      LOG_WARNING("Read failed! fd: {} ({})", connection.socket.operator int(), strerror(-cqe.res));
+      closeConnection(id);
+      return;
+    }
+
+    // the peer may shut down its side after the last request and still wait for the responses
+    if (cqe.res == 0)
+      connection.protocol.setLastRequest();
+
+    if (connection.protocol.isFinished() && !connection.send_in_flight)
+    {
+      closeConnection(id);
+      return;
+    }
+
+    if (!connection.recv_armed && connection.protocol.isAcceptingRequests() && reading_paused_)
+      deferred_recvs_.push_back(id);
+    else if (!connection.recv_armed && connection.protocol.isAcceptingRequests())
+      armRecv(id, connection);
+    updateDeadline(id, connection, false);
+  }
+
+  /// @class UringReactor
+  /// @name receiveRequests
+  /// @brief Copies received bytes into the receive buffer of the connection and hands every complete request to the
+  ///        message queue as a slice of that buffer. This is the only copy on the way to the handler; provided buffers
+  ///        belong to the kernel and cannot be lent out. The error response to a rejected request is sent right away
+  /// @throws None
+  void UringReactor::receiveRequests(uint64_t id, UringConnection &connection, const char *data, std::size_t size)
+  {
+    container::buffer::ReceiveBuffer& buffer = connection.protocol.getReceiveBuffer();
+    if (buffer.prepare(size))
+    {
+      std::memcpy(buffer.writePosition(), data, size);
+      buffer.commit(size);
+      ServerMetrics::get().bytes_received.add(size);
+      connection.protocol.extractRequests(container::message_queue::ConnectionHandle{index_, id}, received_messages_, now_);
+    }
+    else
+    {
+      connection.protocol.rejectTooLarge();
+    }
+
+    if (!connection.send_in_flight && connection.protocol.hasPendingOutput())
+      submitSend(id, connection);
+  }
+
+  /// @class UringReactor
+  /// @name handleSend
+  /// @brief Handles a completion of a sendmsg. A short send leaves the rest in the outbound queue, which is resubmitted
+  ///        together with everything queued in the meantime
+  /// @throws None
+  void UringReactor::handleSend(uint64_t id, const io_uring_cqe &cqe)
+  {
+    const auto it = connections_.find(id);
+    if (it == connections_.end())
+      return;
+
+    UringConnection& connection = it->second;
+    connection.send_in_flight = false;
+
+    if (cqe.res >= 0)
+    {
+      ServerMetrics::get().bytes_sent.add(static_cast<uint64_t>(cqe.res));
+      if (connection.protocol.getSendQueue().advance(cqe.res))
+      {
+        LOG_DEBUG("Send successful! fd: {}", connection.socket.operator int());
+      }
+    }
+    else if (cqe.res != -ECANCELED && !connection.closing)
+    {
+      LOG_INFO("Send failed! fd: {} ({})", connection.socket.operator int(), strerror(-cqe.res));
+      ServerMetrics::get().send_failures.add();
+      closeConnection(id);
+      return;
+    }
+
+    if (connection.closing)
+    {
+      releaseIfDone(id);
+      return;
+    }
+
+    if (connection.protocol.isFinished())
+    {
+      closeConnection(id);
+      return;
+    }
+
+    if (connection.protocol.hasPendingOutput())
+      submitSend(id, connection);
+    updateDeadline(id, connection, cqe.res > 0);
+  }
+
+  /// @class UringReactor
+  /// @name updateDeadline
+  /// @brief Picks the timeout for the state of the connection and makes sure its timer expires no later than the
+  ///        deadline
+  /// @param[in] response_progress : bytes of a response were sent by the completion handled
+  /// @throws None
+  void UringReactor::updateDeadline(const uint64_t id, UringConnection &connection, const bool response_progress)
+  {
+    connection.protocol.updateDeadline(response_progress, now_);
+    connection.protocol.getDeadline().arm(timers_, id);
+  }
+
+  /// @class UringReactor
+  /// @name registerConnection
+  /// @brief Adds an accepted connection and starts receiving on it. Executed by the reactor thread
+  /// @param[in] socket : accepted socket
+  /// @throws None
+  void UringReactor::registerConnection(SocketFileDescriptor socket)
+  {
+    const int fd = socket;
+    if (clearNonBlocking(fd) < 0)
+    {
+      LOG_WARNING("Registering connection failed! fd: {} ({})", fd, strerror(errno));
+      return;
+    }
+
+    const uint64_t id = next_connection_id_++;
+    UringConnection& connection = connections_.try_emplace(id, std::move(socket), now_).first->second;
+    connection.protocol.getDeadline().arm(timers_, id);
+    if (reading_paused_)
+      deferred_recvs_.push_back(id);
+    else
+      armRecv(id, connection);
+    ServerMetrics::get().open_connections.add();
+    LOG_DEBUG("Connection registered! fd: {} id: {}", fd, id);
+  }
+
+  /// @class UringReactor
+  /// @name closeConnection
+  /// @brief Shuts a connection down. Its state is released once the kernel finished all operations referencing it
+  /// @throws None
+  void UringReactor::closeConnection(uint64_t id)
+  {
+    UringConnection& connection = connections_.at(id);
+    connection.closing = true;
+    connection.protocol.getDeadline().disarm(timers_);
+    shutdown(connection.socket, SHUT_RDWR);
+    releaseIfDone(id);
+  }
+
+  /// @class UringReactor
+  /// @name releaseIfDone
+  /// @brief Closes the socket of a closing connection once no recv or send is in flight anymore
+  /// @throws None
+  void UringReactor::releaseIfDone(uint64_t id)
+  {
+    const auto it = connections_.find(id);
+    if (it == connections_.end())
+      return;
+
+    if (it->second.closing && !it->second.send_in_flight && !it->second.recv_armed)
+    {
+      connections_.erase(it);
+      ServerMetrics::get().open_connections.sub();
+    }
+  }
+
+  /// @class UringReactor
+  /// @name post
+  /// @brief Queues a task for execution on the reactor thread
+  /// @param[in] task : task to execute
+  /// @throws None
+  void UringReactor::post(std::function<void(void)> task)
+  {
+    {
+      std::lock_guard<std::mutex> guard(pending_tasks_mutex_);
+      pending_tasks_.emplace_back(std::move(task));
+    }
+
+    const uint64_t one{1};
+    [[maybe_unused]] const ssize_t result = write(wakeup_fd_, &one, sizeof(one));
+  }
+
+  /// @class UringReactor
+  /// @name runPendingTasks
+  /// @brief Executes all tasks posted from other threads
+  /// @throws None
+  void UringReactor::runPendingTasks()
+  {
+    std::vector<std::function<void(void)>> tasks;
+    {
+      std::lock_guard<std::mutex> guard(pending_tasks_mutex_);
+      tasks.swap(pending_tasks_);
+    }
+
+    for (auto& task : tasks)
+    {
+      task();
+    }
+  }
+}
@@ -0,0 +1,175 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_URINGREACTOR_HPP
+#define WEBSERVER_URINGREACTOR_HPP
+
+#include "connectionprotocol.hpp"
+#include "reactor.hpp"
+#include "messagequeue.hpp"
+#include "socketfiledescriptor.hpp"
+#include "timerwheel.hpp"
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace network::tcp
+{
+  ///@brief Completion based event loop on top of io_uring (raw syscalls). Uses multishot accept, multishot recv with a
+  ///       kernel-provided buffer ring and gathering sendmsg, so a whole loop iteration costs a single io_uring_enter()
+  class UringReactor : public Reactor
+  {
+  private:
+    static constexpr unsigned RING_ENTRIES{1024};
+    static constexpr unsigned NUMBER_BUFFERS{512};   // must be a power of two
+    static constexpr unsigned SIZE_BUFFER{2048};
+    static constexpr uint16_t BUFFER_GROUP{0};
+    static constexpr std::size_t MAX_SEND_VECTORS{16};
+
+    enum class Operation : uint8_t
+    {
+      WAKEUP,
+      ACCEPT,
+      RECV,
+      SEND,
+      CANCEL,
+    };
+
+    struct UringConnection
+    {
+      SocketFileDescriptor socket;
+      ConnectionProtocol protocol;
+      iovec send_vectors[MAX_SEND_VECTORS]{};
+      msghdr send_header{};
+      bool send_in_flight{false};
+      bool recv_armed{false};
+      bool closing{false};
+
+      // io_uring has no sendfile, file regions are mapped and sent from the page cache with sendmsg
+      UringConnection(SocketFileDescriptor socket, std::chrono::steady_clock::time_point now)
+        : socket(std::move(socket)), protocol(this->socket, SendQueue::FileTransfer::MAP, now)
+      {}
+    };
+
+    int ring_fd_{-1};
+
+    // submission queue ring, shares its mapping with the completion queue ring
+    void* sq_ring_{nullptr};
+    std::size_t sq_ring_size_{0};
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned* sq_array_{nullptr};
+    io_uring_sqe* sqes_{nullptr};
+    std::size_t sqes_size_{0};
+    unsigned sq_entries_{0};
+    unsigned pending_submissions_{0};
+
+    // completion queue ring
+    void* cq_ring_{nullptr};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+    std::vector<io_uring_cqe> completions_;   // taken off the ring, handled in order by the event loop
+
+    // provided buffer ring
+    void* buffer_ring_{nullptr};
+    std::size_t buffer_ring_size_{0};
+    std::vector<char> buffers_;
+    uint16_t buffer_ring_tail_{0};
+
+    int wakeup_fd_{-1};
+    uint64_t wakeup_counter_{0};
+    int listen_fd_{-1};
+    AcceptHandler accept_handler_;
+
+    container::message_queue::Queue& message_queue_;
+    const uint16_t index_;
+
+    // only accessed by the reactor thread
+    uint64_t next_connection_id_{1};
+    std::unordered_map<uint64_t, UringConnection> connections_;
+    std::vector<container::message_queue::Message> received_messages_;
+    bool reading_paused_{false};
+    std::vector<uint64_t> deferred_recvs_;   // connections whose recv ended while reading was paused
+    std::chrono::steady_clock::time_point now_{std::chrono::steady_clock::now()};
+    container::TimerWheel timers_{TIMER_RESOLUTION, now_};   // one deadline timer per connection, the payload is its id
+    std::vector<uint64_t> expired_timers_;
+
+    std::mutex pending_tasks_mutex_;
+    std::vector<std::function<void(void)>> pending_tasks_;
+
+    int cpu_{NO_CPU_AFFINITY};
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+
+    static uint64_t encodeUserData(Operation operation, uint64_t id);
+
+    void setupRing();
+    void setupBufferRing();
+    void releaseRing();
+
+    io_uring_sqe* acquireSqe();
+    void submitAndWait(std::optional<std::chrono::nanoseconds> timeout);
+    void reapCompletions();
+    void recycleBuffer(uint16_t buffer_id);
+
+    void armWakeup();
+    void armAccept();
+    void armRecv(uint64_t id, UringConnection& connection);
+    void cancelRecv(uint64_t id);
+    void submitSend(uint64_t id, UringConnection& connection);
+
+    void run();
+    [[nodiscard]] std::optional<std::chrono::nanoseconds> getWaitTimeout() const;
+    void expireTimers();
+    void post(std::function<void(void)> task);
+    void runPendingTasks();
+    void flushReceivedMessages();
+    void shedRequest(const container::message_queue::Message& message);
+    void pauseReading();
+    void resumeReading();
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleAccept(const io_uring_cqe& cqe);
+    void handleRecv(uint64_t id, const io_uring_cqe& cqe);
+    void receiveRequests(uint64_t id, UringConnection& connection, const char* data, std::size_t size);
+    void handleSend(uint64_t id, const io_uring_cqe& cqe);
+    void updateDeadline(uint64_t id, UringConnection& connection, bool response_progress);
+
+    void registerConnection(SocketFileDescriptor socket);
+    void closeConnection(uint64_t id);
+    void releaseIfDone(uint64_t id);
+
+  public:
+    UringReactor(container::message_queue::Queue& message_queue, uint16_t index);
+    ~UringReactor() override;
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    void watchListeningSocket(int listen_fd, AcceptHandler handler) override;
+    void addConnection(SocketFileDescriptor socket) override;
+    void adoptConnection(SocketFileDescriptor socket) override;
+    void sendResponse(container::message_queue::ConnectionHandle connection, uint64_t sequence, container::buffer::BufferSegments response,
+                      container::buffer::FileRegion file) override;
+
+    void setCpuAffinity(int cpu) override;
+    void start() override;
+    void stop() override;
+  };
+}
+
+#endif //WEBSERVER_URINGREACTOR_HPP
@@ -0,0 +1,257 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "benchmark.hpp"
+#include "trace.hpp"
+#include "messagequeue.hpp"
+#include "lockfreemessagequeue.hpp"
+#include "httprequest.hpp"
+#include "simdscan.hpp"
+#include "ipaddress.hpp"
+#include "metrics.hpp"
+#include "timerwheel.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  constexpr std::string_view REQUEST{"GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: webserver_bench\r\n"
+                                     "Accept: text/html,application/xhtml+xml\r\nAccept-Encoding: gzip, deflate\r\n"
+                                     "Connection: keep-alive\r\n\r\n"};
+
+  ///@brief Producers enqueue and consumers retrieve iterations messages in total, rounded up so every thread moves
+  ///       the same number. Includes starting and joining the threads, which is amortised by the message count
+  template<typename QueueType>
+  benchmark::Function queueBenchmark(const std::size_t producers, const std::size_t consumers)
+  {
+    return [producers, consumers](const uint64_t iterations) {
+      const uint64_t threads = producers * consumers;
+      const uint64_t total = (iterations + threads - 1) / threads * threads;
+      QueueType queue;
+      std::vector<std::thread> workers;
+      for (std::size_t i = 0; i < consumers; ++i)
+      {
+        workers.emplace_back([&queue, count = total / consumers] {
+          for (uint64_t n = 0; n < count; ++n)
+            benchmark::doNotOptimize(queue.retrieveReceivedMessage().getSequence());
+        });
+      }
+      for (std::size_t i = 0; i < producers; ++i)
+      {
+        workers.emplace_back([&queue, count = total / producers] {
+          for (uint64_t n = 0; n < count; ++n)
+            queue.enqueueReceivedMessage({container::buffer::BufferSlice::fromStatic(REQUEST), {0, 1}, n});
+        });
+      }
+      for (auto& worker : workers)
+        worker.join();
+    };
+  }
+
+  void addQueueBenchmarks(benchmark::Runner &runner)
+  {
+    const std::pair<std::size_t, std::size_t> configurations[]{{1, 1}, {2, 2}, {4, 4}, {4, 1}, {1, 4}};
+    for (const auto& [producers, consumers] : configurations)
+    {
+      runner.add(fmt::format("queue/socket/{}p{}c", producers, consumers),
+                 queueBenchmark<network::tcp::SocketMessageQueue>(producers, consumers));
+      runner.add(fmt::format("queue/lockfree/{}p{}c", producers, consumers),
+                 queueBenchmark<network::tcp::LockFreeMessageQueue>(producers, consumers));
+    }
+  }
+
+  void addLoggingBenchmarks(benchmark::Runner &runner)
+  {
+    // records are formatted and written, but the stream discards them
+    static std::ostream null_stream{nullptr};
+    logging::Logger& logger = logging::Logger::getInstance();
+    logger.setOutputStream(null_stream);
+    logger.setLogThreadId(true);
+
+    runner.add("log/disabled", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::ERROR);
+      for (uint64_t i = 0; i < iterations; ++i)
+        LOG_DEBUG("Message received: {} on fd {}", REQUEST, i);
+    });
+    runner.add("log/enabled_sync", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::DEBUG);
+      for (uint64_t i = 0; i < iterations; ++i)
+        LOG_INFO("Send successful! fd: {}", i);
+    });
+    runner.add("log/enabled_async", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::DEBUG);
+      logger.startAsync(logging::OverflowPolicy::BLOCK);
+      for (uint64_t i = 0; i < iterations; ++i)
+        LOG_INFO("Send successful! fd: {}", i);
+      logger.stopAsync();
+    });
+    runner.add("trace/disabled", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::INFO);
+      for (uint64_t i = 0; i < iterations; ++i)
+        const logging::Trace trace(__func__);
+    });
+    runner.add("trace/enabled_sync", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::DEBUG);
+      for (uint64_t i = 0; i < iterations; ++i)
+        const logging::Trace trace(__func__);
+    });
+    runner.add("trace/spans", [&logger](const uint64_t iterations) {
+      logger.setLogLevel(logging::LogLevel::INFO);
+      logging::SpanRecorder::getInstance().start();
+      for (uint64_t i = 0; i < iterations; ++i)
+        const logging::Trace trace(__func__);
+      logging::SpanRecorder::getInstance().stop();
+    });
+    runner.add("log/format_time_same_second", [](const uint64_t iterations) {
+      timespec time{1700000000, 0};
+      for (uint64_t i = 0; i < iterations; ++i)
+      {
+        time.tv_nsec = static_cast<long>(i % 1000U) * 1000000L;
+        benchmark::doNotOptimize(logging::Logger::formatTime(time).data());
+      }
+    });
+    runner.add("log/format_time_new_second", [](const uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i)
+        benchmark::doNotOptimize(logging::Logger::formatTime({static_cast<time_t>(1700000000 + i), 0}).data());
+    });
+  }
+
+  void addNetworkBenchmarks(benchmark::Runner &runner)
+  {
+    runner.add("ipv4/to_string", [](const uint64_t iterations) {
+      const network::ip::IPv4Address address(127, 0, 0, 1);
+      for (uint64_t i = 0; i < iterations; ++i)
+        benchmark::doNotOptimize(address.to_string().size());
+    });
+    runner.add("ipv4/in_addr_t", [](const uint64_t iterations) {
+      const network::ip::IPv4Address address(192, 168, 100, 200);
+      for (uint64_t i = 0; i < iterations; ++i)
+        benchmark::doNotOptimize(static_cast<in_addr_t>(address));
+    });
+
+    runner.add("http/parse_request", [](const uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i)
+      {
+        network::http::RequestParser parser;
+        benchmark::doNotOptimize(parser.parse(REQUEST));
+      }
+    });
+
+    namespace scan = network::http::scan;
+    static const std::string headers = [] {
+      std::string data;
+      while (data.size() < 4096)
+        data += "X-Forwarded-For: 192.168.100.200, 10.0.0.1\r\n";
+      return data + "\r\n";
+    }();
+    for (const scan::Isa isa : {scan::Isa::SCALAR, scan::Isa::SSE42, scan::Isa::AVX2})
+    {
+      if (!scan::isSupported(isa))
+        continue;
+
+      runner.add(fmt::format("scan/header_end_4k/{}", scan::toString(isa)), [isa](const uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i)
+          benchmark::doNotOptimize(scan::findHeaderEnd(isa, headers));
+      });
+      runner.add(fmt::format("scan/controls_4k/{}", scan::toString(isa)), [isa](const uint64_t iterations) {
+        uint32_t positions[256];
+        for (uint64_t i = 0; i < iterations; ++i)
+          benchmark::doNotOptimize(scan::findControls(isa, headers, positions, std::size(positions)));
+      });
+    }
+  }
+
+  void addMetricsBenchmarks(benchmark::Runner &runner)
+  {
+    static metrics::Counter counter;
+    static metrics::Histogram histogram;
+    runner.add("metrics/counter_add", [](const uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i)
+        counter.add();
+    });
+    runner.add("metrics/histogram_observe", [](const uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i)
+        histogram.observe(i);
+    });
+  }
+
+  void addTimerBenchmarks(benchmark::Runner &runner)
+  {
+    // a reactor with 10k connections: every operation reschedules the deadline of one of them
+    runner.add("timer/reschedule_10k", [](const uint64_t iterations) {
+      constexpr std::size_t CONNECTIONS{10000};
+      const auto start = container::TimerWheel::Clock::now();
+      container::TimerWheel timers(std::chrono::milliseconds(10), start);
+      std::vector<container::TimerWheel::Handle> handles(CONNECTIONS);
+      for (std::size_t i = 0; i < CONNECTIONS; ++i)
+        handles[i] = timers.schedule(start + std::chrono::seconds(30), i);
+
+      for (uint64_t i = 0; i < iterations; ++i)
+      {
+        const std::size_t connection = i % CONNECTIONS;
+        timers.cancel(handles[connection]);
+        handles[connection] = timers.schedule(start + std::chrono::seconds(10) + std::chrono::microseconds(i % 20000000U), connection);
+      }
+      benchmark::doNotOptimize(timers.size());
+    });
+    runner.add("timer/advance_expire", [](const uint64_t iterations) {
+      const auto start = container::TimerWheel::Clock::now();
+      container::TimerWheel timers(std::chrono::milliseconds(10), start);
+      std::vector<uint64_t> expired;
+      for (uint64_t i = 0; i < iterations; ++i)
+        timers.schedule(start + std::chrono::milliseconds(i % 60000U), i);
+      timers.advance(start + std::chrono::minutes(1), expired);
+      benchmark::doNotOptimize(expired.size());
+    });
+  }
+}
+
+// Microbenchmarks of the hot paths: webserver_bench [--filter=<substring>] [--json=<file>] [--min-time=<ms>] [--repetitions=<n>]
+int main(int argc, char* argv[])
+{
+  benchmark::Runner runner;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string argument{argv[i]};
+    if (argument.rfind("--filter=", 0) == 0)
+      runner.setFilter(argument.substr(9));
+    else if (argument.rfind("--json=", 0) == 0)
+      json_path = argument.substr(7);
+    else if (argument.rfind("--min-time=", 0) == 0)
+      runner.setMinTime(std::chrono::milliseconds(std::stoul(argument.substr(11))));
+    else if (argument.rfind("--repetitions=", 0) == 0)
+      runner.setRepetitions(std::stoul(argument.substr(14)));
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--filter=<substring>] [--json=<file>] [--min-time=<ms>] [--repetitions=<n>]" << std::endl;
+      return 2;
+    }
+  }
+
+  addQueueBenchmarks(runner);
+  addLoggingBenchmarks(runner);
+  addNetworkBenchmarks(runner);
+  addMetricsBenchmarks(runner);
+  addTimerBenchmarks(runner);
+
+  const std::vector<benchmark::Result> results = runner.run(std::cout);
+
+  if (!json_path.empty())
+  {
+    std::ofstream out(json_path, std::ios::trunc);
+    if (!out)
+    {
+      std::cerr << "Cannot open " << json_path << std::endl;
+      return 1;
+    }
+    benchmark::Runner::writeJson(out, results);
+  }
+  return 0;
+}
@@ -0,0 +1,252 @@
+//
+// Created by david on 17/10/26.
+//
+
+#include "workerpool.hpp"
+#include "error.hpp"
+#include "trace.hpp"
+
+namespace concurrency
+{
+  thread_local WorkerPool* WorkerPool::current_pool_{nullptr};
+  thread_local std::size_t WorkerPool::current_worker_{0};
+
+  /// @class WorkerPool
+  /// @name WorkerPool
+  /// @brief constructor
+  /// @param[in] message_queue : queue the received messages are pulled from
+  /// @param[in] handler : gets called by a worker thread for every received message
+  /// @param[in] number_workers : number of worker threads
+  /// @throws logging::Error
+  WorkerPool::WorkerPool(container::message_queue::Queue &message_queue, Handler handler, const std::size_t number_workers) :
+      message_queue_(message_queue), handler_(std::move(handler))
+  {
+    const logging::Trace trace(__func__);
+    if (number_workers == 0)
+    {
+      throw logging::Error(LOC, "At least one worker is required");
+    }
+
+    for (std::size_t i = 0; i < number_workers; ++i)
+    {
+      workers_.emplace_back(std::make_unique<Worker>());
+    }
+  }
+
+  /// @class WorkerPool
+  /// @name ~WorkerPool
+  /// @brief destructor which stops and joins all workers
+  /// @throws None
+  WorkerPool::~WorkerPool()
+  {
+    const logging::Trace trace(__func__);
+    shutdown();
+  }
+
+  /// @class WorkerPool
+  /// @name start
+  /// @brief Starts all worker threads
+  /// @throws None
+  void WorkerPool::start()
+  {
+    const logging::Trace trace(__func__);
+    for (std::size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->thread = std::thread([this, i]() { run(i); });
+      LOG_DEBUG("Started worker thread (TID: {})", logging::formatThreadId(workers_[i]->thread.get_id()));
+    }
+  }
+
+  /// @class WorkerPool
+  /// @name submit
+  /// @brief Queues a task. Called from a worker the task goes to that worker's deque, otherwise the deques are used round-robin
+  /// @param[in] task : task to execute
+  /// @throws None
+  void WorkerPool::submit(Task task)
+  {
+    const std::size_t index = (current_pool_ == this) ? current_worker_
+                                                      : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+      std::lock_guard<std::mutex> guard(workers_[index]->tasks_mutex);
+      workers_[index]->tasks.push_back({std::move(task), std::nullopt});
+    }
+    queued_items_.fetch_add(1);
+
+    std::lock_guard<std::mutex> idle_guard(idle_mutex_);
+    idle_cv_.notify_one();
+  }
+
+  /// @class WorkerPool
+  /// @name shutdown
+  /// @brief Stops all workers and joins them. Also shuts the message queue down to release the worker blocked on it.
+  ///        Pending tasks are discarded
+  /// @throws None
+  void WorkerPool::shutdown()
+  {
+    const logging::Trace trace(__func__);
+    stopping_ = true;
+    message_queue_.shutdown();
+    {
+      std::lock_guard<std::mutex> idle_guard(idle_mutex_);
+      idle_cv_.notify_all();
+    }
+
+    for (auto& worker : workers_)
+    {
+      if (worker->thread.joinable() && worker->thread.get_id() != std::this_thread::get_id())
+        worker->thread.join();
+    }
+  }
+
+  /// @class WorkerPool
+  /// @name run
+  /// @brief Loop executed by every worker: own deque first, then stealing, then the message queue
+  /// @param[in] index : index of the executing worker
+  /// @throws None
+  void WorkerPool::run(const std::size_t index)
+  {
+    const logging::Trace trace(__func__);
+    current_pool_ = this;
+    current_worker_ = index;
+
+    while (!stopping_)
+    {
+      WorkItem item;
+      if (popLocal(index, item) || steal(index, item))
+      {
+        if (item.message)
+        {
+          handleMessage(*item.message);
+          continue;
+        }
+
+        try
+        {
+          item.task();
+        }
+        catch (const std::exception& e)
+        {
+          LOG_ERROR("Task failed: {}", e.what());
+        }
+        continue;
+      }
+
+      // items queued after the deques were checked are counted before the notification, which needs the idle mutex,
+      // so checking the count under it cannot miss a wakeup
+      std::unique_lock<std::mutex> idle_lock(idle_mutex_);
+      if (stopping_)
+        break;
+
+      if (queued_items_ > 0)
+        continue;
+
+      if (!fetching_)
+      {
+        if (!fetchMessages(idle_lock))
+          break;
+        continue;
+      }
+
+      idle_cv_.wait(idle_lock, [this]() { return stopping_ || !fetching_ || queued_items_ > 0; });
+    }
+  }
+
+  /// @class WorkerPool
+  /// @name popLocal
+  /// @brief Takes the most recently queued task of the own deque
+  /// @throws None
+  bool WorkerPool::popLocal(const std::size_t index, WorkItem &item)
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> guard(worker.tasks_mutex);
+    if (worker.tasks.empty())
+      return false;
+
+    item = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    queued_items_.fetch_sub(1);
+    return true;
+  }
+
+  /// @class WorkerPool
+  /// @name steal
+  /// @brief Takes the oldest task of another worker's deque
+  /// @throws None
+  bool WorkerPool::steal(const std::size_t index, WorkItem &item)
+  {
+    for (std::size_t offset = 1; offset < workers_.size(); ++offset)
+    {
+      Worker& victim = *workers_[(index + offset) % workers_.size()];
+      std::lock_guard<std::mutex> guard(victim.tasks_mutex);
+      if (victim.tasks.empty())
+        continue;
+
+      item = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_items_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  /// @class WorkerPool
+  /// @name fetchMessages
+  /// @brief Blocks on the message queue as the single leader and drains a batch of messages with one synchronisation
+  ///        round trip. The first message is handled right away, the rest is queued on the own deque for stealing
+  /// @param[in,out] idle_lock : locked idle mutex, released while blocking
+  /// @returns false once the message queue was shut down
+  /// @throws None
+  bool WorkerPool::fetchMessages(std::unique_lock<std::mutex> &idle_lock)
+  {
+    fetching_ = true;
+    idle_lock.unlock();
+
+    std::vector<container::message_queue::Message> messages;
+    messages.reserve(FETCH_BATCH_SIZE);
+    const std::size_t number_messages = message_queue_.retrieveReceivedMessages(messages, FETCH_BATCH_SIZE);
+
+    if (number_messages > 1)
+    {
+      // pushed in reverse, so the owner pops them in arrival order while thieves take the newest
+      Worker& worker = *workers_[current_worker_];
+      std::lock_guard<std::mutex> guard(worker.tasks_mutex);
+      for (std::size_t i = number_messages - 1; i > 0; --i)
+      {
+        worker.tasks.push_back({nullptr, std::move(messages[i])});
+      }
+      queued_items_.fetch_add(number_messages - 1);
+    }
+
+    idle_lock.lock();
+    fetching_ = false;
+    idle_lock.unlock();
+    if (number_messages > 1)
+      idle_cv_.notify_all();
+    else
+      idle_cv_.notify_one();
+
+    if (number_messages == 0)
+      return false;
+
+    handleMessage(messages.front());
+    return true;
+  }
+
+  /// @class WorkerPool
+  /// @name handleMessage
+  /// @brief Runs the handler on a message. Exceptions are logged and do not terminate the worker; the connection gets
+  ///        an empty response, which closes it instead of leaving the responses to later requests waiting
+  /// @throws None
+  void WorkerPool::handleMessage(const container::message_queue::Message &message)
+  {
+    try
+    {
+      handler_(message);
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Message handler failed: {}", e.what());
+      message_queue_.enqueueResponseMessage(message.respond(container::buffer::BufferSegments{}));
+    }
+  }
+}
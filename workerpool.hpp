@@ -0,0 +1,84 @@
+//
+// Created by david on 17/10/26.
+//
+
+#ifndef WEBSERVER_WORKERPOOL_HPP
+#define WEBSERVER_WORKERPOOL_HPP
+
+#include "messagequeue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace concurrency
+{
+  ///@brief Fixed size pool of worker threads which pull received messages from a message queue and run a handler on them.
+  ///       Every worker owns a deque of tasks; idle workers steal from the others. Only one idle worker at a time blocks
+  ///       on the message queue (leader/follower) and drains a batch of messages into its deque, the rest park until
+  ///       work is submitted or the leader hands over
+  class WorkerPool
+  {
+  public:
+    using Handler = std::function<void(const container::message_queue::Message&)>;
+    using Task = std::function<void(void)>;
+
+  private:
+    static constexpr std::size_t FETCH_BATCH_SIZE{32};
+
+    ///@brief Either a submitted task or a fetched message. Messages are move-only and therefore cannot be captured by a Task
+    struct WorkItem
+    {
+      Task task;
+      std::optional<container::message_queue::Message> message;
+    };
+
+    struct Worker
+    {
+      std::mutex tasks_mutex;
+      std::deque<WorkItem> tasks;
+      std::thread thread;
+    };
+
+    container::message_queue::Queue& message_queue_;
+    Handler handler_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    bool fetching_{false};
+    std::atomic<std::size_t> queued_items_{0};   // items in all deques, raised before idle workers are notified
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::size_t> next_worker_{0};
+
+    static thread_local WorkerPool* current_pool_;
+    static thread_local std::size_t current_worker_;
+
+    void run(std::size_t index);
+    bool popLocal(std::size_t index, WorkItem& item);
+    bool steal(std::size_t index, WorkItem& item);
+    bool fetchMessages(std::unique_lock<std::mutex>& idle_lock);
+    void handleMessage(const container::message_queue::Message& message);
+
+  public:
+    WorkerPool(container::message_queue::Queue& message_queue, Handler handler, std::size_t number_workers);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void start();
+    void submit(Task task);
+    void shutdown();
+
+    [[nodiscard]] std::size_t getNumberWorkers() const { return workers_.size(); }
+  };
+}
+
+#endif //WEBSERVER_WORKERPOOL_HPP